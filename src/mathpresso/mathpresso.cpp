@@ -84,6 +84,8 @@ const OpInfo op_info_table[kOpCount] = {
   ROW(Le           , Le           , 2, 8, 0, 0, LTR | F(Condition)                       , "<="             ),
   ROW(Gt           , Gt           , 2, 8, 0, 0, LTR | F(Condition)                       , ">"              ),
   ROW(Ge           , Ge           , 2, 8, 0, 0, LTR | F(Condition)                       , ">="             ),
+  ROW(LogAnd       , LogAnd       , 2,13, 0, 0, LTR | F(Condition)                       , "&&"             ),
+  ROW(LogOr        , LogOr        , 2,14, 0, 0, LTR | F(Condition)                       , "||"             ),
   ROW(Add          , Add          , 2, 6, 0, 0, LTR | F(Arithmetic)    | F(NopIfZero)    , "+"              ),
   ROW(Sub          , Sub          , 2, 6, 0, 0, LTR | F(Arithmetic)    | F(NopIfRZero)   , "-"              ),
   ROW(Mul          , Mul          , 2, 5, 0, 0, LTR | F(Arithmetic)    | F(NopIfOne)     , "*"              ),
@@ -128,7 +130,7 @@ MATHPRESSO_NOAPI Error make_error(Error error) {
 //! Used instead of nullptr in `Expression::_func`.
 //!
 //! Returns NaN.
-static void dummy_func(double* result, void*) {
+static void dummy_func(double* result, void*, void* const*) {
   *result = mp_get_nan();
 }
 
@@ -143,18 +145,26 @@ static const ContextImpl mp_context_null = { 0 };
 //! \internal
 //!
 //! Internal context data.
+//!
+//! A context can be derived from a `_parent` context, which is referenced, never copied. The `_scope` of a derived
+//! context chains to the scope of its parent, so symbols of the parent are resolved without being cloned. Since the
+//! parent is shared it's immutable - `mp_context_make_mutable()` only clones symbols of the derived context itself.
 struct ContextInternalImpl : public ContextImpl {
-  MATHPRESSO_INLINE ContextInternalImpl()
-    : _arena(32768),
+  MATHPRESSO_INLINE explicit ContextInternalImpl(ContextInternalImpl* parent = nullptr)
+    : _arena(parent ? kDerivedContextArenaSize : kContextArenaSize),
       _builder(_arena),
-      _scope(&_builder, nullptr, kAstScopeGlobal) {
+      _scope(&_builder, parent ? &parent->_scope : nullptr, kAstScopeGlobal),
+      _parent(parent) {
     mp_atomic_set(&_ref_count, 1);
   }
-  MATHPRESSO_INLINE ~ContextInternalImpl() {}
+  MATHPRESSO_INLINE ~ContextInternalImpl();
 
   Arena _arena;
   AstBuilder _builder;
   AstScope _scope;
+
+  //! Parent context (referenced) or nullptr.
+  ContextInternalImpl* _parent;
 };
 
 static MATHPRESSO_INLINE ContextImpl* mp_context_add_ref(ContextImpl* d) {
@@ -168,11 +178,85 @@ static MATHPRESSO_INLINE void mp_context_release(ContextImpl* d) {
     delete static_cast<ContextInternalImpl*>(d);
 }
 
+MATHPRESSO_INLINE ContextInternalImpl::~ContextInternalImpl() {
+  if (_parent)
+    mp_context_release(_parent);
+}
+
+// Clone parameters and the body of an inline function `src` to `dst`, which belongs to `d`.
+static Error mp_inline_clone(ContextInternalImpl* d, AstSymbol* dst, const AstSymbol* src) {
+  AstScope* src_scope = static_cast<AstScope*>(src->func_ptr());
+  AstScope* dst_scope = d->_builder.new_scope(&d->_scope, kAstScopeNested);
+  MATHPRESSO_NULLCHECK(dst_scope);
+
+  dst->set_func_ptr(dst_scope);
+  dst->set_func_args(0);
+
+  // Parameters are cloned first, the body is cloned with each parameter replaced by a variable of its clone.
+  AstNode* args[kMaxInlineParams];
+  uint32_t count = src->func_args();
+  Error err = kErrorOk;
+
+  AstSymbolHashIterator it(src_scope->symbols());
+  while (it.has()) {
+    AstSymbol* param = it.get();
+    StringRef name(param->_name, param->_name_size);
+
+    AstSymbol* cloned_param = d->_builder.new_symbol(name, param->hash_code(), kAstSymbolVariable, kAstScopeNested);
+    MATHPRESSO_NULLCHECK(cloned_param);
+
+    cloned_param->_symbol_flags = param->_symbol_flags;
+    cloned_param->set_var_slot_id(param->var_slot_id());
+    dst_scope->put_symbol(cloned_param);
+    it.next();
+  }
+
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    args[i] = d->_builder.new_node<AstVar>();
+    if (MATHPRESSO_UNLIKELY(!args[i])) {
+      err = MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+      break;
+    }
+  }
+
+  if (err == kErrorOk) {
+    AstSymbolHashIterator dst_it(dst_scope->symbols());
+    while (dst_it.has()) {
+      AstSymbol* param = dst_it.get();
+      static_cast<AstVar*>(args[param->var_slot_id()])->set_symbol(param);
+      param->increment_used_count();
+      dst_it.next();
+    }
+
+    AstNode* body = d->_builder.clone_node(src->node(), args);
+    if (body) {
+      dst->set_node(body);
+      dst->set_func_args(count);
+    }
+    else {
+      err = MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+    }
+  }
+
+  while (i)
+    d->_builder.delete_node(args[--i]);
+  return err;
+}
+
 static ContextImpl* mp_context_clone(ContextImpl* other_d) {
-  ContextInternalImpl* d = new(std::nothrow) ContextInternalImpl();
+  ContextInternalImpl* parent = nullptr;
+  if (other_d != &mp_context_null)
+    parent = static_cast<ContextInternalImpl*>(other_d)->_parent;
+
+  ContextInternalImpl* d = new(std::nothrow) ContextInternalImpl(parent);
   if (MATHPRESSO_UNLIKELY(!d))
     return nullptr;
 
+  // The parent is shared by both contexts, only symbols of `other_d` are cloned.
+  if (parent)
+    mp_context_add_ref(parent);
+
   if (other_d != &mp_context_null) {
     ContextInternalImpl* otherD = static_cast<ContextInternalImpl*>(other_d);
     AstSymbolHashIterator it(otherD->_scope._symbols);
@@ -195,9 +279,28 @@ static ContextImpl* mp_context_clone(ContextImpl* other_d) {
         case kAstSymbolVariable:
           cloned_symbol->set_var_slot_id(sym->var_slot_id());
           cloned_symbol->set_var_offset(sym->var_offset());
+          cloned_symbol->set_var_base(sym->var_base());
           cloned_symbol->_value = sym->value();
           break;
 
+        case kAstSymbolArray:
+          cloned_symbol->set_var_offset(sym->var_offset());
+          cloned_symbol->set_var_base(sym->var_base());
+          cloned_symbol->set_array_length(sym->array_length());
+          cloned_symbol->set_array_stride(sym->array_stride());
+          break;
+
+        case kAstSymbolTable:
+          cloned_symbol->set_var_offset(sym->var_offset());
+          cloned_symbol->set_var_base(sym->var_base());
+          cloned_symbol->set_array_length(sym->array_length());
+          cloned_symbol->set_array_stride(sym->array_stride());
+          cloned_symbol->set_table_knots(sym->table_knots());
+          cloned_symbol->set_table_flags(sym->table_flags());
+          cloned_symbol->set_table_x0(sym->table_x0());
+          cloned_symbol->set_table_scale(sym->table_scale());
+          break;
+
         case kAstSymbolIntrinsic:
         case kAstSymbolFunction:
           cloned_symbol->set_op_type(sym->op_type());
@@ -205,6 +308,14 @@ static ContextImpl* mp_context_clone(ContextImpl* other_d) {
           cloned_symbol->set_func_ptr(sym->func_ptr());
           break;
 
+        case kAstSymbolInline:
+          if (mp_inline_clone(d, cloned_symbol, sym) != kErrorOk) {
+            d->_builder.delete_symbol(cloned_symbol);
+            delete d;
+            return nullptr;
+          }
+          break;
+
         default:
           MATHPRESSO_ASSERT_NOT_REACHED();
       }
@@ -266,6 +377,25 @@ Context& Context::operator=(const Context& other) {
   return *this;
 }
 
+Error Context::derive_from(const Context& parent) {
+  ContextImpl* parent_d = parent._d;
+
+  // Deriving from an empty context is the same as starting with an empty one.
+  if (parent_d == &mp_context_null)
+    return reset();
+
+  ContextInternalImpl* d = new(std::nothrow) ContextInternalImpl(static_cast<ContextInternalImpl*>(mp_context_add_ref(parent_d)));
+  if (MATHPRESSO_UNLIKELY(!d)) {
+    mp_context_release(parent_d);
+    return MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+  }
+
+  mp_context_release(
+    mp_atomic_set_xchg_t<ContextImpl*>(
+      &_d, d));
+  return kErrorOk;
+}
+
 struct GlobalConstant {
   char name[8];
   double value;
@@ -315,6 +445,7 @@ Error Context::add_builtins(void) {
     sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsAssigned | kAstSymbolIsReadOnly);
     sym->set_var_slot_id(kInvalidSlot);
     sym->set_var_offset(0);
+    sym->set_var_base(0);
     sym->set_value(c.value);
 
     d->_scope.put_symbol(sym);
@@ -345,6 +476,9 @@ Error Context::add_constant(const char* name, double value) {
   MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
   MATHPRESSO_ADD_SYMBOL(name, kAstSymbolVariable);
 
+  sym->set_var_slot_id(kInvalidSlot);
+  sym->set_var_offset(0);
+  sym->set_var_base(0);
   sym->set_value(value);
   sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsReadOnly | kAstSymbolIsAssigned);
 
@@ -360,6 +494,7 @@ Error Context::add_variable(const char* name, int offset, unsigned int flags) {
   sym->add_symbol_flags(kAstSymbolIsDeclared);
   sym->set_var_slot_id(kInvalidSlot);
   sym->set_var_offset(offset);
+  sym->set_var_base((flags & _kVariableBaseMask) >> _kVariableBaseShift);
 
   if (flags & kVariableRO)
     sym->add_symbol_flags(kAstSymbolIsReadOnly);
@@ -367,6 +502,77 @@ Error Context::add_variable(const char* name, int offset, unsigned int flags) {
   return kErrorOk;
 }
 
+Error Context::add_array(const char* name, int offset, size_t length, unsigned int stride, unsigned int flags) {
+  ContextInternalImpl* d;
+
+  // The displacement of the last element must fit into a 32-bit memory operand. A zero stride would make all
+  // elements the same, it's most likely a mistake.
+  if (length == 0 || length > size_t(kMaxArrayLength) || stride == 0 ||
+      int64_t(offset) + int64_t(length - 1) * int64_t(stride) > int64_t(INT32_MAX))
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
+  MATHPRESSO_ADD_SYMBOL(name, kAstSymbolArray);
+
+  sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsReadOnly);
+  sym->set_var_offset(offset);
+  sym->set_var_base((flags & _kVariableBaseMask) >> _kVariableBaseShift);
+  sym->set_array_length(uint32_t(length));
+  sym->set_array_stride(stride);
+
+  return kErrorOk;
+}
+
+static bool mp_table_fits(int offset, size_t length) {
+  // The displacement of the last value (and the next one a search can address) must fit into a memory operand.
+  return length >= 2 && length <= size_t(kMaxArrayLength) &&
+         int64_t(offset) + int64_t(length) * int64_t(sizeof(double)) <= int64_t(INT32_MAX);
+}
+
+Error Context::add_table(const char* name, int offset, size_t length, double x0, double x1, unsigned int flags) {
+  ContextInternalImpl* d;
+
+  if (!mp_table_fits(offset, length) || !(x0 < x1) || !mp_is_finite(x1 - x0))
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
+  MATHPRESSO_ADD_SYMBOL(name, kAstSymbolTable);
+
+  sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsReadOnly);
+  sym->set_var_offset(offset);
+  sym->set_var_base((flags & _kVariableBaseMask) >> _kVariableBaseShift);
+  sym->set_array_length(uint32_t(length));
+  sym->set_array_stride(sizeof(double));
+  sym->set_table_knots(0);
+  sym->set_table_flags(flags & kTableCubic);
+  sym->set_table_x0(x0);
+  sym->set_table_scale(double(length - 1) / (x1 - x0));
+
+  return kErrorOk;
+}
+
+Error Context::add_table_knots(const char* name, int offset, int knots_offset, size_t length, unsigned int flags) {
+  ContextInternalImpl* d;
+
+  if (!mp_table_fits(offset, length) || !mp_table_fits(knots_offset, length) || (flags & kTableCubic) != 0)
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
+  MATHPRESSO_ADD_SYMBOL(name, kAstSymbolTable);
+
+  sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsReadOnly);
+  sym->set_var_offset(offset);
+  sym->set_var_base((flags & _kVariableBaseMask) >> _kVariableBaseShift);
+  sym->set_array_length(uint32_t(length));
+  sym->set_array_stride(sizeof(double));
+  sym->set_table_knots(knots_offset);
+  sym->set_table_flags(_kTableKnots);
+  sym->set_table_x0(0.0);
+  sym->set_table_scale(0.0);
+
+  return kErrorOk;
+}
+
 Error Context::add_function(const char* name, void* fn, unsigned int flags) {
   ContextInternalImpl* d;
 
@@ -374,6 +580,9 @@ Error Context::add_function(const char* name, void* fn, unsigned int flags) {
   MATHPRESSO_ADD_SYMBOL(name, kAstSymbolFunction);
 
   sym->add_symbol_flags(kAstSymbolIsDeclared);
+  if (flags & kFunctionNoSideEffects)
+    sym->add_symbol_flags(kAstSymbolIsPure);
+
   sym->set_func_ptr(fn);
   // TODO: Other function flags.
   sym->set_func_args(flags & _kFunctionArgMask);
@@ -381,6 +590,55 @@ Error Context::add_function(const char* name, void* fn, unsigned int flags) {
   return kErrorOk;
 }
 
+Error Context::add_inline_function(const char* name, const char* params, const char* body) {
+  ContextInternalImpl* d;
+
+  MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
+
+  size_t name_size = strlen(name);
+  uint32_t hash_code = HashUtils::hash_string(name, name_size);
+
+  if (d->_scope.get_symbol(StringRef(name, name_size), hash_code))
+    return MATHPRESSO_TRACE_ERROR(kErrorSymbolAlreadyExists);
+
+  AstScope* scope = d->_builder.new_scope(&d->_scope, kAstScopeNested);
+  MATHPRESSO_NULLCHECK(scope);
+
+  // The body is parsed once and stored in the context, `Parser::parse_call()` splices a copy of it into callers.
+  uint32_t count = 0;
+  AstNode* node = nullptr;
+
+  size_t params_size = strlen(params);
+  ErrorReporter params_reporter(params, params_size, kNoOptions, nullptr);
+  Error err = Parser(&d->_builder, &params_reporter, params, params_size).parse_inline_params(scope, &count);
+
+  if (err == kErrorOk) {
+    size_t body_size = strlen(body);
+    ErrorReporter body_reporter(body, body_size, kNoOptions, nullptr);
+    err = Parser(&d->_builder, &body_reporter, body, body_size).parse_inline_body(scope, &node);
+  }
+
+  if (err != kErrorOk) {
+    d->_builder.delete_scope(scope);
+    return err;
+  }
+
+  AstSymbol* sym = d->_builder.new_symbol(StringRef(name, name_size), hash_code, kAstSymbolInline, kAstScopeGlobal);
+  if (!sym) {
+    d->_builder.delete_node(node);
+    d->_builder.delete_scope(scope);
+    return MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+  }
+
+  d->_scope.put_symbol(sym);
+  sym->add_symbol_flags(kAstSymbolIsDeclared);
+  sym->set_node(node);
+  sym->set_func_ptr(scope);
+  sym->set_func_args(count);
+
+  return kErrorOk;
+}
+
 Error Context::del_symbol(const char* name) {
   ContextInternalImpl* d;
   MATHPRESSO_PROPAGATE(mp_context_make_mutable(this, &d));
@@ -392,25 +650,500 @@ Error Context::del_symbol(const char* name) {
   if (!sym)
     return MATHPRESSO_TRACE_ERROR(kErrorSymbolNotFound);
 
+  if (sym->symbol_type() == kAstSymbolInline) {
+    if (sym->node())
+      d->_builder.delete_node(sym->node());
+    d->_builder.delete_scope(static_cast<AstScope*>(sym->func_ptr()));
+  }
+
   d->_builder.delete_symbol(d->_scope.remove_symbol(sym));
   return kErrorOk;
 }
 
-// MathPresso - Expression API
-// ===========================
+// MathPresso - Expression Impl
+// ============================
 
-Expression::Expression() : _func(dummy_func) {}
-Expression::~Expression() { reset(); }
+//! \internal
+//!
+//! Expression data that is not needed by the inline `Expression::evaluate()`.
+struct ExpressionImpl {
+  MATHPRESSO_INLINE ExpressionImpl() {}
+  MATHPRESSO_INLINE ~ExpressionImpl() {
+    if (finite_func)
+      free_compiled_function((void*)finite_func);
+    if (array_func)
+      free_compiled_function((void*)array_func);
+    if (finite_array_func)
+      free_compiled_function((void*)finite_array_func);
+    if (reduce_func)
+      free_compiled_function((void*)reduce_func);
+    if (finite_reduce_func)
+      free_compiled_function((void*)finite_reduce_func);
+    if (bitmap_func)
+      free_compiled_function((void*)bitmap_func);
+    if (finite_bitmap_func)
+      free_compiled_function((void*)finite_bitmap_func);
+    if (gather_func)
+      free_compiled_function((void*)gather_func);
+    if (stream_func)
+      free_compiled_function((void*)stream_func);
+    if (finite_stream_func)
+      free_compiled_function((void*)finite_stream_func);
+    if (gradient_func)
+      free_compiled_function((void*)gradient_func);
+    if (interval_func)
+      free_compiled_function((void*)interval_func);
+    if (ode_func)
+      free_compiled_function((void*)ode_func);
+    if (profile_func)
+      free_compiled_function((void*)profile_func);
+    release_speculated();
+    ::free(input_offsets);
+    ::free(profile);
+    ::free(condition_counters);
+    ::free(spec_data);
+  }
 
-Error Expression::compile(const Context& ctx, const char* body, unsigned int options, OutputLog* log) {
-  // Init options first.
-  options &= _kOptionsMask;
+  //! Release the variant compiled by `Expression::reoptimize()`.
+  void release_speculated() {
+    if (speculated_func)
+      free_compiled_function((void*)speculated_func);
+    if (speculated_array_func)
+      free_compiled_function((void*)speculated_array_func);
+    if (speculated_stream_func)
+      free_compiled_function((void*)speculated_stream_func);
+    if (speculated_reduce_func)
+      free_compiled_function((void*)speculated_reduce_func);
+    if (speculated_bitmap_func)
+      free_compiled_function((void*)speculated_bitmap_func);
+    if (speculated_gather_func)
+      free_compiled_function((void*)speculated_gather_func);
+    ::free(speculated_bits);
+
+    speculated_func = nullptr;
+    speculated_array_func = nullptr;
+    speculated_stream_func = nullptr;
+    speculated_reduce_func = nullptr;
+    speculated_bitmap_func = nullptr;
+    speculated_gather_func = nullptr;
+    speculated_bits = nullptr;
+    speculated_offsets = nullptr;
+    speculated_count = 0;
+    speculated_finite = false;
+  }
 
-  if (log)
-    options |= kInternalOptionLog;
-  else
-    options &= ~(kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler);
+  //! Variant compiled with the assumption that all inputs are finite, see \ref kOptionFiniteFastPath.
+  CompiledFunc finite_func = nullptr;
+
+  //! Function that evaluates rows in a loop, see \ref kOptionArrayLoop.
+  ArrayFunc array_func = nullptr;
+  //! Variant of `array_func` compiled with the assumption that all inputs are finite.
+  ArrayFunc finite_array_func = nullptr;
+
+  //! Variant of `array_func` that uses non-temporal stores, see \ref kOptionStreamingStores.
+  ArrayFunc stream_func = nullptr;
+  //! Variant of `stream_func` compiled with the assumption that all inputs are finite.
+  ArrayFunc finite_stream_func = nullptr;
+
+  //! Function that accumulates results of rows, see \ref kOptionReduceLoop.
+  ArrayFunc reduce_func = nullptr;
+  //! Variant of `reduce_func` compiled with the assumption that all inputs are finite.
+  ArrayFunc finite_reduce_func = nullptr;
+
+  //! Function that evaluates rows as a predicate to a bitmap, see \ref kOptionFilterLoop.
+  ArrayFunc bitmap_func = nullptr;
+  //! Variant of `bitmap_func` compiled with the assumption that all inputs are finite.
+  ArrayFunc finite_bitmap_func = nullptr;
+
+  //! Function that evaluates rows selected by indexes, see \ref kOptionGatherLoop.
+  GatherFunc gather_func = nullptr;
+
+  //! Function that evaluates the result and its partial derivatives, see `Expression::compile_gradient()`.
+  CompiledFunc gradient_func = nullptr;
+
+  //! Function that evaluates intervals, see \ref kOptionInterval.
+  CompiledFunc interval_func = nullptr;
+
+  //! Function that integrates a system of equations, see `Expression::compile_ode()`.
+  OdeFunc ode_func = nullptr;
+
+  //! Offsets of all variables the expression reads, used to guard `finite_func`.
+  int32_t* input_offsets = nullptr;
+  //! Number of `input_offsets`.
+  uint32_t input_count = 0;
+
+  //! Options used to compile the expression.
+  uint32_t options = 0;
+
+  //! Statistics of sampled inputs (in the same order as `input_offsets`, names are stored after them), see
+  //! \ref kOptionProfile.
+  VariableProfile* profile = nullptr;
+  //! Function that evaluates a row and counts outcomes of comparisons, used by `Expression::sample()`.
+  CompiledFunc profile_func = nullptr;
+  //! Counters of comparisons updated by `profile_func` (two per comparison), `condition_positions` are stored after
+  //! them, see `JitConditions`.
+  double* condition_counters = nullptr;
+  //! Source code positions of comparisons.
+  uint32_t* condition_positions = nullptr;
+  //! Number of comparisons counted by `profile_func`.
+  uint32_t condition_count = 0;
+
+  //! Variant compiled by `Expression::reoptimize()`.
+  CompiledFunc speculated_func = nullptr;
+  //! Array function of the variant compiled by `Expression::reoptimize()` (only with \ref kOptionArrayLoop).
+  ArrayFunc speculated_array_func = nullptr;
+  //! Variant of `speculated_array_func` that uses non-temporal stores (only with \ref kOptionStreamingStores).
+  ArrayFunc speculated_stream_func = nullptr;
+  //! Reduce function of the variant (only with \ref kOptionReduceLoop).
+  ArrayFunc speculated_reduce_func = nullptr;
+  //! Bitmap function of the variant (only with \ref kOptionFilterLoop).
+  ArrayFunc speculated_bitmap_func = nullptr;
+  //! Gather function of the variant (only if `gather_func` is compiled).
+  GatherFunc speculated_gather_func = nullptr;
+  //! Values of inputs the variant speculates on (compared bitwise), `speculated_offsets` are stored after them.
+  uint64_t* speculated_bits = nullptr;
+  //! Offsets of inputs the variant speculates on.
+  int32_t* speculated_offsets = nullptr;
+  //! Number of `speculated_bits` and `speculated_offsets`.
+  uint32_t speculated_count = 0;
+  //! Whether the variant also assumes that all inputs are finite.
+  bool speculated_finite = false;
+
+  //! Context the specialized (or profiled) expression was compiled with, see `Expression::respecialize()` and
+  //! `Expression::reoptimize()`.
+  Context spec_ctx;
+  //! Single allocation that holds `spec_values`, `spec_names`, and `spec_body`.
+  void* spec_data = nullptr;
+  //! Values of specialized variables.
+  double* spec_values = nullptr;
+  //! Names of specialized variables.
+  const char** spec_names = nullptr;
+  //! Body of the specialized expression.
+  const char* spec_body = nullptr;
+  //! Number of specialized variables.
+  size_t spec_count = 0;
+};
+
+//! \internal
+//!
+//! Variables that are compiled as constants, see `Expression::specialize()`.
+struct Specialization {
+  const char* const* names;
+  const double* values;
+  size_t count;
+};
 
+//! \internal
+//!
+//! Variables the result is differentiated with respect to, see `Expression::compile_gradient()`.
+struct Gradient {
+  const char* const* names;
+  const int* offsets;
+  size_t count;
+};
+
+//! \internal
+//!
+//! System of equations compiled by `Expression::compile_ode()`.
+struct Ode {
+  const char* const* bodies;
+  const char* const* names;
+  size_t count;
+  const char* time_name;
+  uint32_t method;
+};
+
+//! \internal
+//!
+//! Copy everything `Expression::respecialize()` needs to compile the expression again into `d`.
+static Error mp_specialization_init(ExpressionImpl* d, const Context& ctx, const char* body, const Specialization& spec) {
+  size_t count = spec.count;
+  size_t body_size = ::strlen(body) + 1;
+  size_t data_size = count * (sizeof(double) + sizeof(char*)) + body_size;
+
+  for (size_t i = 0; i < count; i++)
+    data_size += ::strlen(spec.names[i]) + 1;
+
+  uint8_t* p = static_cast<uint8_t*>(::malloc(data_size));
+  MATHPRESSO_NULLCHECK(p);
+
+  d->spec_data = p;
+  d->spec_values = reinterpret_cast<double*>(p);
+  d->spec_names = reinterpret_cast<const char**>(p + count * sizeof(double));
+  d->spec_count = count;
+  d->spec_ctx = ctx;
+
+  ::memcpy(d->spec_values, spec.values, count * sizeof(double));
+  p += count * (sizeof(double) + sizeof(char*));
+
+  ::memcpy(p, body, body_size);
+  d->spec_body = reinterpret_cast<const char*>(p);
+  p += body_size;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t name_size = ::strlen(spec.names[i]) + 1;
+    ::memcpy(p, spec.names[i], name_size);
+    d->spec_names[i] = reinterpret_cast<const char*>(p);
+    p += name_size;
+  }
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Put read-only copies of specialized variables to the root scope, which makes them constants that are folded by
+//! the optimizer. Must be called before the program is parsed.
+static Error mp_specialization_apply(AstBuilder* ast, const Specialization& spec) {
+  AstScope* root_scope = ast->root_scope();
+
+  for (size_t i = 0; i < spec.count; i++) {
+    StringRef name(spec.names[i]);
+    uint32_t hash_code = HashUtils::hash_string(name.data(), name.size());
+
+    // Specializing the same variable twice is most likely a bug in the caller.
+    if (root_scope->get_symbol(name, hash_code))
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+    AstSymbol* ctx_sym = root_scope->resolve_symbol(name, hash_code);
+    if (!ctx_sym)
+      return MATHPRESSO_TRACE_ERROR(kErrorSymbolNotFound);
+
+    if (ctx_sym->symbol_type() != kAstSymbolVariable || !ctx_sym->is_global())
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+    AstSymbol* sym = ast->shadow_symbol(ctx_sym);
+    MATHPRESSO_NULLCHECK(sym);
+
+    sym->set_var_slot_id(ast->new_slot_id());
+    sym->add_symbol_flags(kAstSymbolIsReadOnly);
+    sym->set_value(spec.values[i]);
+    root_scope->put_symbol(sym);
+  }
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Resolve variables of `gradient` to symbols of the parsed program. Variables the program doesn't reference get
+//! null symbols (their partial derivatives are zero).
+static Error mp_gradient_resolve(AstBuilder* ast, const Gradient& gradient, JitGradient* out) {
+  AstScope* root_scope = ast->root_scope();
+  AstSymbol** symbols = static_cast<AstSymbol**>(ast->arena().alloc_oneshot(Arena::aligned_size(gradient.count * sizeof(AstSymbol*))));
+  MATHPRESSO_NULLCHECK(symbols);
+
+  for (size_t i = 0; i < gradient.count; i++) {
+    StringRef name(gradient.names[i]);
+    uint32_t hash_code = HashUtils::hash_string(name.data(), name.size());
+
+    // Global variables are put to the root scope when referenced, see `Parser::parse_expression()`.
+    AstSymbol* sym = root_scope->resolve_symbol(name, hash_code);
+    if (!sym)
+      return MATHPRESSO_TRACE_ERROR(kErrorSymbolNotFound);
+
+    if (sym->symbol_type() != kAstSymbolVariable || !sym->is_global() || sym->is_assigned())
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+    symbols[i] = root_scope->get_symbol(name, hash_code) == sym ? sym : nullptr;
+  }
+
+  out->symbols = symbols;
+  out->offsets = gradient.offsets;
+  out->count = uint32_t(gradient.count);
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Declare variables of `ode` in the root scope (so they are known even if no equation references them) and parse
+//! each equation into a separate program, which is a child of the program node.
+static Error mp_ode_parse(AstBuilder* ast, const Ode& ode, uint32_t options, OutputLog* log, JitOde* out) {
+  AstScope* root_scope = ast->root_scope();
+  AstSymbol** state = static_cast<AstSymbol**>(ast->arena().alloc_oneshot(Arena::aligned_size(ode.count * sizeof(AstSymbol*))));
+  MATHPRESSO_NULLCHECK(state);
+
+  AstSymbol* time = nullptr;
+
+  for (size_t i = 0; i <= ode.count; i++) {
+    const char* name_str = i < ode.count ? ode.names[i] : ode.time_name;
+    if (!name_str)
+      continue;
+
+    StringRef name(name_str);
+    uint32_t hash_code = HashUtils::hash_string(name.data(), name.size());
+
+    // The same variable cannot be used twice.
+    if (root_scope->get_symbol(name, hash_code))
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+    AstSymbol* ctx_sym = root_scope->resolve_symbol(name, hash_code);
+    if (!ctx_sym)
+      return MATHPRESSO_TRACE_ERROR(kErrorSymbolNotFound);
+
+    if (ctx_sym->symbol_type() != kAstSymbolVariable || !ctx_sym->is_global() || ctx_sym->is_assigned() ||
+        ctx_sym->has_symbol_flag(kAstSymbolIsReadOnly))
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+    AstSymbol* sym = ast->shadow_symbol(ctx_sym);
+    MATHPRESSO_NULLCHECK(sym);
+
+    sym->set_var_slot_id(ast->new_slot_id());
+    root_scope->put_symbol(sym);
+
+    if (i < ode.count)
+      state[i] = sym;
+    else
+      time = sym;
+  }
+
+  for (size_t i = 0; i < ode.count; i++) {
+    const char* body = ode.bodies[i];
+    size_t size = ::strlen(body);
+    ErrorReporter error_reporter(body, size, options, log);
+
+    AstProgram* program = ast->new_node<AstProgram>();
+    MATHPRESSO_NULLCHECK(program);
+
+    MATHPRESSO_PROPAGATE(ast->program_node()->will_add());
+    ast->program_node()->append_node(program);
+
+    MATHPRESSO_PROPAGATE(Parser(ast, &error_reporter, body, size).parse_scoped_program(program));
+  }
+
+  // The state and time are only changed by the integrator.
+  for (size_t i = 0; i < ode.count; i++) {
+    if (state[i]->write_count() != 0)
+      return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+  }
+
+  if (time && time->write_count() != 0)
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  out->state = state;
+  out->time = time;
+  out->count = uint32_t(ode.count);
+  out->method = ode.method;
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Collect offsets of global variables referenced by the program, must be called before the AST is optimized so
+//! global constants (which are already assigned at this point) can be distinguished from variables.
+//!
+//! Only variables of the base 0 (row data) are collected, the optimizer doesn't consider other variables finite.
+//! Variables that are only written (outputs) are not inputs.
+static MATHPRESSO_INLINE bool mp_is_input(const AstSymbol* sym) {
+  return sym->symbol_type() == kAstSymbolVariable && sym->is_global() && !sym->is_assigned() && sym->var_base() == 0 &&
+         sym->read_count() != 0;
+}
+
+static Error mp_collect_inputs(AstBuilder* ast, ExpressionImpl* d) {
+  uint32_t count = 0;
+
+  {
+    AstSymbolHashIterator it(ast->root_scope()->symbols());
+    while (it.has()) {
+      AstSymbol* sym = it.get();
+      count += mp_is_input(sym);
+      it.next();
+    }
+  }
+
+  if (count == 0)
+    return kErrorOk;
+
+  d->input_offsets = static_cast<int32_t*>(::malloc(count * sizeof(int32_t)));
+  MATHPRESSO_NULLCHECK(d->input_offsets);
+
+  // Names are copied after the profile as symbols (and the context) don't have to outlive the expression.
+  char* names = nullptr;
+  if (d->options & kOptionProfile) {
+    size_t profile_size = count * sizeof(VariableProfile);
+
+    AstSymbolHashIterator it(ast->root_scope()->symbols());
+    while (it.has()) {
+      AstSymbol* sym = it.get();
+      if (mp_is_input(sym))
+        profile_size += size_t(sym->name_size()) + 1;
+      it.next();
+    }
+
+    d->profile = static_cast<VariableProfile*>(::malloc(profile_size));
+    MATHPRESSO_NULLCHECK(d->profile);
+    names = reinterpret_cast<char*>(d->profile + count);
+  }
+
+  {
+    AstSymbolHashIterator it(ast->root_scope()->symbols());
+    while (it.has()) {
+      AstSymbol* sym = it.get();
+      if (mp_is_input(sym)) {
+        if (names) {
+          VariableProfile& profile = d->profile[d->input_count];
+          ::memcpy(names, sym->name(), sym->name_size());
+          names[sym->name_size()] = '\0';
+
+          profile.name = names;
+          profile.offset = sym->var_offset();
+          profile.constant = true;
+          profile.first = 0.0;
+          profile.min = mp_get_inf();
+          profile.max = -mp_get_inf();
+          profile.count = 0;
+          profile.nan_count = 0;
+          profile.negative_count = 0;
+          names += sym->name_size() + 1;
+        }
+
+        d->input_offsets[d->input_count++] = sym->var_offset();
+      }
+      it.next();
+    }
+  }
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Get the number of comparisons in `node` and its children.
+static uint32_t mp_count_conditions(AstNode* node) {
+  uint32_t n = node->node_type() == kAstNodeBinaryOp && node->op_type() >= kOpEq && node->op_type() <= kOpGe;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      n += mp_count_conditions(child);
+  }
+  return n;
+}
+
+//! \internal
+//!
+//! Allocate counters of comparisons of the optimized program owned by `d` and describe them by `out`.
+static Error mp_conditions_init(AstBuilder* ast, ExpressionImpl* d, JitConditions* out) {
+  uint32_t capacity = mp_count_conditions(ast->program_node());
+
+  void* p = ::calloc(1, capacity * (2 * sizeof(double) + sizeof(uint32_t)) + 1);
+  MATHPRESSO_NULLCHECK(p);
+
+  d->condition_counters = static_cast<double*>(p);
+  d->condition_positions = reinterpret_cast<uint32_t*>(d->condition_counters + capacity * 2);
+
+  out->counters = d->condition_counters;
+  out->positions = d->condition_positions;
+  out->capacity = capacity;
+  out->count = 0;
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Parse, optimize, and compile `body` into functions of all types (see \ref JitFuncType) specified by `func_types`
+//! bit mask and store them to `funcs_out` (indexed by the function type). If `d` is not null it's filled with
+//! information about the program that is needed by non-inline parts of the `Expression` API.
+static Error mp_compile_program(const Context& ctx, const char* body, const Specialization& spec, const Gradient* gradient, const Ode* ode, uint32_t options, OutputLog* log, uint32_t func_types, void** funcs_out, ExpressionImpl* d) {
   Arena arena(32768);
   StringTmp<512> sb_tmp;
 
@@ -418,16 +1151,30 @@ Error Expression::compile(const Context& ctx, const char* body, unsigned int opt
   AstBuilder ast(arena);
   MATHPRESSO_PROPAGATE(ast.init_program_scope());
 
-  ContextImpl* d = ctx._d;
-  if (d != &mp_context_null)
-    ast.root_scope()->shadow_context_scope(&static_cast<ContextInternalImpl*>(d)->_scope);
+  ContextImpl* ctx_d = ctx._d;
+  if (ctx_d != &mp_context_null)
+    ast.root_scope()->shadow_context_scope(&static_cast<ContextInternalImpl*>(ctx_d)->_scope);
+
+  if (spec.count)
+    MATHPRESSO_PROPAGATE(mp_specialization_apply(&ast, spec));
 
   // Setup basic data structures used during parsing and compilation.
   size_t size = ::strlen(body);
   ErrorReporter error_reporter(body, size, options, log);
 
-  // Parse the expression into AST.
-  { MATHPRESSO_PROPAGATE(Parser(&ast, &error_reporter, body, size).parse_program(ast.program_node())); }
+  // Parse the expression into AST (or equations of `ode`, then `body` is empty).
+  JitOde jit_ode {};
+  if (ode)
+    MATHPRESSO_PROPAGATE(mp_ode_parse(&ast, *ode, options, log, &jit_ode));
+  else
+    MATHPRESSO_PROPAGATE(Parser(&ast, &error_reporter, body, size).parse_program(ast.program_node()));
+
+  if (d)
+    MATHPRESSO_PROPAGATE(mp_collect_inputs(&ast, d));
+
+  JitGradient jit_gradient {};
+  if (gradient)
+    MATHPRESSO_PROPAGATE(mp_gradient_resolve(&ast, *gradient, &jit_gradient));
 
   if (options & kOptionDebugAst) {
     ast.dump(sb_tmp);
@@ -444,17 +1191,352 @@ Error Expression::compile(const Context& ctx, const char* body, unsigned int opt
     sb_tmp.clear();
   }
 
-  // Compile the function to machine code.
-  CompiledFunc fn = compile_function(&ast, options, log);
-  if (!fn)
-    return MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+  // Counters are owned by `d`, as their address is embedded in the function.
+  JitConditions jit_conditions {};
+  if (func_types & (1u << kJitFuncProfile)) {
+    MATHPRESSO_ASSERT(d != nullptr);
+    MATHPRESSO_PROPAGATE(mp_conditions_init(&ast, d, &jit_conditions));
+  }
+
+  // Compile functions to machine code, all of them use the same optimized AST.
+  for (uint32_t func_type = 0; func_type < kJitFuncCount; func_type++) {
+    if (!(func_types & (1u << func_type)))
+      continue;
+
+    void* fn = compile_function(&ast, func_type, options, log,
+                                func_type == kJitFuncGradient ? &jit_gradient : nullptr,
+                                func_type == kJitFuncOde ? &jit_ode : nullptr,
+                                func_type == kJitFuncProfile ? &jit_conditions : nullptr);
+    if (!fn) {
+      for (uint32_t i = 0; i < func_type; i++) {
+        if (func_types & (1u << i))
+          free_compiled_function(funcs_out[i]);
+      }
+      return MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+    }
+
+    funcs_out[func_type] = fn;
+  }
 
-  reset();
-  _func = fn;
+  if (func_types & (1u << kJitFuncProfile))
+    d->condition_count = jit_conditions.count;
 
   return kErrorOk;
 }
 
+//! \internal
+//!
+//! Get whether all inputs of `count` rows starting at `data` are finite.
+static bool mp_rows_are_finite(const uint8_t* data, size_t stride, size_t count, const int32_t* offsets, uint32_t offset_count) {
+  uint64_t non_finite = 0;
+
+  for (uint32_t i = 0; i < offset_count; i++) {
+    const uint8_t* p = data + offsets[i];
+    for (size_t j = 0; j < count; j++, p += stride) {
+      uint64_t bits;
+      ::memcpy(&bits, p, sizeof(uint64_t));
+      non_finite |= uint64_t((bits & 0x7FF0000000000000u) == 0x7FF0000000000000u);
+    }
+
+    if (non_finite)
+      return false;
+  }
+
+  return true;
+}
+
+//! \internal
+//!
+//! Get whether `count` rows starting at `data` match the speculation of the variant compiled by
+//! `Expression::reoptimize()`.
+static bool mp_rows_match_speculation(const ExpressionImpl* d, const uint8_t* data, size_t stride, size_t count) {
+  uint64_t mismatch = 0;
+
+  for (uint32_t i = 0; i < d->speculated_count; i++) {
+    const uint8_t* p = data + d->speculated_offsets[i];
+    uint64_t expected = d->speculated_bits[i];
+
+    for (size_t j = 0; j < count; j++, p += stride) {
+      uint64_t bits;
+      ::memcpy(&bits, p, sizeof(uint64_t));
+      mismatch |= bits ^ expected;
+    }
+
+    if (mismatch)
+      return false;
+  }
+
+  return !d->speculated_finite || mp_rows_are_finite(data, stride, count, d->input_offsets, d->input_count);
+}
+
+//! \internal
+//!
+//! Get whether `count` rows selected by `indices` match the speculation of the variant compiled by
+//! `Expression::reoptimize()`, see `mp_rows_match_speculation()`.
+static bool mp_indexed_rows_match_speculation(const ExpressionImpl* d, const uint8_t* data, size_t stride, const uint32_t* indices, size_t count) {
+  uint64_t mismatch = 0;
+  uint64_t non_finite = 0;
+
+  for (size_t j = 0; j < count; j++) {
+    const uint8_t* row = data + size_t(indices[j]) * stride;
+
+    for (uint32_t i = 0; i < d->speculated_count; i++) {
+      uint64_t bits;
+      ::memcpy(&bits, row + d->speculated_offsets[i], sizeof(uint64_t));
+      mismatch |= bits ^ d->speculated_bits[i];
+    }
+
+    if (d->speculated_finite) {
+      for (uint32_t i = 0; i < d->input_count; i++) {
+        uint64_t bits;
+        ::memcpy(&bits, row + d->input_offsets[i], sizeof(uint64_t));
+        non_finite |= uint64_t((bits & 0x7FF0000000000000u) == 0x7FF0000000000000u);
+      }
+    }
+
+    if (mismatch | non_finite)
+      return false;
+  }
+
+  return true;
+}
+
+//! \internal
+//!
+//! Add inputs of a single row to the profile of `d`.
+static void mp_profile_sample(ExpressionImpl* d, const uint8_t* row) {
+  for (uint32_t i = 0; i < d->input_count; i++) {
+    VariableProfile& profile = d->profile[i];
+
+    double v;
+    uint64_t bits;
+    ::memcpy(&v, row + profile.offset, sizeof(double));
+    ::memcpy(&bits, &v, sizeof(uint64_t));
+
+    if (profile.count == 0) {
+      profile.first = v;
+    }
+    else if (profile.constant) {
+      uint64_t first_bits;
+      ::memcpy(&first_bits, &profile.first, sizeof(uint64_t));
+      profile.constant = bits == first_bits;
+    }
+
+    profile.count++;
+    profile.negative_count += bits >> 63;
+
+    if (v != v) {
+      profile.nan_count++;
+    }
+    else {
+      profile.min = v < profile.min ? v : profile.min;
+      profile.max = v > profile.max ? v : profile.max;
+    }
+  }
+}
+
+//! \internal
+//!
+//! Evaluate rows by the regular (not speculated) functions of the expression, see `Expression::evaluate_array()`.
+//!
+//! The `stream` argument selects functions that use non-temporal stores (if compiled), it's decided by the caller as
+//! rows can be passed in chunks of a larger array.
+static void mp_evaluate_rows(CompiledFunc func, const ExpressionImpl* d, double* results, uint8_t* row, size_t stride, size_t count, void* const* bases, bool stream) {
+  if (!d || (!d->finite_func && !d->finite_array_func)) {
+    if (d && d->array_func) {
+      ArrayFunc fn = stream && d->stream_func ? d->stream_func : d->array_func;
+      fn(results, row, bases, stride, count);
+      return;
+    }
+
+    for (size_t i = 0; i < count; i++, row += stride)
+      func(results + i, row, bases);
+    return;
+  }
+
+  ArrayFunc array_func = d->array_func;
+  ArrayFunc finite_array_func = d->finite_array_func;
+
+  if (stream && d->stream_func) {
+    array_func = d->stream_func;
+    finite_array_func = d->finite_stream_func;
+  }
+
+  while (count) {
+    size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+    bool finite = mp_rows_are_finite(row, stride, n, d->input_offsets, d->input_count);
+
+    if (array_func) {
+      (finite ? finite_array_func : array_func)(results, row, bases, stride, n);
+      row += n * stride;
+    }
+    else {
+      CompiledFunc fn = finite ? d->finite_func : func;
+      for (size_t i = 0; i < n; i++, row += stride)
+        fn(results + i, row, bases);
+    }
+
+    results += n;
+    count -= n;
+  }
+}
+
+//! \internal
+//!
+//! Evaluate rows selected by `indices` by the regular (not speculated) functions of the expression, see
+//! `Expression::evaluate_indexed()`.
+static void mp_evaluate_indexed_rows(CompiledFunc func, const ExpressionImpl* d, double* results, uint8_t* rows, size_t stride, const uint32_t* indices, size_t count, void* const* bases) {
+  if (d && d->gather_func) {
+    d->gather_func(results, rows, bases, stride, count, indices);
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    func(results + i, rows + size_t(indices[i]) * stride, bases);
+}
+
+//! \internal
+//!
+//! Compile `body` into `self`, used by all `Expression` functions that compile.
+static Error mp_expression_compile(Expression* self, const Context& ctx, const char* body, const Specialization& spec, const Gradient* gradient, const Ode* ode, unsigned int options, OutputLog* log) {
+  // Init options first.
+  options &= _kOptionsMask;
+
+  if (log)
+    options |= kInternalOptionLog;
+  else
+    options &= ~(kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler);
+
+  ExpressionImpl* d = new(std::nothrow) ExpressionImpl();
+  MATHPRESSO_NULLCHECK(d);
+
+  d->options = options;
+
+  if (spec.count != 0 || (options & kOptionProfile)) {
+    // Must be copied before `reset()` as `respecialize()` passes the data of the current `_d`.
+    MATHPRESSO_PROPAGATE_(mp_specialization_init(d, ctx, body, spec), { delete d; });
+  }
+
+  // The array function is used instead of the scalar one by `evaluate_array()` when requested. Flushing denormals
+  // always compiles loops, otherwise the host would call the scalar function per row, which sets and restores the
+  // floating-point control register each time.
+  uint32_t array_types = (options & (kOptionArrayLoop | kOptionFlushDenormals)) ? (1u << kJitFuncArray) : (1u << kJitFuncScalar);
+  if ((options & (kOptionArrayLoop | kOptionStreamingStores)) == (kOptionArrayLoop | kOptionStreamingStores))
+    array_types |= 1u << kJitFuncArrayStream;
+  if (options & kOptionReduceLoop)
+    array_types |= 1u << kJitFuncReduce;
+  if (options & kOptionFilterLoop)
+    array_types |= 1u << kJitFuncBitmap;
+  void* funcs[kJitFuncCount] {};
+
+  // Rows selected by indexes are not checked by the finite fast path, so there is only one gather function.
+  uint32_t func_types = (1u << kJitFuncScalar) | array_types;
+  if (options & (kOptionGatherLoop | kOptionFlushDenormals))
+    func_types |= 1u << kJitFuncGather;
+  if (gradient)
+    func_types |= 1u << kJitFuncGradient;
+  if (options & kOptionInterval)
+    func_types |= 1u << kJitFuncInterval;
+  if (ode)
+    func_types |= 1u << kJitFuncOde;
+  if (options & kOptionProfile)
+    func_types |= 1u << kJitFuncProfile;
+
+  MATHPRESSO_PROPAGATE_(mp_compile_program(ctx, body, spec, gradient, ode, options, log, func_types, funcs, d), { delete d; });
+
+  CompiledFunc fn = (CompiledFunc)funcs[kJitFuncScalar];
+  d->array_func = (ArrayFunc)funcs[kJitFuncArray];
+  d->stream_func = (ArrayFunc)funcs[kJitFuncArrayStream];
+  d->reduce_func = (ArrayFunc)funcs[kJitFuncReduce];
+  d->bitmap_func = (ArrayFunc)funcs[kJitFuncBitmap];
+  d->gather_func = (GatherFunc)funcs[kJitFuncGather];
+  d->gradient_func = (CompiledFunc)funcs[kJitFuncGradient];
+  d->interval_func = (CompiledFunc)funcs[kJitFuncInterval];
+  d->ode_func = (OdeFunc)funcs[kJitFuncOde];
+  d->profile_func = (CompiledFunc)funcs[kJitFuncProfile];
+
+  if (options & kOptionFiniteFastPath) {
+    // The variant is only useful if the program reads at least one variable, and it only differs in the optimizer,
+    // so the debug output of the second pass would just repeat what was already logged.
+    if (d->input_count != 0) {
+      uint32_t finite_options = (options & ~(kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler)) | kInternalOptionFiniteInputs;
+      void* finite_funcs[kJitFuncCount] {};
+
+      MATHPRESSO_PROPAGATE_(mp_compile_program(ctx, body, spec, nullptr, ode, finite_options, log, array_types, finite_funcs, nullptr), {
+        free_compiled_function((void*)fn);
+        delete d;
+      });
+
+      d->finite_func = (CompiledFunc)finite_funcs[kJitFuncScalar];
+      d->finite_array_func = (ArrayFunc)finite_funcs[kJitFuncArray];
+      d->finite_stream_func = (ArrayFunc)finite_funcs[kJitFuncArrayStream];
+      d->finite_reduce_func = (ArrayFunc)finite_funcs[kJitFuncReduce];
+      d->finite_bitmap_func = (ArrayFunc)finite_funcs[kJitFuncBitmap];
+    }
+  }
+
+  self->reset();
+  self->_func = fn;
+  self->_d = d;
+
+  return kErrorOk;
+}
+
+// MathPresso - Expression API
+// ===========================
+
+Expression::Expression()
+  : _func(dummy_func),
+    _d(nullptr) {}
+Expression::~Expression() { reset(); }
+
+Error Expression::compile(const Context& ctx, const char* body, unsigned int options, OutputLog* log) {
+  return specialize(ctx, body, nullptr, nullptr, 0, options, log);
+}
+
+Error Expression::specialize(const Context& ctx, const char* body, const char* const* names, const double* values, size_t count, unsigned int options, OutputLog* log) {
+  if (count != 0 && (!names || !values))
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  Specialization spec = { names, values, count };
+  return mp_expression_compile(this, ctx, body, spec, nullptr, nullptr, options, log);
+}
+
+Error Expression::compile_gradient(const Context& ctx, const char* body, const char* const* names, const int* offsets, size_t count, unsigned int options, OutputLog* log) {
+  if (count != 0 && (!names || !offsets))
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  Specialization spec = { nullptr, nullptr, 0 };
+  Gradient gradient = { names, offsets, count };
+  return mp_expression_compile(this, ctx, body, spec, &gradient, nullptr, options, log);
+}
+
+Error Expression::compile_ode(const Context& ctx, const char* const* bodies, const char* const* names, size_t count, const char* time_name, uint32_t method, unsigned int options, OutputLog* log) {
+  if (count == 0 || !bodies || !names || method > kOdeRK45)
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidArgument);
+
+  Specialization spec = { nullptr, nullptr, 0 };
+  Ode ode = { bodies, names, count, time_name, method };
+  return mp_expression_compile(this, ctx, "", spec, nullptr, &ode, options, log);
+}
+
+Error Expression::respecialize(const double* values, OutputLog* log) {
+  ExpressionImpl* d = _d;
+  if (!d || !d->spec_count)
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidState);
+
+  // Nothing to do if the values didn't change (compared bitwise, so NaNs and signed zeros are handled correctly).
+  if (::memcmp(d->spec_values, values, d->spec_count * sizeof(double)) == 0)
+    return kErrorOk;
+
+  // Everything passed is owned by the current `_d`, which is released only after the new expression compiles.
+  unsigned int options = d->options & (_kOptionsMask & ~(kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler));
+  if (log)
+    options |= d->options & (kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler);
+
+  return specialize(d->spec_ctx, d->spec_body, d->spec_names, values, d->spec_count, options, log);
+}
+
 bool Expression::is_compiled() const {
   return _func != dummy_func;
 }
@@ -465,6 +1547,425 @@ void Expression::reset() {
     free_compiled_function((void*)_func);
     _func = dummy_func;
   }
+
+  delete _d;
+  _d = nullptr;
+}
+
+size_t Expression::profile(VariableProfile* out, size_t capacity) const {
+  const ExpressionImpl* d = _d;
+  if (!d || !d->profile)
+    return 0;
+
+  size_t count = d->input_count;
+  ::memcpy(out, d->profile, (count < capacity ? count : capacity) * sizeof(VariableProfile));
+  return count;
+}
+
+size_t Expression::condition_profile(ConditionProfile* out, size_t capacity) const {
+  const ExpressionImpl* d = _d;
+  if (!d || !d->profile_func)
+    return 0;
+
+  size_t count = d->condition_count;
+  for (size_t i = 0; i < count && i < capacity; i++) {
+    out[i].position = d->condition_positions[i];
+    out[i].count = static_cast<uint64_t>(d->condition_counters[i * 2]);
+    out[i].true_count = static_cast<uint64_t>(d->condition_counters[i * 2 + 1]);
+  }
+  return count;
+}
+
+double Expression::sample(void* data, void* const* bases) {
+  ExpressionImpl* d = _d;
+  double result;
+
+  if (d && d->profile)
+    mp_profile_sample(d, static_cast<const uint8_t*>(data));
+
+  // The profile function is the scalar function that also counts outcomes of comparisons.
+  if (d && d->profile_func)
+    d->profile_func(&result, data, bases);
+  else
+    _func(&result, data, bases);
+  return result;
+}
+
+Error Expression::reoptimize(OutputLog* log) {
+  ExpressionImpl* d = _d;
+  if (!d || !d->profile || d->ode_func || d->profile[0].count < uint64_t(kProfileMinSamples))
+    return MATHPRESSO_TRACE_ERROR(kErrorInvalidState);
+
+  const VariableProfile* profile = d->profile;
+  uint32_t input_count = d->input_count;
+  uint32_t speculated_count = 0;
+  bool finite = true;
+
+  for (uint32_t i = 0; i < input_count; i++) {
+    speculated_count += profile[i].constant;
+    finite &= profile[i].nan_count == 0 && profile[i].min != -mp_get_inf() && profile[i].max != mp_get_inf();
+  }
+
+  // Release the current variant first, a new one is only compiled if there is something to speculate on.
+  d->release_speculated();
+
+  if (speculated_count == 0 && !finite)
+    return kErrorOk;
+
+  uint64_t* speculated_bits = static_cast<uint64_t*>(::malloc(speculated_count * (sizeof(uint64_t) + sizeof(int32_t)) + 1));
+  MATHPRESSO_NULLCHECK(speculated_bits);
+  int32_t* speculated_offsets = reinterpret_cast<int32_t*>(speculated_bits + speculated_count);
+
+  // Speculated inputs are specialized in addition to variables the expression was specialized with.
+  size_t spec_count = d->spec_count + speculated_count;
+  uint8_t* p = static_cast<uint8_t*>(::malloc(spec_count * (sizeof(double) + sizeof(char*)) + 1));
+  MATHPRESSO_NULLCHECK_(p, { ::free(speculated_bits); });
+
+  double* spec_values = reinterpret_cast<double*>(p);
+  const char** spec_names = reinterpret_cast<const char**>(p + spec_count * sizeof(double));
+
+  ::memcpy(spec_values, d->spec_values, d->spec_count * sizeof(double));
+  ::memcpy(spec_names, d->spec_names, d->spec_count * sizeof(char*));
+
+  for (uint32_t i = 0, j = 0; i < input_count; i++) {
+    if (!profile[i].constant)
+      continue;
+
+    spec_values[d->spec_count + j] = profile[i].first;
+    spec_names[d->spec_count + j] = profile[i].name;
+    ::memcpy(&speculated_bits[j], &profile[i].first, sizeof(uint64_t));
+    speculated_offsets[j] = profile[i].offset;
+    j++;
+  }
+
+  unsigned int options = d->options & (_kOptionsMask & ~(kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler));
+  if (log)
+    options |= kInternalOptionLog | (d->options & (kOptionVerbose | kOptionDebugAst | kOptionDebugMachineCode | kOptionDebugCompiler));
+  if (finite)
+    options |= kInternalOptionFiniteInputs;
+
+  uint32_t func_types = (options & (kOptionArrayLoop | kOptionFlushDenormals)) ? (1u << kJitFuncScalar) | (1u << kJitFuncArray) : (1u << kJitFuncScalar);
+  if ((options & (kOptionArrayLoop | kOptionStreamingStores)) == (kOptionArrayLoop | kOptionStreamingStores))
+    func_types |= 1u << kJitFuncArrayStream;
+  if (options & kOptionReduceLoop)
+    func_types |= 1u << kJitFuncReduce;
+  if (options & kOptionFilterLoop)
+    func_types |= 1u << kJitFuncBitmap;
+  if (options & (kOptionGatherLoop | kOptionFlushDenormals))
+    func_types |= 1u << kJitFuncGather;
+  void* funcs[kJitFuncCount] {};
+
+  Specialization spec = { spec_names, spec_values, spec_count };
+  Error err = mp_compile_program(d->spec_ctx, d->spec_body, spec, nullptr, nullptr, options, log, func_types, funcs, nullptr);
+  ::free(p);
+  MATHPRESSO_PROPAGATE_(err, { ::free(speculated_bits); });
+
+  d->speculated_func = (CompiledFunc)funcs[kJitFuncScalar];
+  d->speculated_array_func = (ArrayFunc)funcs[kJitFuncArray];
+  d->speculated_stream_func = (ArrayFunc)funcs[kJitFuncArrayStream];
+  d->speculated_reduce_func = (ArrayFunc)funcs[kJitFuncReduce];
+  d->speculated_bitmap_func = (ArrayFunc)funcs[kJitFuncBitmap];
+  d->speculated_gather_func = (GatherFunc)funcs[kJitFuncGather];
+  d->speculated_bits = speculated_bits;
+  d->speculated_offsets = speculated_offsets;
+  d->speculated_count = speculated_count;
+  d->speculated_finite = finite;
+  return kErrorOk;
+}
+
+void Expression::evaluate_array(double* results, void* data, size_t stride, size_t count, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  uint8_t* row = static_cast<uint8_t*>(data);
+
+  bool stream = count >= size_t(kArrayStreamingThreshold);
+
+  if (!d || !d->speculated_func) {
+    mp_evaluate_rows(_func, d, results, row, stride, count, bases, stream);
+    return;
+  }
+
+  ArrayFunc speculated_array_func = stream && d->speculated_stream_func ? d->speculated_stream_func : d->speculated_array_func;
+
+  // Chunks of rows that don't match the speculation are evaluated by the regular functions.
+  while (count) {
+    size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+
+    if (!mp_rows_match_speculation(d, row, stride, n))
+      mp_evaluate_rows(_func, d, results, row, stride, n, bases, stream);
+    else if (speculated_array_func)
+      speculated_array_func(results, row, bases, stride, n);
+    else {
+      for (size_t i = 0; i < n; i++)
+        d->speculated_func(results + i, row + i * stride, bases);
+    }
+
+    results += n;
+    row += n * stride;
+    count -= n;
+  }
+}
+
+void Expression::reduce_array(ReduceResult* out, void* data, size_t stride, size_t count, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  uint8_t* row = static_cast<uint8_t*>(data);
+
+  double state[kReduceStateSize] = { 0.0, 0.0, mp_get_inf(), -mp_get_inf(), 0.0 };
+
+  if (d && d->reduce_func) {
+    if (!d->finite_reduce_func && !d->speculated_reduce_func) {
+      d->reduce_func(state, row, bases, stride, count);
+    }
+    else {
+      // Each chunk is accumulated by the variant that is valid for all of its rows, the state is shared by all.
+      while (count) {
+        size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+        ArrayFunc fn = d->reduce_func;
+
+        if (d->speculated_reduce_func && mp_rows_match_speculation(d, row, stride, n))
+          fn = d->speculated_reduce_func;
+        else if (d->finite_reduce_func && mp_rows_are_finite(row, stride, n, d->input_offsets, d->input_count))
+          fn = d->finite_reduce_func;
+
+        fn(state, row, bases, stride, n);
+        row += n * stride;
+        count -= n;
+      }
+    }
+  }
+  else {
+    // Evaluate chunks of rows and accumulate them the same way as the compiled reduction does.
+    bool kahan = d && (d->options & kOptionKahanSum) != 0;
+    double results[kArrayChunkSize];
+
+    while (count) {
+      size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+      evaluate_array(results, row, stride, n, bases);
+
+      for (size_t i = 0; i < n; i++) {
+        double v = results[i];
+        if (v != v)
+          continue;
+
+        if (kahan) {
+          double y = v - state[kReduceSumComp];
+          double t = state[kReduceSum] + y;
+          state[kReduceSumComp] = mp_is_finite(t) != 0.0 ? (t - state[kReduceSum]) - y : 0.0;
+          state[kReduceSum] = t;
+        }
+        else {
+          state[kReduceSum] += v;
+        }
+
+        state[kReduceMin] = v < state[kReduceMin] ? v : state[kReduceMin];
+        state[kReduceMax] = v > state[kReduceMax] ? v : state[kReduceMax];
+        state[kReduceCount] += 1.0;
+      }
+
+      row += n * stride;
+      count -= n;
+    }
+  }
+
+  out->sum = state[kReduceSum];
+  out->min = state[kReduceMin];
+  out->max = state[kReduceMax];
+  out->count = static_cast<size_t>(state[kReduceCount]);
+  out->mean = state[kReduceSum] / state[kReduceCount];
+}
+
+void Expression::filter_bitmap(uint64_t* bitmap, void* data, size_t stride, size_t count, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  uint8_t* row = static_cast<uint8_t*>(data);
+
+  // Compiled function only processes whole words, the remaining rows are evaluated as an array.
+  if (d && d->bitmap_func) {
+    size_t n = count & ~size_t(63);
+
+    if (!d->finite_bitmap_func && !d->speculated_bitmap_func) {
+      d->bitmap_func(reinterpret_cast<double*>(bitmap), row, bases, stride, n);
+      bitmap += n / 64;
+      row += n * stride;
+      count -= n;
+    }
+    else {
+      while (n) {
+        size_t chunk = n < size_t(kArrayChunkSize) ? n : size_t(kArrayChunkSize);
+        ArrayFunc fn = d->bitmap_func;
+
+        if (d->speculated_bitmap_func && mp_rows_match_speculation(d, row, stride, chunk))
+          fn = d->speculated_bitmap_func;
+        else if (d->finite_bitmap_func && mp_rows_are_finite(row, stride, chunk, d->input_offsets, d->input_count))
+          fn = d->finite_bitmap_func;
+
+        fn(reinterpret_cast<double*>(bitmap), row, bases, stride, chunk);
+        bitmap += chunk / 64;
+        row += chunk * stride;
+        count -= chunk;
+        n -= chunk;
+      }
+    }
+  }
+
+  double results[64];
+  while (count) {
+    size_t n = count < size_t(64) ? count : size_t(64);
+    evaluate_array(results, row, stride, n, bases);
+
+    uint64_t word = 0;
+    for (size_t i = 0; i < n; i++)
+      word |= uint64_t(results[i] != 0.0 && results[i] == results[i]) << i;
+
+    *bitmap++ = word;
+    row += n * stride;
+    count -= n;
+  }
+}
+
+size_t Expression::filter_array(uint32_t* indices, void* data, size_t stride, size_t count, void* const* bases) const {
+  uint8_t* row = static_cast<uint8_t*>(data);
+  uint32_t* indices_start = indices;
+
+  uint64_t bitmap[kArrayChunkSize / 64];
+  uint32_t base_index = 0;
+
+  while (count) {
+    size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+    filter_bitmap(bitmap, row, stride, n, bases);
+
+    for (size_t i = 0; i < (n + 63) / 64; i++) {
+      uint64_t word = bitmap[i];
+      uint32_t word_index = base_index + uint32_t(i * 64);
+
+      while (word) {
+        *indices++ = word_index + asmjit::Support::ctz(word);
+        word &= word - 1;
+      }
+    }
+
+    base_index += uint32_t(n);
+    row += n * stride;
+    count -= n;
+  }
+
+  return size_t(indices - indices_start);
+}
+
+void Expression::evaluate_indexed(double* results, void* data, size_t stride, const uint32_t* indices, size_t count, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  uint8_t* rows = static_cast<uint8_t*>(data);
+
+  if (!d || !d->speculated_func) {
+    mp_evaluate_indexed_rows(_func, d, results, rows, stride, indices, count, bases);
+    return;
+  }
+
+  // Chunks of selected rows that don't match the speculation are evaluated by the regular functions.
+  while (count) {
+    size_t n = count < size_t(kArrayChunkSize) ? count : size_t(kArrayChunkSize);
+
+    if (!mp_indexed_rows_match_speculation(d, rows, stride, indices, n))
+      mp_evaluate_indexed_rows(_func, d, results, rows, stride, indices, n, bases);
+    else if (d->speculated_gather_func)
+      d->speculated_gather_func(results, rows, bases, stride, n, indices);
+    else {
+      for (size_t i = 0; i < n; i++)
+        d->speculated_func(results + i, rows + size_t(indices[i]) * stride, bases);
+    }
+
+    results += n;
+    indices += n;
+    count -= n;
+  }
+}
+
+void Expression::evaluate_array_nullable(double* results, uint64_t* result_validity, void* data, size_t stride, size_t count, const ValidityBitmap* validity, size_t validity_count, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  uint8_t* rows = static_cast<uint8_t*>(data);
+
+  size_t word_count = (count + 63) / 64;
+  uint64_t last_word_mask = (count & 63) ? (uint64_t(1) << (count & 63)) - 1u : ~uint64_t(0);
+
+  // Calculate validity of results first, 64 rows at a time - it's the AND of bitmaps of inputs, which is cheaper here
+  // than in compiled code, as it's not per row.
+  for (size_t w = 0; w < word_count; w++)
+    result_validity[w] = w == word_count - 1 ? last_word_mask : ~uint64_t(0);
+
+  if (d) {
+    for (size_t i = 0; i < validity_count; i++) {
+      const ValidityBitmap& v = validity[i];
+
+      bool is_input = false;
+      for (uint32_t j = 0; j < d->input_count; j++)
+        is_input |= d->input_offsets[j] == v.offset;
+
+      if (!is_input)
+        continue;
+
+      for (size_t w = 0; w < word_count; w++)
+        result_validity[w] &= v.bits[w];
+    }
+  }
+
+  // Evaluate runs of valid rows and fill null rows with NaN. Null rows are not evaluated at all, as the expression can
+  // have side effects (it can write variables or call functions).
+  double nan = mp_get_nan();
+  size_t i = 0;
+
+  while (i < count) {
+    uint64_t bits = result_validity[i / 64] >> (i & 63);
+
+    if ((bits & 1u) == 0) {
+      size_t n = bits ? size_t(asmjit::Support::ctz(bits)) : size_t(64 - (i & 63));
+      size_t end = i + n < count ? i + n : count;
+
+      for (; i < end; i++)
+        results[i] = nan;
+      continue;
+    }
+
+    size_t first = i;
+    for (;;) {
+      bits = ~(result_validity[i / 64] >> (i & 63));
+      size_t n = bits ? size_t(asmjit::Support::ctz(bits)) : size_t(64 - (i & 63));
+      i += n;
+
+      // The run continues to the next word if the current one ends with a valid row.
+      if (n == 0 || (i & 63) != 0 || i >= count || i - first >= size_t(kArrayChunkSize))
+        break;
+    }
+
+    if (i > count)
+      i = count;
+    evaluate_array(results + first, rows + first * stride, stride, i - first, bases);
+  }
+}
+
+double Expression::evaluate_gradient(void* data, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+  CompiledFunc fn = d && d->gradient_func ? d->gradient_func : _func;
+
+  double result;
+  fn(&result, data, bases);
+  return result;
+}
+
+void Expression::evaluate_interval(Interval* result, void* data, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+
+  if (!d || !d->interval_func) {
+    result->lo = -mp_get_inf();
+    result->hi = mp_get_inf();
+    return;
+  }
+
+  d->interval_func(&result->lo, data, bases);
+}
+
+void Expression::integrate(OdeIntegration* ode, void* data, void* const* bases) const {
+  const ExpressionImpl* d = _d;
+
+  if (d && d->ode_func)
+    d->ode_func(ode, data, bases);
 }
 
 // MathPresso - OutputLog - API
@@ -94,6 +94,7 @@ public:
 
 struct OutputLog;
 struct Expression;
+struct ExpressionImpl;
 
 // MathPresso Typedefs
 // ===================
@@ -102,7 +103,10 @@ struct Expression;
 typedef unsigned int Error;
 
 //! Prototype of the compiled function generated by MathPresso.
-typedef void (*CompiledFunc)(double* result, void* data);
+//!
+//! Variables bound to the base 0 are relative to `data`, variables bound to other bases are relative to `bases[i]`,
+//! see \ref VariableFlags. The `bases` array can be null if the expression only uses variables of the base 0.
+typedef void (*CompiledFunc)(double* result, void* data, void* const* bases);
 
 typedef double (*Arg0Func)(void);
 typedef double (*Arg1Func)(double);
@@ -157,6 +161,53 @@ enum Options {
   //! Debug AsmJit's compiler.
   kOptionDebugCompiler = 0x0008u,
 
+  //! Flush denormals to zero while the compiled function runs.
+  //!
+  //! Sets FTZ and DAZ (X86) or FZ (AArch64) in the function prologue and restores the caller's floating-point
+  //! control register in the epilogue, so the environment of the calling thread is never changed. Results that
+  //! would be denormal become zero, which avoids the large penalty denormal operands have on many CPUs.
+  //!
+  //! Functions that evaluate many rows (like \ref Expression::evaluate_array()) always use compiled loops with this
+  //! option (as if \ref kOptionArrayLoop and \ref kOptionGatherLoop were set), so the control register is set once
+  //! per call (or chunk of rows) instead of once per row.
+  kOptionFlushDenormals = 0x0010u,
+
+  //! Also compile a variant of the expression that assumes finite inputs.
+  //!
+  //! The variant folds NaN/INF checks of inputs and other operations that are only equivalent for finite values
+  //! (like `x - x` or `x == x`). It produces the same results as the IEEE-correct variant when all inputs are
+  //! finite, and it's only used by \ref Expression::evaluate_array(), which checks each chunk of rows and uses
+  //! the fast variant only when all inputs of the chunk are finite.
+  kOptionFiniteFastPath = 0x0020u,
+
+  //! Also compile a function that evaluates rows in a loop, used by \ref Expression::evaluate_array().
+  //!
+  //! Subexpressions that only depend on variables of other bases than 0 (see \ref kVariableBase1), which are the
+  //! same for all rows of a single call, are computed once before the loop instead of once per row.
+  kOptionArrayLoop = 0x0040u,
+
+  //! Also compile a function that accumulates results of rows in a loop, used by \ref Expression::reduce_array().
+  //!
+  //! Without this option `reduce_array()` evaluates chunks of rows and accumulates them separately.
+  kOptionReduceLoop = 0x0080u,
+
+  //! Use Kahan (compensated) summation in \ref Expression::reduce_array().
+  kOptionKahanSum = 0x0100u,
+
+  //! Also compile a function that evaluates rows as a predicate to a bitmap, used by \ref Expression::filter_bitmap()
+  //! and \ref Expression::filter_array().
+  kOptionFilterLoop = 0x0200u,
+
+  //! Also compile a function that evaluates rows selected by an index list, used by
+  //! \ref Expression::evaluate_indexed().
+  kOptionGatherLoop = 0x0400u,
+
+  //! Also compile a variant of the \ref kOptionArrayLoop function that uses non-temporal (streaming) stores.
+  //!
+  //! \ref Expression::evaluate_array() uses the variant when the results are much larger than caches, in which
+  //! case regular stores would evict inputs from caches and read each cache line of results before writing it.
+  kOptionStreamingStores = 0x0800u,
+
   //! Do not use SSE4.1 extension even if CPU supports it.
   //!
   //! \note This should only be used to test various code generation implementations, which normally detect
@@ -174,11 +225,22 @@ enum Options {
   //! \note This should only be used to test various code generation implementations.
   kOptionDisableAVX512 = 0x4000u,
 
+  //! Also compile a function that evaluates the expression over intervals, used by
+  //! \ref Expression::evaluate_interval().
+  kOptionInterval = 0x10000u,
+
+  //! Keep a profile of inputs of rows evaluated by \ref Expression::sample() and count outcomes of comparisons, see
+  //! \ref Expression::profile(), \ref Expression::condition_profile(), and \ref Expression::reoptimize().
+  //!
+  //! Functions that only evaluate the expression don't sample (they are `const` and can be called by multiple threads
+  //! at the same time), so the caller decides which rows are sampled.
+  kOptionProfile = 0x20000u,
+
   //! \internal
   //!
   //! Mask of all accessible options, MathPresso uses also \ref InternalOptions
   //! that should not collide with \ref Options.
-  _kOptionsMask = 0xFFFFu
+  _kOptionsMask = 0x00FFFFFFu
 };
 
 // MathPresso Variable Flags
@@ -187,7 +249,31 @@ enum Options {
 //! Variable flags.
 enum VariableFlags {
   kVariableRW = 0x00000000u,
-  kVariableRO = 0x00000001u
+  kVariableRO = 0x00000001u,
+
+  //! Variable is relative to the base pointer 0 - the `data` passed to evaluate (default).
+  kVariableBase0 = 0x00000000u,
+  //! Variable is relative to the base pointer 1.
+  kVariableBase1 = 0x00000100u,
+  //! Variable is relative to the base pointer 2.
+  kVariableBase2 = 0x00000200u,
+  //! Variable is relative to the base pointer 3.
+  kVariableBase3 = 0x00000300u,
+  //! Variable is relative to the base pointer 4.
+  kVariableBase4 = 0x00000400u,
+  //! Variable is relative to the base pointer 5.
+  kVariableBase5 = 0x00000500u,
+  //! Variable is relative to the base pointer 6.
+  kVariableBase6 = 0x00000600u,
+  //! Variable is relative to the base pointer 7.
+  kVariableBase7 = 0x00000700u,
+
+  //! \internal
+  _kVariableBaseShift = 8,
+  //! \internal
+  _kVariableBaseMask = 0x00000700u,
+  //! \internal
+  _kVariableBaseCount = 8
 };
 
 // MathPresso Function Flags
@@ -226,6 +312,134 @@ enum FunctionFlags {
   kFunctionNoSideEffects = 0x80000000u
 };
 
+// MathPresso Table Flags
+// ======================
+
+//! Table flags, see \ref Context::add_table() - can be combined with `kVariableBase{i}` flags.
+enum TableFlags {
+  //! Values between knots are interpolated linearly (default).
+  kTableLinear = 0x00000000u,
+  //! Values between knots are interpolated by a cubic Catmull-Rom spline (only tables having uniform knots).
+  kTableCubic = 0x00010000u,
+
+  //! \internal
+  //!
+  //! Table has non-uniform knots, see \ref Context::add_table_knots().
+  _kTableKnots = 0x00020000u
+};
+
+// MathPresso Reduce Result
+// ========================
+
+//! Result of \ref Expression::reduce_array().
+//!
+//! Results that are NaN are skipped by all reductions.
+struct ReduceResult {
+  //! Sum of results.
+  double sum;
+  //! Minimum of results (INF if `count` is zero).
+  double min;
+  //! Maximum of results (-INF if `count` is zero).
+  double max;
+  //! Mean of results (NaN if `count` is zero).
+  double mean;
+  //! Number of results.
+  size_t count;
+};
+
+// MathPresso Validity Bitmap
+// ==========================
+
+//! Validity bitmap of a variable, see \ref Expression::evaluate_array_nullable().
+struct ValidityBitmap {
+  //! Offset of the variable, the same as passed to \ref Context::add_variable() (only variables of base 0).
+  int offset;
+  //! Bit `i % 64` of `bits[i / 64]` is set if the variable of the row `i` is valid (not null).
+  const uint64_t* bits;
+};
+
+// MathPresso Interval
+// ===================
+
+//! Closed interval `[lo, hi]` of doubles, see \ref Expression::evaluate_interval().
+//!
+//! Infinite bounds are allowed. An interval with `lo > hi` is `[hi, lo]` that may also be NaN and an interval having
+//! a NaN bound is empty (it's only NaN).
+struct Interval {
+  //! Lower bound.
+  double lo;
+  //! Upper bound.
+  double hi;
+};
+
+// MathPresso ODE
+// ==============
+
+//! Method used to integrate a system of ordinary differential equations, see \ref Expression::compile_ode().
+enum OdeMethod {
+  //! Classic fourth order Runge-Kutta method with a fixed step.
+  kOdeRK4 = 0,
+  //! Dormand-Prince 5(4) method with an adaptive step - the error of each step is estimated by the embedded fourth
+  //! order solution and steps that exceed the tolerance are repeated with a smaller step.
+  kOdeRK45 = 1
+};
+
+//! Parameters and progress of \ref Expression::integrate().
+struct OdeIntegration {
+  //! Time, updated to the time reached.
+  double t;
+  //! Step - fixed (\ref kOdeRK4), or the initial step, which is updated to the next step to try (\ref kOdeRK45).
+  double dt;
+  //! Time to integrate to (only \ref kOdeRK45).
+  double t_end;
+  //! Tolerance of the error of each accepted step, which is relative to `1 + |y|` of each component (only
+  //! \ref kOdeRK45).
+  double tolerance;
+  //! Number of steps (\ref kOdeRK4) or the maximum number of attempted steps (\ref kOdeRK45), updated to the number
+  //! of steps left - if it's zero and `t` didn't reach `t_end` the integration can be continued by another call.
+  size_t steps;
+};
+
+// MathPresso Variable Profile
+// ===========================
+
+//! Statistics of a variable sampled by an expression compiled with \ref kOptionProfile, see
+//! \ref Expression::profile().
+struct VariableProfile {
+  //! Name of the variable.
+  const char* name;
+  //! Offset of the variable in a row.
+  int offset;
+  //! Whether all samples are the same (compared bitwise).
+  bool constant;
+  //! The first sample (the value of the variable if it's `constant`).
+  double first;
+  //! Minimum of samples that are not NaN (INF if there is no such sample).
+  double min;
+  //! Maximum of samples that are not NaN (-INF if there is no such sample).
+  double max;
+  //! Number of samples.
+  uint64_t count;
+  //! Number of samples that are NaN.
+  uint64_t nan_count;
+  //! Number of samples that have the sign bit set (including -0).
+  uint64_t negative_count;
+};
+
+// MathPresso Condition Profile
+// ============================
+
+//! Statistics of a comparison evaluated by \ref Expression::sample() of an expression compiled with
+//! \ref kOptionProfile, see \ref Expression::condition_profile().
+struct ConditionProfile {
+  //! Position of the comparison in the expression (in characters, `0xFFFFFFFF` if it was created by the optimizer).
+  uint32_t position;
+  //! Number of evaluations.
+  uint64_t count;
+  //! Number of evaluations that were true.
+  uint64_t true_count;
+};
+
 // MathPresso Context
 // ==================
 
@@ -266,6 +480,13 @@ struct Context {
   //! Assignement operator.
   MATHPRESSO_API Context& operator=(const Context& other);
 
+  //! Make this context an empty context derived from `parent`.
+  //!
+  //! Symbols of `parent` are visible through this context without being copied, and symbols added to this context
+  //! shadow symbols of the same name in `parent`. The parent is shared (referenced) and should not be modified
+  //! afterwards - modifying it makes a private copy of it, which derived contexts don't see.
+  MATHPRESSO_API Error derive_from(const Context& parent);
+
   // Interface
   // ---------
 
@@ -275,11 +496,43 @@ struct Context {
   //! Add constant to this context.
   MATHPRESSO_API Error add_constant(const char* name, double value);
   //! Add variable to this context.
+  //!
+  //! The `offset` is relative to the base pointer selected by `flags`, see \ref kVariableBase0 and others.
   MATHPRESSO_API Error add_variable(const char* name, int offset, unsigned int flags = kVariableRW);
+  //! Add read-only array of `length` variables to this context, the element `i` is at `offset + i * stride`. The
+  //! `stride` must not be zero.
+  //!
+  //! Elements are accessed as `name[index]` - the index is truncated towards zero and clamped to the array, so an
+  //! access is never out of bounds (NaN selects the first element). Only `kVariableBase{i}` bits of `flags` are used.
+  //! Elements are not intervals, so they evaluate to `[-inf, inf]` that may be NaN if \ref kOptionInterval is used.
+  MATHPRESSO_API Error add_array(const char* name, int offset, size_t length, unsigned int stride = sizeof(double), unsigned int flags = kVariableBase0);
+  //! Add table of `length` doubles at `offset` sampled at uniform knots from `x0` to `x1` to this context.
+  //!
+  //! A table is used as a function of one argument - `name(x)` interpolates values of knots around `x`, see
+  //! \ref TableFlags. The position is clamped to the knots (NaN gives NaN). The interpolation is compiled inline
+  //! without branches, so it's much cheaper than a function doing the same. Derivatives of tables are unknown and
+  //! they evaluate to `[-inf, inf]` that may be NaN if \ref kOptionInterval is used.
+  MATHPRESSO_API Error add_table(const char* name, int offset, size_t length, double x0, double x1, unsigned int flags = kTableLinear);
+  //! Add table of `length` doubles at `offset` sampled at knots at `knots_offset` to this context.
+  //!
+  //! The same as \ref add_table(), but knots are `length` strictly ascending doubles relative to the same base pointer
+  //! as values, which are searched by a binary search of a fixed number of steps. Only \ref kTableLinear is supported.
+  MATHPRESSO_API Error add_table_knots(const char* name, int offset, int knots_offset, size_t length, unsigned int flags = kTableLinear);
   //! Add function to this context.
   MATHPRESSO_API Error add_function(const char* name, void* fn, unsigned int flags);
+  //! Add inline function of comma separated `params` (up to 8) that evaluates `body` to this context.
+  //!
+  //! The body is a single expression parsed once, each call `name(args...)` is replaced by a copy of it where each
+  //! parameter is replaced by a copy of its argument, so it's optimized and compiled together with the caller. The
+  //! body can only use parameters, constants (their current values are used), intrinsics and inline functions added
+  //! before it. Returns \ref kErrorInvalidSyntax if the body can't be parsed.
+  //!
+  //! Calls have macro semantics - an argument is evaluated once per use of its parameter (or not at all). Expressions
+  //! that pass an argument calling a function without \ref kFunctionNoSideEffects to a parameter that isn't used
+  //! exactly once fail to compile with \ref kErrorInvalidSyntax.
+  MATHPRESSO_API Error add_inline_function(const char* name, const char* params, const char* body);
 
-  //! Delete symbol from this context.
+  //! Delete symbol from this context (symbols of a parent context, see \ref derive_from(), cannot be deleted).
   MATHPRESSO_API Error del_symbol(const char* name);
 };
 
@@ -295,6 +548,8 @@ struct Expression {
 
   //! Compiled function.
   CompiledFunc _func;
+  //! Private data not needed by `evaluate()`.
+  ExpressionImpl* _d;
 
   // Construction & Destruction
   // --------------------------
@@ -309,6 +564,10 @@ struct Expression {
 
   //! Parse and compile a given expression.
   //!
+  //! Besides expressions, the body can declare variables (`var a = x * 2;`), use nested blocks, and bounded loops -
+  //! `repeat (n) statement` (or a block) evaluates the statement `n` times. The count is evaluated once, truncated,
+  //! and clamped to 1048576 iterations (NaN or a negative count means no iteration).
+  //!
   //! \param ctx MathPresso's \ref Context to use.
   //! \param body Expression to parse and compile.
   //! \param options MathPresso options (flags), see \ref Options.
@@ -318,6 +577,82 @@ struct Expression {
   //! Returns MathPresso's error code, see \ref Error.
   MATHPRESSO_API Error compile(const Context& ctx, const char* body, unsigned int options, OutputLog* log = nullptr);
 
+  //! Parse and compile a given expression, treating variables `names[0..count)` as constants `values[0..count)`.
+  //!
+  //! The specialized variables become immediates, so the optimizer can fold everything that depends only on them.
+  //! This is useful for coefficients that change rarely, but are read each time the expression is evaluated.
+  //! Specialized variables are read-only within the expression.
+  //!
+  //! Returns \ref kErrorSymbolNotFound if a name doesn't refer to a variable of `ctx` and \ref kErrorInvalidArgument
+  //! if it refers to something else than a variable or if a variable is specialized twice.
+  MATHPRESSO_API Error specialize(const Context& ctx, const char* body, const char* const* names, const double* values, size_t count, unsigned int options, OutputLog* log = nullptr);
+
+  //! Parse and compile a given expression like \ref compile(), and also a function that computes the result together
+  //! with its partial derivatives with respect to variables `names[0..count)`, see \ref evaluate_gradient().
+  //!
+  //! The derivatives are computed by reverse-mode automatic differentiation of the optimized expression, so the cost
+  //! doesn't grow with `count` like finite differences do. Operators that are piecewise constant (conditions and
+  //! rounding) have zero derivatives. Derivatives of functions added by \ref Context::add_function() are unknown,
+  //! so partial derivatives that depend on them are NaN.
+  //!
+  //! Returns \ref kErrorSymbolNotFound if a name doesn't refer to a symbol and \ref kErrorInvalidArgument if it
+  //! refers to something else than a global variable.
+  MATHPRESSO_API Error compile_gradient(const Context& ctx, const char* body, const char* const* names, const int* offsets, size_t count, unsigned int options, OutputLog* log = nullptr);
+
+  //! Parse and compile a system of ordinary differential equations `d names[i] / dt = bodies[i]` and a function that
+  //! integrates it by `method` (see \ref OdeMethod and \ref integrate()).
+  //!
+  //! Each of `bodies` is a program that computes the derivative of the variable `names[i]` (locals declared by one
+  //! program are not visible to others). State variables and the optional time variable `time_name` must be global
+  //! variables that are not read-only, the programs cannot assign them. The state is kept in registers while
+  //! integrating and only stored when \ref integrate() returns. Other variables can be assigned, which happens each
+  //! time the right-hand sides are evaluated. Functions that evaluate the expression (like \ref evaluate()) evaluate
+  //! all programs and return the result of the last one.
+  //!
+  //! Returns \ref kErrorSymbolNotFound if a name doesn't refer to a symbol and \ref kErrorInvalidArgument if it
+  //! refers to something else than a writable global variable or is used twice.
+  MATHPRESSO_API Error compile_ode(const Context& ctx, const char* const* bodies, const char* const* names, size_t count, const char* time_name, uint32_t method, unsigned int options, OutputLog* log = nullptr);
+
+  //! Compile the expression passed to \ref specialize() again with new `values` (in the same order as `names`).
+  //!
+  //! The context, body, names, and options are kept by the expression, so the caller only provides the values. If
+  //! the values are the same as the current ones nothing is compiled. Otherwise the body is parsed, optimized, and
+  //! compiled again (the AST is not kept), which costs as much as \ref specialize(), so it only pays off if values
+  //! change much less often than the expression is evaluated. Returns \ref kErrorInvalidState if the expression was
+  //! not specialized.
+  MATHPRESSO_API Error respecialize(const double* values, OutputLog* log = nullptr);
+
+  //! Store statistics of variables sampled by an expression compiled with \ref kOptionProfile to `out` (at most
+  //! `capacity` of them). Returns the number of variables the expression reads from rows (which can be larger than
+  //! `capacity`) or zero if the expression doesn't profile.
+  MATHPRESSO_API size_t profile(VariableProfile* out, size_t capacity) const;
+
+  //! Store statistics of comparisons of the optimized expression compiled with \ref kOptionProfile to `out` (at most
+  //! `capacity` of them, in the order they are evaluated). Returns the number of comparisons or zero if the
+  //! expression doesn't profile.
+  //!
+  //! Comparisons are compiled without branches, so \ref reoptimize() doesn't speculate on their outcomes.
+  MATHPRESSO_API size_t condition_profile(ConditionProfile* out, size_t capacity) const;
+
+  //! Evaluate a single row like \ref evaluate() and add its inputs and outcomes of comparisons to the profile if the
+  //! expression was compiled with \ref kOptionProfile. Returns the result of the evaluated expression.
+  //!
+  //! The profile is not synchronized, so this function must not be called by multiple threads at the same time (or
+  //! at the same time as \ref reoptimize()). Other functions don't read the profile.
+  MATHPRESSO_API double sample(void* data, void* const* bases = nullptr);
+
+  //! Compile a variant of the expression speculating on the profile (see \ref kOptionProfile).
+  //!
+  //! Variables that were the same in all of at least 64 samples become constants of the variant (like variables
+  //! passed to \ref specialize()), and if no sampled input was NaN or INF the variant also assumes finite inputs
+  //! (like \ref kOptionFiniteFastPath does). \ref evaluate_array(), \ref reduce_array(), \ref filter_bitmap(),
+  //! \ref filter_array(), and \ref evaluate_indexed() guard each chunk of rows and use the variant only if the
+  //! speculation holds for all rows of the chunk, other chunks are evaluated by the regular functions. The
+  //! profile is kept, so the expression can be reoptimized again later, which replaces the variant (or releases it
+  //! if there is nothing to speculate on). Returns \ref kErrorInvalidState if the expression doesn't profile, reads
+  //! no variables from rows, or has less than 64 samples.
+  MATHPRESSO_API Error reoptimize(OutputLog* log = nullptr);
+
   //! Get whether the `Expression` contains a valid compiled expression.
   MATHPRESSO_API bool is_compiled() const;
 
@@ -329,9 +664,87 @@ struct Expression {
   //! Returns the result of the evaluated expression, NaN otherwise.
   MATHPRESSO_INLINE double evaluate(void* data) const {
     double result;
-    _func(&result, data);
+    _func(&result, data, nullptr);
+    return result;
+  }
+
+  //! Evaluate expression that uses variables relative to multiple base pointers.
+  //!
+  //! The `bases[i]` is the base pointer of variables added with `kVariableBase{i}` flag, `bases[0]` is the same
+  //! as `data` passed to \ref evaluate(). Only bases used by the expression are read.
+  MATHPRESSO_INLINE double evaluate_bases(void* const* bases) const {
+    double result;
+    _func(&result, bases[0], bases);
     return result;
   }
+
+  //! Evaluate expression for `count` rows, the row `i` starts at `data + i * stride` (in bytes) and its result is
+  //! stored to `results[i]`.
+  //!
+  //! If the expression was compiled with \ref kOptionFiniteFastPath the rows are processed in chunks and each chunk
+  //! that contains only finite inputs is evaluated by the faster variant.
+  //!
+  //! Variables bound to other bases than 0 are relative to `bases[i]`, which are the same for all rows (`bases[0]`
+  //! is not used as rows are always relative to `data`).
+  MATHPRESSO_API void evaluate_array(double* results, void* data, size_t stride, size_t count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression for `count` rows (see \ref evaluate_array()) and reduce the results to a sum, minimum,
+  //! maximum, mean, and count stored to `out`, without materializing the results.
+  //!
+  //! If the expression was compiled with \ref kOptionReduceLoop the results are accumulated by compiled code.
+  MATHPRESSO_API void reduce_array(ReduceResult* out, void* data, size_t stride, size_t count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression as a predicate for `count` rows (see \ref evaluate_array()) and set bit `i % 64` of
+  //! `bitmap[i / 64]` if the result of the row `i` is non-zero and not NaN. The `bitmap` must have space for
+  //! `(count + 63) / 64` words, unused bits of the last word are cleared.
+  //!
+  //! If the expression was compiled with \ref kOptionFilterLoop the bitmap is produced by compiled code.
+  MATHPRESSO_API void filter_bitmap(uint64_t* bitmap, void* data, size_t stride, size_t count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression as a predicate for `count` rows (see \ref filter_bitmap()) and store indexes of selected
+  //! rows to `indices`, which must have space for `count` indexes. Returns the number of selected rows.
+  MATHPRESSO_API size_t filter_array(uint32_t* indices, void* data, size_t stride, size_t count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression for `count` rows selected by `indices` and store their results to `results` - the row `i`
+  //! starts at `data + indices[i] * stride` (in bytes). Use with \ref filter_array() to evaluate only selected rows
+  //! without copying them.
+  //!
+  //! If the expression was compiled with \ref kOptionGatherLoop the rows are loaded by compiled code.
+  MATHPRESSO_API void evaluate_indexed(double* results, void* data, size_t stride, const uint32_t* indices, size_t count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression for `count` rows (see \ref evaluate_array()) of which some inputs can be null.
+  //!
+  //! Nulls propagate - the result of a row is valid only if all variables the expression reads are valid. Bitmaps
+  //! of variables the expression doesn't read (or only writes) are ignored, variables without a bitmap are always
+  //! valid. Validity of results is the AND of the bitmaps, computed before the expression is evaluated, and it's
+  //! stored to `result_validity` (which must have space for `(count + 63) / 64` words, unused bits of the last word
+  //! are cleared). Null rows are not evaluated, so they don't write variables or call functions, and their results
+  //! are NaN. Runs of valid rows are evaluated by \ref evaluate_array().
+  MATHPRESSO_API void evaluate_array_nullable(double* results, uint64_t* result_validity, void* data, size_t stride, size_t count, const ValidityBitmap* validity, size_t validity_count, void* const* bases = nullptr) const;
+
+  //! Evaluate expression compiled by \ref compile_gradient() and store the partial derivative of the result with
+  //! respect to `names[i]` to `data + offsets[i]` (as double). Returns the result of the evaluated expression.
+  //!
+  //! Partial derivatives are stored after the expression is evaluated, so they can overwrite its inputs. Expressions
+  //! not compiled by \ref compile_gradient() only evaluate the result.
+  MATHPRESSO_API double evaluate_gradient(void* data, void* const* bases = nullptr) const;
+
+  //! Evaluate expression over intervals and store an interval that contains results of all points of the input
+  //! intervals to `result`. If a point can have a NaN result the bounds of `result` are swapped (`lo > hi`), if all
+  //! points have a NaN result both bounds are NaN, see \ref Interval.
+  //!
+  //! Each variable added at offset `o` is an \ref Interval at `data + o * 2` (or `bases[i] + o * 2`), so variables
+  //! of a program should be laid out in doubles and given as intervals in the same order. Assignments store
+  //! intervals. The `result` must not overlap with variables.
+  //!
+  //! Operators are rounded outwards, results of user functions are `[-INF, INF]` that may be NaN. Expressions not
+  //! compiled with \ref kOptionInterval store `[-INF, INF]`.
+  MATHPRESSO_API void evaluate_interval(Interval* result, void* data, void* const* bases = nullptr) const;
+
+  //! Integrate the system compiled by \ref compile_ode() starting at the state read from `data` (and `bases`) at
+  //! the time `ode->t`, the state reached is stored back and `ode` is updated. Expressions not compiled by
+  //! \ref compile_ode() don't change anything.
+  MATHPRESSO_API void integrate(OdeIntegration* ode, void* data, void* const* bases = nullptr) const;
 };
 
 // MathPresso OutputLog
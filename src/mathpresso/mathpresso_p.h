@@ -149,6 +149,8 @@ enum OpType {
   kOpLe,                // a <= b
   kOpGt,                // a >  b
   kOpGe,                // a >= b
+  kOpLogAnd,            // a && b
+  kOpLogOr,             // a || b
 
   kOpAdd,               // a + b
   kOpSub,               // a - b
@@ -209,7 +211,33 @@ enum OpFlags {
 // ==========================
 
 enum InternalConsts {
-  kInvalidSlot = 0xFFFFFFFFu
+  kInvalidSlot = 0xFFFFFFFFu,
+
+  //! Number of rows processed at once by `Expression::evaluate_array()`.
+  kArrayChunkSize = 256,
+  //! Minimum number of rows `Expression::evaluate_array()` uses streaming stores for (16MB of results).
+  kArrayStreamingThreshold = 2 * 1024 * 1024,
+
+  //! Minimum number of samples `Expression::reoptimize()` speculates on.
+  kProfileMinSamples = 64,
+
+  //! Maximum number of iterations of a `repeat` loop, larger counts are clamped, so a loop always terminates.
+  kMaxRepeatCount = 1024 * 1024,
+  //! Maximum number of iterations of a `repeat` loop having a constant count unrolled by `AstOptimizer`.
+  kRepeatUnrollCount = 8,
+  //! Maximum number of nodes of all copies of the body of a `repeat` loop unrolled by `AstOptimizer`.
+  kRepeatUnrollNodes = 256,
+
+  //! Maximum number of elements of an array, see \ref Context::add_array().
+  kMaxArrayLength = 0x7FFFFFFF,
+
+  //! Maximum number of parameters of an inline function, see \ref Context::add_inline_function().
+  kMaxInlineParams = 8,
+
+  //! Arena block size of a context.
+  kContextArenaSize = 32768,
+  //! Arena block size of a derived context, which usually holds only a few symbols.
+  kDerivedContextArenaSize = 2048
 };
 
 // MathPresso Internal Options
@@ -220,7 +248,10 @@ enum InternalConsts {
 //! Compilation options MATHPRESSO uses internally.
 enum InternalOptions {
   //! Set if `OutputLog` is present. MATHPRESSO then checks only this flag to use it.
-  kInternalOptionLog = 0x00010000
+  kInternalOptionLog = 0x01000000,
+
+  //! Compiling the variant that assumes finite inputs, see \ref kOptionFiniteFastPath.
+  kInternalOptionFiniteInputs = 0x02000000
 };
 
 // MathPresso - Assertions
@@ -38,9 +38,11 @@ static const AstNodeSize ast_node_size_table[] = {
   ROW(kAstNodeVarDecl  , sizeof(AstVarDecl)  ),
   ROW(kAstNodeVar      , sizeof(AstVar)      ),
   ROW(kAstNodeImm      , sizeof(AstImm)      ),
+  ROW(kAstNodeIndex    , sizeof(AstIndex)    ),
   ROW(kAstNodeUnaryOp  , sizeof(AstUnaryOp)  ),
   ROW(kAstNodeBinaryOp , sizeof(AstBinaryOp) ),
-  ROW(kAstNodeCall     , sizeof(AstCall)     )
+  ROW(kAstNodeCall     , sizeof(AstCall)     ),
+  ROW(kAstNodeRepeat   , sizeof(AstRepeat)   )
 };
 #undef ROW
 
@@ -95,10 +97,31 @@ AstSymbol* AstBuilder::shadow_symbol(const AstSymbol* other) {
     case kAstSymbolVariable: {
       sym->_var_slot_id = other->_var_slot_id;
       sym->_var_offset = other->_var_offset;
+      sym->_var_base = other->_var_base;
       sym->_value = other->_value;
       break;
     }
 
+    case kAstSymbolArray: {
+      sym->_var_offset = other->_var_offset;
+      sym->_var_base = other->_var_base;
+      sym->_array_length = other->_array_length;
+      sym->_array_stride = other->_array_stride;
+      break;
+    }
+
+    case kAstSymbolTable: {
+      sym->_var_offset = other->_var_offset;
+      sym->_var_base = other->_var_base;
+      sym->_array_length = other->_array_length;
+      sym->_array_stride = other->_array_stride;
+      sym->_table_knots = other->_table_knots;
+      sym->_table_flags = other->_table_flags;
+      sym->_table_x0 = other->_table_x0;
+      sym->_table_scale = other->_table_scale;
+      break;
+    }
+
     case kAstSymbolFunction: {
       sym->_func_ptr = other->_func_ptr;
       sym->_func_args = other->_func_args;
@@ -128,9 +151,11 @@ void AstBuilder::delete_node(AstNode* node) {
     case kAstNodeVarDecl  : static_cast<AstVarDecl*  >(node)->destroy(this); break;
     case kAstNodeVar      : static_cast<AstVar*      >(node)->destroy(this); break;
     case kAstNodeImm      : static_cast<AstImm*      >(node)->destroy(this); break;
+    case kAstNodeIndex    : static_cast<AstIndex*    >(node)->destroy(this); break;
     case kAstNodeUnaryOp  : static_cast<AstUnaryOp*  >(node)->destroy(this); break;
     case kAstNodeBinaryOp : static_cast<AstBinaryOp* >(node)->destroy(this); break;
     case kAstNodeCall     : static_cast<AstCall*     >(node)->destroy(this); break;
+    case kAstNodeRepeat   : static_cast<AstRepeat*   >(node)->destroy(this); break;
   }
 
   for (uint32_t i = 0; i < size; i++) {
@@ -142,6 +167,126 @@ void AstBuilder::delete_node(AstNode* node) {
   _arena.free_reusable(node, ast_node_size_table[node_type].node_size());
 }
 
+AstNode* AstBuilder::clone_node(AstNode* node, AstNode* const* args) {
+  uint32_t node_type = node->node_type();
+  AstNode* clone;
+
+  // Symbol counters are updated like when the parser creates the node, `delete_node()` reverts them.
+  switch (node_type) {
+    case kAstNodeBlock: {
+      clone = new_node<AstBlock>();
+      break;
+    }
+
+    case kAstNodeVarDecl: {
+      AstVarDecl* decl = new_node<AstVarDecl>();
+      if (decl) {
+        AstSymbol* sym = static_cast<AstVarDecl*>(node)->symbol();
+        decl->set_symbol(sym);
+
+        if (static_cast<AstVarDecl*>(node)->child()) {
+          sym->increment_used_count();
+          sym->increment_write_count();
+        }
+      }
+      clone = decl;
+      break;
+    }
+
+    case kAstNodeVar: {
+      if (args)
+        return clone_node(args[static_cast<AstVar*>(node)->symbol()->var_slot_id()]);
+
+      AstVar* var = new_node<AstVar>();
+      if (var) {
+        var->set_symbol(static_cast<AstVar*>(node)->symbol());
+        var->symbol()->increment_used_count();
+      }
+      clone = var;
+      break;
+    }
+
+    case kAstNodeImm: {
+      clone = new_node<AstImm>(static_cast<AstImm*>(node)->value());
+      break;
+    }
+
+    case kAstNodeIndex: {
+      AstIndex* index = new_node<AstIndex>();
+      if (index)
+        index->set_symbol(static_cast<AstIndex*>(node)->symbol());
+      clone = index;
+      break;
+    }
+
+    case kAstNodeUnaryOp: {
+      clone = new_node<AstUnaryOp>(node->op_type());
+      break;
+    }
+
+    case kAstNodeBinaryOp: {
+      // The write count is incremented when the left child (the assigned variable) is cloned.
+      clone = new_node<AstBinaryOp>(node->op_type());
+      break;
+    }
+
+    case kAstNodeCall: {
+      AstCall* call = new_node<AstCall>();
+      if (call)
+        call->set_symbol(static_cast<AstCall*>(node)->symbol());
+      clone = call;
+      break;
+    }
+
+    case kAstNodeRepeat: {
+      clone = new_node<AstRepeat>();
+      break;
+    }
+
+    default:
+      MATHPRESSO_ASSERT_NOT_REACHED();
+      return nullptr;
+  }
+
+  if (MATHPRESSO_UNLIKELY(clone == nullptr))
+    return nullptr;
+
+  clone->set_node_flags(node->node_flags());
+  clone->set_position(node->position());
+
+  bool is_block = node_type == kAstNodeBlock || node_type == kAstNodeCall;
+  bool is_assignment = node_type == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment();
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    AstNode* child_clone = nullptr;
+
+    if (child) {
+      child_clone = clone_node(child, args);
+      if (MATHPRESSO_UNLIKELY(child_clone == nullptr)) {
+        delete_node(clone);
+        return nullptr;
+      }
+    }
+
+    if (is_block) {
+      if (static_cast<AstBlock*>(clone)->will_add() != kErrorOk) {
+        delete_node(child_clone);
+        delete_node(clone);
+        return nullptr;
+      }
+      static_cast<AstBlock*>(clone)->append_node(child_clone);
+    }
+    else {
+      clone->replace_at(i, child_clone);
+      if (i == 0 && is_assignment)
+        static_cast<AstVar*>(child_clone)->symbol()->increment_write_count();
+    }
+  }
+
+  return clone;
+}
+
 Error AstBuilder::init_program_scope() {
   if (_root_scope == nullptr) {
     _root_scope = new_scope(nullptr, kAstScopeGlobal);
@@ -386,9 +531,11 @@ Error AstVisitor::on_node(AstNode* node) {
     case kAstNodeVarDecl  : return on_var_decl (static_cast<AstVarDecl*  >(node));
     case kAstNodeVar      : return on_var      (static_cast<AstVar*      >(node));
     case kAstNodeImm      : return on_imm      (static_cast<AstImm*      >(node));
+    case kAstNodeIndex    : return on_index    (static_cast<AstIndex*    >(node));
     case kAstNodeUnaryOp  : return on_unary_op (static_cast<AstUnaryOp*  >(node));
     case kAstNodeBinaryOp : return on_binary_op(static_cast<AstBinaryOp* >(node));
     case kAstNodeCall     : return on_invoke   (static_cast<AstCall*     >(node));
+    case kAstNodeRepeat   : return on_repeat   (static_cast<AstRepeat*   >(node));
 
     default:
       return MATHPRESSO_TRACE_ERROR(kErrorInvalidState);
@@ -436,6 +583,15 @@ Error AstDump::on_imm(AstImm* node) {
   return info("%f", node->_value);
 }
 
+Error AstDump::on_index(AstIndex* node) {
+  AstSymbol* sym = node->symbol();
+
+  nest(sym && sym->symbol_type() == kAstSymbolTable ? "%s()" : "%s[]", sym ? sym->name() : static_cast<const char*>(nullptr));
+  if (node->child())
+    MATHPRESSO_PROPAGATE(on_node(node->child()));
+  return denest();
+}
+
 Error AstDump::on_unary_op(AstUnaryOp* node) {
   nest("%s [Unary]", OpInfo::get(node->op_type()).name);
   if (node->child())
@@ -460,6 +616,15 @@ Error AstDump::on_invoke(AstCall* node) {
   return denest();
 }
 
+Error AstDump::on_repeat(AstRepeat* node) {
+  nest("repeat");
+  if (node->count())
+    MATHPRESSO_PROPAGATE(on_node(node->count()));
+  if (node->body())
+    MATHPRESSO_PROPAGATE(on_block(node->body()));
+  return denest();
+}
+
 Error AstDump::info(const char* fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
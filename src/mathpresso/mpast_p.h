@@ -56,7 +56,13 @@ enum AstSymbolType {
   //! Symbol is a variable.
   kAstSymbolVariable,
   //! Symbol is a function.
-  kAstSymbolFunction
+  kAstSymbolFunction,
+  //! Symbol is a read-only array of variables, see \ref Context::add_array().
+  kAstSymbolArray,
+  //! Symbol is a read-only table of values interpolated between knots, see \ref Context::add_table().
+  kAstSymbolTable,
+  //! Symbol is an inline function spliced into callers, see \ref Context::add_inline_function().
+  kAstSymbolInline
 };
 
 // MathPresso - AstSymbolFlags
@@ -83,7 +89,10 @@ enum AstSymbolFlags {
   //!
   //! Currently only useful for global variables so the JIT compiler can
   //! perform write operation at the end of the generated function.
-  kAstSymbolIsAltered = 0x0010
+  kAstSymbolIsAltered = 0x0010,
+
+  //! The function has no side effects, see \ref kFunctionNoSideEffects.
+  kAstSymbolIsPure = 0x0020
 };
 
 // MathPresso - AstNodeType
@@ -113,6 +122,8 @@ enum AstNodeType {
   kAstNodeVar,
   //! Node is `AstImm`.
   kAstNodeImm,
+  //! Node is `AstIndex`.
+  kAstNodeIndex,
 
   // Operator & Call
   // ---------------
@@ -122,7 +133,13 @@ enum AstNodeType {
   //! Node is `AstBinaryOp`.
   kAstNodeBinaryOp,
   //! Node is `AstCall`.
-  kAstNodeCall
+  kAstNodeCall,
+
+  // Control Flow
+  // ------------
+
+  //! Node is `AstRepeat`.
+  kAstNodeRepeat
 };
 
 // MathPresso - AstNodeFlags
@@ -132,7 +149,14 @@ enum AstNodeType {
 //!
 //! `AstNode` flags.
 enum AstNodeFlags {
-  kAstNodeHasSideEffect = 0x01
+  kAstNodeHasSideEffect = 0x01,
+
+  //! The node only depends on immediates and variables that don't change between rows of an array evaluation (set
+  //! by `AstOptimizer`), so it can be computed once before the loop over rows.
+  kAstNodeIsUniform = 0x02,
+
+  //! The value of the node depends on a variable, so its derivative may be non-zero (set by the gradient compiler).
+  kAstNodeIsActive = 0x04
 };
 
 // MathPresso - AstBuilder
@@ -200,6 +224,11 @@ struct AstBuilder {
 #undef MATHPRESSO_ALLOC_AST_OBJECT
 
   void delete_node(AstNode* node);
+  //! Create a deep copy of `node` (except `AstProgram`), which references the same symbols.
+  //!
+  //! If `args` is not null each variable is replaced by a copy of `args[slot_id]` of its symbol, which is used to
+  //! splice the body of an inline function into its caller.
+  AstNode* clone_node(AstNode* node, AstNode* const* args = nullptr);
 
   MATHPRESSO_INLINE uint32_t new_slot_id() { return _num_slots++; }
 
@@ -249,14 +278,29 @@ struct AstSymbol : public HashNode {
       uint32_t _var_slot_id;
       //! Variable offset in data structure (in case the symbol is a global variable).
       int32_t _var_offset;
+      //! Index of the base pointer `_var_offset` is relative to (in case the symbol is a global variable).
+      uint32_t _var_base;
       //! The current value of the symbol (in case the symbol is an immediate).
       double _value;
+      //! Number of elements (in case the symbol is an array).
+      uint32_t _array_length;
+      //! Distance between elements in bytes (in case the symbol is an array).
+      uint32_t _array_stride;
+      //! Offset of knots (in case the symbol is a table having non-uniform knots).
+      int32_t _table_knots;
+      //! Table flags, see \ref TableFlags (in case the symbol is a table).
+      uint32_t _table_flags;
+      //! Position of the first knot (in case the symbol is a table having uniform knots).
+      double _table_x0;
+      //! Number of knots per unit (in case the symbol is a table having uniform knots).
+      double _table_scale;
     };
 
     struct {
-      //! Function pointer (in case the symbol is a function).
+      //! Function pointer (in case the symbol is a function) or the scope of parameters (in case the symbol is an
+      //! inline function, its body is the node of the symbol).
       void* _func_ptr;
-      //! Number of function arguments (in case the symbol is a function).
+      //! Number of function arguments (in case the symbol is a function or an inline function).
       uint32_t _func_args;
     };
   };
@@ -336,6 +380,27 @@ struct AstSymbol : public HashNode {
   MATHPRESSO_INLINE int32_t var_offset() const { return _var_offset; }
   MATHPRESSO_INLINE void set_var_offset(int32_t offset) { _var_offset = offset; }
 
+  MATHPRESSO_INLINE uint32_t var_base() const { return _var_base; }
+  MATHPRESSO_INLINE void set_var_base(uint32_t base) { _var_base = base; }
+
+  MATHPRESSO_INLINE uint32_t array_length() const { return _array_length; }
+  MATHPRESSO_INLINE void set_array_length(uint32_t length) { _array_length = length; }
+
+  MATHPRESSO_INLINE uint32_t array_stride() const { return _array_stride; }
+  MATHPRESSO_INLINE void set_array_stride(uint32_t stride) { _array_stride = stride; }
+
+  MATHPRESSO_INLINE int32_t table_knots() const { return _table_knots; }
+  MATHPRESSO_INLINE void set_table_knots(int32_t offset) { _table_knots = offset; }
+
+  MATHPRESSO_INLINE uint32_t table_flags() const { return _table_flags; }
+  MATHPRESSO_INLINE void set_table_flags(uint32_t flags) { _table_flags = flags; }
+
+  MATHPRESSO_INLINE double table_x0() const { return _table_x0; }
+  MATHPRESSO_INLINE void set_table_x0(double x0) { _table_x0 = x0; }
+
+  MATHPRESSO_INLINE double table_scale() const { return _table_scale; }
+  MATHPRESSO_INLINE void set_table_scale(double scale) { _table_scale = scale; }
+
   MATHPRESSO_INLINE void* func_ptr() const { return _func_ptr; }
   MATHPRESSO_INLINE void set_func_ptr(void* ptr) { _func_ptr = ptr; }
 
@@ -752,9 +817,12 @@ struct AstVarDecl : public AstUnary {
     : AstUnary(ast, kAstNodeVarDecl),
       _symbol(nullptr) {}
 
+  // A declaration is only counted as a use (and a write) of its symbol if it has an initializer.
   MATHPRESSO_INLINE void destroy(AstBuilder*) {
-    if (symbol())
+    if (symbol() && child()) {
       symbol()->decrement_used_count();
+      symbol()->decrement_write_count();
+    }
   }
 
   // Accessors
@@ -814,6 +882,33 @@ struct AstImm : public AstNode {
   MATHPRESSO_INLINE void set_value(double value) { _value = value; }
 };
 
+// MathPresso - AstIndex
+// ======================
+
+//! Element of an array - `array[index]`, or a value interpolated from a table - `table(x)`. The index of an array
+//! is truncated and clamped to the array, NaN selects the first element.
+struct AstIndex : public AstUnary {
+  MATHPRESSO_NONCOPYABLE(AstIndex)
+
+  // Members
+  // -------
+
+  AstSymbol* _symbol;
+
+  // Construction & Destruction
+  // --------------------------
+
+  MATHPRESSO_INLINE AstIndex(AstBuilder* ast)
+    : AstUnary(ast, kAstNodeIndex),
+      _symbol(nullptr) {}
+
+  // Accessors
+  // ---------
+
+  MATHPRESSO_INLINE AstSymbol* symbol() const { return _symbol; }
+  MATHPRESSO_INLINE void set_symbol(AstSymbol* symbol) { _symbol = symbol; }
+};
+
 // MathPresso - AstUnaryOp
 // =======================
 
@@ -873,6 +968,35 @@ struct AstCall : public AstBlock {
   MATHPRESSO_INLINE void set_symbol(AstSymbol* symbol) { _symbol = symbol; }
 };
 
+// MathPresso - AstRepeat
+// =======================
+
+//! Bounded loop - `repeat (count) body` evaluates `body` `count` times (truncated and clamped to `kMaxRepeatCount`,
+//! NaN or a negative count means no iteration). The value of the loop is the value of the body in the last iteration
+//! (NaN if there was none).
+struct AstRepeat : public AstNode {
+  MATHPRESSO_NONCOPYABLE(AstRepeat)
+
+  // Members
+  // -------
+
+  MATHPRESSO_AST_CHILD(0, AstNode, count);
+  MATHPRESSO_AST_CHILD(1, AstBlock, body);
+
+  // Construction & Destruction
+  // --------------------------
+
+  MATHPRESSO_INLINE AstRepeat(AstBuilder* ast)
+    : AstNode(ast, kAstNodeRepeat, &_count, 2),
+      _count(nullptr),
+      _body(nullptr) {}
+
+  // Accessors
+  // ---------
+
+  MATHPRESSO_INLINE AstNode** children() const { return (AstNode**)&_count; }
+};
+
 // MathPresso - AstVisitor
 // =======================
 
@@ -905,9 +1029,11 @@ struct AstVisitor {
   virtual Error on_var_decl(AstVarDecl* node) = 0;
   virtual Error on_var(AstVar* node) = 0;
   virtual Error on_imm(AstImm* node) = 0;
+  virtual Error on_index(AstIndex* node) = 0;
   virtual Error on_unary_op(AstUnaryOp* node) = 0;
   virtual Error on_binary_op(AstBinaryOp* node) = 0;
   virtual Error on_invoke(AstCall* node) = 0;
+  virtual Error on_repeat(AstRepeat* node) = 0;
 };
 
 // MathPresso - AstDump
@@ -935,9 +1061,11 @@ struct AstDump : public AstVisitor {
   virtual Error on_var_decl(AstVarDecl* node);
   virtual Error on_var(AstVar* node);
   virtual Error on_imm(AstImm* node);
+  virtual Error on_index(AstIndex* node);
   virtual Error on_unary_op(AstUnaryOp* node);
   virtual Error on_binary_op(AstBinaryOp* node);
   virtual Error on_invoke(AstCall* node);
+  virtual Error on_repeat(AstRepeat* node);
 
   // Helpers
   // -------
@@ -11,8 +11,10 @@
 #include "./mpast_p.h"
 #include "./mpcompiler_p.h"
 #include "./mpeval_p.h"
+#include "./mpinterval_p.h"
 
 #include <asmjit/ujit.h>
+#include <stddef.h>
 
 namespace mathpresso {
 
@@ -142,46 +144,218 @@ struct MATHPRESSO_NOAPI JitVar {
   uint32_t _flags;
 };
 
+// MathPresso - JIT Tape
+// =====================
+
+//! Value of a node computed by a `kJitFuncGradient` function and its adjoint (the partial derivative of the result
+//! with respect to the value), which is computed by the reverse sweep, see `JitCompiler::compile_gradient()`.
+struct MATHPRESSO_NOAPI JitTapeEntry {
+  AstNode* node;
+  JitVar value;
+  JitVar adjoint;
+  //! Index of the previous entry of the same node or `kJitTapeNone`, see `JitCompiler::find_tape_entry()`.
+  uint32_t prev;
+};
+
+//! No tape entry.
+static constexpr uint32_t kJitTapeNone = 0xFFFFFFFFu;
+
+// MathPresso - JIT ODE Methods
+// =============================
+
+//! Butcher tableau of an explicit Runge-Kutta method used by `kJitFuncOde` functions.
+struct JitOdeTableau {
+  //! Number of stages.
+  uint32_t stages;
+  //! Times of stages relative to the step.
+  double c[7];
+  //! Weights of previous stages used by each stage (the row `s` is used by the stage `s`).
+  double a[7][7];
+  //! Weights of the solution.
+  double b[7];
+  //! Weights of the error estimate (the solution minus the embedded solution), only used by adaptive methods.
+  double e[7];
+  //! Whether the method has an embedded solution to adapt the step.
+  bool adaptive;
+};
+
+static const JitOdeTableau jit_ode_rk4 = {
+  4,
+  { 0.0, 0.5, 0.5, 1.0 },
+  {
+    { 0.0 },
+    { 0.5 },
+    { 0.0, 0.5 },
+    { 0.0, 0.0, 1.0 }
+  },
+  { 1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0 },
+  { 0.0 },
+  false
+};
+
+static const JitOdeTableau jit_ode_dopri5 = {
+  7,
+  { 0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0, 1.0 },
+  {
+    { 0.0 },
+    { 1.0 / 5.0 },
+    { 3.0 / 40.0, 9.0 / 40.0 },
+    { 44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0 },
+    { 19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0 },
+    { 9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0 },
+    { 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0 }
+  },
+  { 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0, 0.0 },
+  { 71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0, -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0 },
+  true
+};
+
 // MathPresso - JIT Compiler
 // =========================
 
 struct MATHPRESSO_NOAPI JitCompiler {
   Arena& arena;
   ujit::UniCompiler uc;
+  uint32_t func_type;
+  uint32_t options;
+  const JitGradient* gradient;
+  const JitOde* ode;
+  //! Counters of comparisons, only used by `kJitFuncProfile` functions.
+  JitConditions* conditions;
 
   ujit::Gp var_ptr;
   ujit::Gp result_ptr;
+  ujit::Gp bases_ptr;
+  ujit::Gp base_regs[_kVariableBaseCount];
+
+  // Only used by functions that loop over rows.
+  ujit::Gp stride;
+  ujit::Gp count;
+
+  // Only used by `kJitFuncGather` - `var_ptr` is calculated from `data_ptr` and an index of each row.
+  ujit::Gp data_ptr;
+  ujit::Gp indices_ptr;
+
+  // Only used by `kJitFuncReduce`, see `ReduceState`.
+  ujit::Vec acc[kReduceStateSize];
+
+  // Only used by `kJitFuncBitmap`.
+  ujit::Gp bitmap_word;
+
+  //! Values of nodes in evaluation order, only recorded by `kJitFuncGradient` functions.
+  JitTapeEntry* tape = nullptr;
+  uint32_t tape_size = 0;
+  uint32_t tape_capacity = 0;
+  //! Open addressing table that maps a node to its last tape entry (`kJitTapeNone` marks an empty bucket).
+  uint32_t* tape_table = nullptr;
+  uint32_t tape_table_mask = 0;
+  //! Adjoints of variables (indexed by slot) during the reverse sweep.
+  JitVar* var_adjoints = nullptr;
+
+  //! Uniform nodes computed before the loop over rows and their results.
+  AstNode** hoisted_nodes = nullptr;
+  JitVar* hoisted_vars = nullptr;
+  uint32_t hoisted_count = 0;
+
+#if defined(ASMJIT_UJIT_X86)
+  x86::Mem fp_control_saved;
+#elif defined(ASMJIT_UJIT_AARCH64)
+  ujit::Gp fp_control_saved;
+#endif
+  bool fp_control_changed = false;
 
   JitVar* var_slots = nullptr;
+  uint32_t num_slots = 0;
   BaseNode* func_body = nullptr;
   ConstPoolNode* const_pool = nullptr;
 
-  JitCompiler(Arena& arena, ujit::BackendCompiler& cc, const CpuFeatures& cpu_features, CpuHints cpu_hints);
+  JitCompiler(Arena& arena, ujit::BackendCompiler& cc, const CpuFeatures& cpu_features, CpuHints cpu_hints, uint32_t func_type, uint32_t options, const JitGradient* gradient, const JitOde* ode, JitConditions* conditions);
   ~JitCompiler();
 
+  //! Get whether the function evaluates rows in a loop (all functions except scalar, gradient, interval, ODE, and
+  //! profile).
+  inline bool is_loop() const {
+    return func_type != kJitFuncScalar && func_type != kJitFuncGradient && func_type != kJitFuncInterval && func_type != kJitFuncOde && func_type != kJitFuncProfile;
+  }
+  //! Get whether values are intervals - `[lo, hi]` pairs held by both lanes of a register.
+  inline bool is_interval() const { return func_type == kJitFuncInterval; }
+
   // Function Generator.
   void begin_function();
   void end_function();
 
+  // Floating Point Environment.
+  void enter_fp_control(uint32_t x86_bits, uint32_t a64_bits);
+  void leave_fp_control();
+
   // Variable Management.
+  ujit::Gp base_ptr(uint32_t base);
+  void move_var(const ujit::Vec& dst, const JitVar& other);
   JitVar copy_var(const JitVar& other, uint32_t flags);
   JitVar writable_var(const JitVar& other);
   JitVar register_var(const JitVar& other);
 
   // Compiler.
   void compile(AstBlock* node, AstScope* root_scope, uint32_t num_slots);
+  ujit::Vec compile_body(AstBlock* node, AstScope* root_scope);
+  void store_altered(AstScope* root_scope);
+  void compile_loop(AstBlock* node, AstScope* root_scope);
+  void reduce_value(const ujit::Vec& value);
+  void predicate_to_bit(const ujit::Gp& dst, const ujit::Vec& value);
+  void store_result_nt(const ujit::Vec& value);
+
+  // Uniform Hoisting.
+  uint32_t count_hoistable(AstNode* node);
+  void hoist_uniform(AstNode* node);
+  const JitVar* find_hoisted(AstNode* node) const;
 
   JitVar on_node(AstNode* node);
   JitVar on_block(AstBlock* node);
   JitVar on_var_decl(AstVarDecl* node);
   JitVar on_var(AstVar* node);
   JitVar on_imm(AstImm* node);
+  JitVar on_index(AstIndex* node);
+  JitVar on_table(AstSymbol* sym, const ujit::Vec& x);
   JitVar on_unary_op(AstUnaryOp* node);
   JitVar on_binary_op(AstBinaryOp* node);
+  ujit::Vec condition_mask(AstNode* node);
+  void count_condition(AstNode* node, const ujit::Vec& truth);
   JitVar on_invoke(AstCall* node);
+  JitVar on_repeat(AstRepeat* node);
+  JitVar symbol_var(AstSymbol* sym);
+
+  // Loops.
+  uint32_t collect_carried(AstBlock* body, AstSymbol** carried, AstSymbol** declared);
+  void collect_vars(AstNode* node, AstSymbol** assigned, uint32_t& assigned_count, AstSymbol** declared, uint32_t& declared_count);
+  void clamp_to_index(const ujit::Gp& dst, const ujit::Vec& value, uint32_t max);
+  void element_ptr(const ujit::Gp& dst, const ujit::Vec& index, uint32_t max, uint32_t stride, const ujit::Gp& base);
+  void clamp_f64(const ujit::Vec& v, double lo, double hi);
+
+  // Automatic Differentiation.
+  void compile_gradient(AstBlock* node, AstScope* root_scope);
+  uint32_t count_nodes(AstNode* node);
+  bool mark_active(AstNode* node);
+  bool is_active(AstNode* node);
+  uint32_t* tape_bucket(AstNode* node);
+  void record_tape_entry(AstNode* node, const JitVar& value);
+  JitTapeEntry* find_tape_entry(AstNode* node, uint32_t end);
+  void accumulate(JitVar& dst, const JitVar& value);
+  void add_adjoint(AstNode* node, uint32_t end, const JitVar& adjoint, const JitVar& scale);
+  void backprop(uint32_t index);
+  void backprop_unary_op(AstUnaryOp* node, uint32_t index);
+  void backprop_binary_op(AstBinaryOp* node, uint32_t index);
+  void unknown_adjoints(AstNode* node);
+
+  // ODE Integration.
+  void compile_ode(AstBlock* node, AstScope* root_scope);
+  void compile_ode_stages(AstBlock* node, AstScope* root_scope, const JitOdeTableau& tableau, const ujit::Vec& t, const ujit::Vec& h, const JitVar* y, JitVar* stage_y, JitVar* k);
+  void ode_weighted_sum(const ujit::Vec& dst, const ujit::Vec& h, const double* weights, const JitVar* k, uint32_t stages, uint32_t index);
+  ujit::Mem ode_state_mem(uint32_t index);
 
   // Helpers.
   void inline_invoke(const ujit::Vec& dst, const ujit::Vec* args, uint32_t count, void* fn);
+  void interval_invoke(const ujit::Vec& dst, const ujit::Vec* args, uint32_t count, void* fn);
+  void select_f64(const ujit::Vec& dst, const ujit::Vec& mask, const ujit::Vec& a, const ujit::Vec& b);
 
   // Constants.
   void prepare_const_pool();
@@ -191,47 +365,155 @@ struct MATHPRESSO_NOAPI JitCompiler {
   JitVar get_constant_f64(double value);
   JitVar get_constant_f64_as_f64x2(double value);
   JitVar get_constant_f64_aligned(double value);
+  JitVar get_constant_interval(double lo, double hi);
 };
 
-JitCompiler::JitCompiler(Arena& arena, ujit::BackendCompiler& cc, const CpuFeatures& cpu_features, CpuHints cpu_hints)
+JitCompiler::JitCompiler(Arena& arena, ujit::BackendCompiler& cc, const CpuFeatures& cpu_features, CpuHints cpu_hints, uint32_t func_type, uint32_t options, const JitGradient* gradient, const JitOde* ode, JitConditions* conditions)
   : arena(arena),
     uc(&cc, cpu_features, cpu_hints),
+    func_type(func_type),
+    options(options),
+    gradient(gradient),
+    ode(ode),
+    conditions(conditions),
     var_slots(nullptr),
     func_body(nullptr) {}
 
 JitCompiler::~JitCompiler() {}
 
 void JitCompiler::begin_function() {
-  FuncNode* func_node = uc.add_func(FuncSignature::build<void, double*, double*>(CallConvId::kCDecl));
+  FuncNode* func_node;
+
+  if (func_type == kJitFuncGather)
+    func_node = uc.add_func(FuncSignature::build<void, double*, double*, void**, size_t, size_t, const uint32_t*>(CallConvId::kCDecl));
+  else if (is_loop())
+    func_node = uc.add_func(FuncSignature::build<void, double*, double*, void**, size_t, size_t>(CallConvId::kCDecl));
+  else
+    func_node = uc.add_func(FuncSignature::build<void, double*, double*, void**>(CallConvId::kCDecl));
 
   var_ptr = uc.new_gpz("var_ptr");
   result_ptr = uc.new_gpz("result_ptr");
+  bases_ptr = uc.new_gpz("bases_ptr");
 
   func_node->set_arg(0, result_ptr);
-  func_node->set_arg(1, var_ptr);
+  func_node->set_arg(2, bases_ptr);
+
+  if (func_type == kJitFuncGather) {
+    data_ptr = uc.new_gpz("data_ptr");
+    indices_ptr = uc.new_gpz("indices_ptr");
+
+    func_node->set_arg(1, data_ptr);
+    func_node->set_arg(5, indices_ptr);
+  }
+  else {
+    func_node->set_arg(1, var_ptr);
+  }
+
+  if (is_loop()) {
+    stride = uc.new_gpz("stride");
+    count = uc.new_gpz("count");
+
+    func_node->set_arg(3, stride);
+    func_node->set_arg(4, count);
+  }
+
   func_body = uc.cc->cursor();
+
+  if (options & kOptionFlushDenormals) {
+    // MXCSR.FTZ | MXCSR.DAZ and FPCR.FZ.
+    enter_fp_control(0x8040u, 0x01000000u);
+  }
 }
 
 void JitCompiler::end_function() {
+  leave_fp_control();
   uc.end_func();
   if (const_pool) {
     uc.cc->add_node(const_pool);
   }
 }
 
-JitVar JitCompiler::copy_var(const JitVar& other, uint32_t flags) {
-  JitVar v(uc.new_vec128_f64x1(), flags);
+// Saves the floating point control register of the caller and sets the given bits. The saved value is restored by
+// `leave_fp_control()`, which is called by `end_function()`, so the caller's environment is never changed.
+void JitCompiler::enter_fp_control(uint32_t x86_bits, uint32_t a64_bits) {
+  MATHPRESSO_ASSERT(!fp_control_changed);
+  fp_control_changed = true;
+
+#if defined(ASMJIT_UJIT_X86)
+  Support::maybe_unused(a64_bits);
+
+  x86::Gp tmp = uc.new_gp32("fp_control");
+  x86::Mem fp_control_new = uc.cc->new_stack(4, 4, "fp_control_new");
+
+  fp_control_saved = uc.cc->new_stack(4, 4, "fp_control_saved");
+  uc.cc->stmxcsr(fp_control_saved);
+  uc.cc->mov(tmp, fp_control_saved);
+  uc.cc->or_(tmp, x86_bits);
+  uc.cc->mov(fp_control_new, tmp);
+  uc.cc->ldmxcsr(fp_control_new);
+#elif defined(ASMJIT_UJIT_AARCH64)
+  Support::maybe_unused(x86_bits);
+
+  a64::Gp tmp = uc.new_gp64("fp_control");
+
+  fp_control_saved = uc.new_gp64("fp_control_saved");
+  uc.cc->mrs(fp_control_saved, Imm(a64::Predicate::SysReg::kFPCR));
+  uc.cc->orr(tmp, fp_control_saved, Imm(a64_bits));
+  uc.cc->msr(Imm(a64::Predicate::SysReg::kFPCR), tmp);
+#else
+  Support::maybe_unused(x86_bits, a64_bits);
+#endif
+}
+
+void JitCompiler::leave_fp_control() {
+  if (!fp_control_changed)
+    return;
+
+#if defined(ASMJIT_UJIT_X86)
+  uc.cc->ldmxcsr(fp_control_saved);
+#elif defined(ASMJIT_UJIT_AARCH64)
+  uc.cc->msr(Imm(a64::Predicate::SysReg::kFPCR), fp_control_saved);
+#endif
+
+  fp_control_changed = false;
+}
+
+// Returns a register holding the base pointer `base`. Base pointers other than `var_ptr` are loaded from `bases_ptr`
+// at the beginning of the function when first used, so the `bases` array is only read if the function uses them.
+ujit::Gp JitCompiler::base_ptr(uint32_t base) {
+  if (base == 0)
+    return var_ptr;
+
+  MATHPRESSO_ASSERT(base < _kVariableBaseCount);
+  if (!base_regs[base].is_valid()) {
+    base_regs[base] = uc.new_gpz("base_ptr");
+
+    BaseNode* prev_node = uc.cc->set_cursor(func_body);
+    uc.load(base_regs[base], ujit::mem_ptr(bases_ptr, static_cast<int32_t>(base * sizeof(void*))));
+    uc.cc->set_cursor(prev_node);
+  }
+
+  return base_regs[base];
+}
 
+void JitCompiler::move_var(const ujit::Vec& dst, const JitVar& other) {
   if (other.is_vec()) {
-    uc.v_mov(v.vec(), other.vec());
+    uc.v_mov(dst, other.vec());
   }
   else if (other.is_mem()) {
-    uc.v_loadu64_f64(v.vec(), other.mem());
+    if (is_interval())
+      uc.v_loadu128_f64(dst, other.mem());
+    else
+      uc.v_loadu64_f64(dst, other.mem());
   }
   else {
     MATHPRESSO_ASSERT_NOT_REACHED();
   }
+}
 
+JitVar JitCompiler::copy_var(const JitVar& other, uint32_t flags) {
+  JitVar v(is_interval() ? uc.new_vec128_f64x2("interval") : uc.new_vec128_f64x1(), flags);
+  move_var(v.vec(), other);
   return v;
 }
 
@@ -250,6 +532,8 @@ JitVar JitCompiler::register_var(const JitVar& other) {
 }
 
 void JitCompiler::compile(AstBlock* node, AstScope* root_scope, uint32_t num_slots) {
+  this->num_slots = num_slots;
+
   if (num_slots != 0) {
     var_slots = static_cast<JitVar*>(arena.alloc_reusable(Arena::aligned_size(sizeof(JitVar) * num_slots)));
     if (var_slots == nullptr) {
@@ -261,50 +545,327 @@ void JitCompiler::compile(AstBlock* node, AstScope* root_scope, uint32_t num_slo
     }
   }
 
-  // Result of the function or NaN.
+  if (func_type == kJitFuncGradient)
+    compile_gradient(node, root_scope);
+  else if (func_type == kJitFuncOde)
+    compile_ode(node, root_scope);
+  else if (is_loop())
+    compile_loop(node, root_scope);
+  else if (is_interval())
+    uc.v_storeu128_f64(ujit::mem_ptr(result_ptr), compile_body(node, root_scope));
+  else
+    uc.v_storeu64_f64(ujit::mem_ptr(result_ptr), compile_body(node, root_scope));
+
+  if (num_slots != 0) {
+    arena.free_reusable(var_slots, sizeof(JitVar) * num_slots);
+  }
+}
+
+// Compiles the program and stores altered global variables, returns the result of the program (or NaN).
+ujit::Vec JitCompiler::compile_body(AstBlock* node, AstScope* root_scope) {
   JitVar result = on_block(node);
+  store_altered(root_scope);
 
-  // Write altered global variables.
-  {
-    AstSymbolHashIterator it(root_scope->symbols());
-    while (it.has()) {
-      AstSymbol* sym = it.get();
-      if (sym->is_global() && sym->is_altered()) {
-        JitVar v = var_slots[sym->var_slot_id()];
-        uc.v_storeu64_f64(ujit::mem_ptr(var_ptr, sym->var_offset()), register_var(v).vec());
-      }
+  // Return NaN (an empty interval) if no result is given.
+  if (result.is_none())
+    return register_var(is_interval() ? get_constant_f64_aligned(mp_get_nan()) : get_constant_f64(mp_get_nan())).vec();
+  else
+    return register_var(result).vec();
+}
+
+// Writes altered global variables.
+void JitCompiler::store_altered(AstScope* root_scope) {
+  AstSymbolHashIterator it(root_scope->symbols());
+  while (it.has()) {
+    AstSymbol* sym = it.get();
+    if (sym->is_global() && sym->is_altered()) {
+      JitVar v = var_slots[sym->var_slot_id()];
+      if (is_interval())
+        uc.v_storeu128_f64(ujit::mem_ptr(base_ptr(sym->var_base()), sym->var_offset() * 2), register_var(v).vec());
+      else
+        uc.v_storeu64_f64(ujit::mem_ptr(base_ptr(sym->var_base()), sym->var_offset()), register_var(v).vec());
+    }
 
-      it.next();
+    it.next();
+  }
+}
+
+// Compiles a loop that evaluates the program for each row. Uniform subexpressions are computed once before the
+// loop, everything else is computed per row - global variables are read from memory each iteration, so writes to
+// variables of other bases than 0 are visible to the next row, like when the scalar function is called per row.
+//
+// Results are either stored (`kJitFuncArray`), accumulated in registers (`kJitFuncReduce`), which are loaded
+// from and stored to `result_ptr` outside of the loop, or shifted into a 64-bit word (`kJitFuncBitmap`), which
+// is stored each 64 rows.
+void JitCompiler::compile_loop(AstBlock* node, AstScope* root_scope) {
+  Label L_Loop = uc.new_label();
+  Label L_Done = uc.new_label();
+
+  hoisted_count = count_hoistable(node);
+  if (hoisted_count) {
+    hoisted_nodes = static_cast<AstNode**>(arena.alloc_reusable(Arena::aligned_size(sizeof(AstNode*) * hoisted_count)));
+    hoisted_vars = static_cast<JitVar*>(arena.alloc_reusable(Arena::aligned_size(sizeof(JitVar) * hoisted_count)));
+
+    if (!hoisted_nodes || !hoisted_vars) {
+      if (hoisted_nodes) arena.free_reusable(hoisted_nodes, sizeof(AstNode*) * hoisted_count);
+      if (hoisted_vars) arena.free_reusable(hoisted_vars, sizeof(JitVar) * hoisted_count);
+
+      hoisted_nodes = nullptr;
+      hoisted_vars = nullptr;
+      hoisted_count = 0;
+    }
+    else {
+      uint32_t n = hoisted_count;
+      hoisted_count = 0;
+
+      hoist_uniform(node);
+      MATHPRESSO_ASSERT(hoisted_count == n);
     }
   }
 
-  // Return NaN if no result is given.
-  ujit::Vec var;
-  if (result.is_none())
-    var = register_var(get_constant_f64(mp_get_nan())).vec();
+  if (func_type == kJitFuncReduce) {
+    for (uint32_t i = 0; i < kReduceStateSize; i++) {
+      acc[i] = uc.new_vec128_f64x1();
+      uc.v_loadu64_f64(acc[i], ujit::mem_ptr(result_ptr, int32_t(i * sizeof(double))));
+    }
+  }
+
+  if (func_type == kJitFuncBitmap) {
+    bitmap_word = uc.new_gp64("bitmap_word");
+    uc.mov(bitmap_word, Imm(0));
+  }
+
+  uc.j(L_Done, ujit::test_z(count));
+  uc.bind(L_Loop);
+
+  if (func_type == kJitFuncGather) {
+    ujit::Gp offset = uc.new_gpz("offset");
+
+    uc.load_u32(offset, ujit::mem_ptr(indices_ptr));
+    uc.mul(offset, offset, stride);
+    uc.add(var_ptr, data_ptr, offset);
+    uc.add(indices_ptr, indices_ptr, Imm(int(sizeof(uint32_t))));
+  }
+
+  if (func_type == kJitFuncReduce) {
+    reduce_value(compile_body(node, root_scope));
+  }
+  else if (func_type == kJitFuncBitmap) {
+    Label L_Next = uc.new_label();
+    ujit::Gp bit = uc.new_gp64("bit");
+
+    // The bit of each row is inserted at the top of the word, after 64 rows the first row is at bit 0.
+    predicate_to_bit(bit, compile_body(node, root_scope));
+    uc.shr(bitmap_word, bitmap_word, Imm(1));
+    uc.or_(bitmap_word, bitmap_word, bit);
+    uc.add(var_ptr, var_ptr, stride);
+    uc.sub(count, count, Imm(1));
+
+    uc.j(L_Next, ujit::test_nz(count, Imm(63)));
+    uc.store(ujit::mem_ptr(result_ptr), bitmap_word);
+    uc.add(result_ptr, result_ptr, Imm(int(sizeof(uint64_t))));
+    uc.bind(L_Next);
+  }
+  else if (func_type == kJitFuncArrayStream) {
+    store_result_nt(compile_body(node, root_scope));
+    uc.add(result_ptr, result_ptr, Imm(int(sizeof(double))));
+  }
+  else {
+    uc.v_storeu64_f64(ujit::mem_ptr(result_ptr), compile_body(node, root_scope));
+    uc.add(result_ptr, result_ptr, Imm(int(sizeof(double))));
+  }
+
+  if (func_type == kJitFuncBitmap) {
+    uc.j(L_Loop, ujit::test_nz(count));
+  }
+  else {
+    if (func_type != kJitFuncGather)
+      uc.add(var_ptr, var_ptr, stride);
+    uc.j(L_Loop, ujit::sub_nz(count, Imm(1)));
+  }
+  uc.bind(L_Done);
+
+#if defined(ASMJIT_UJIT_X86)
+  // Non-temporal stores are weakly ordered, make them visible before returning.
+  if (func_type == kJitFuncArrayStream)
+    uc.cc->sfence();
+#endif
+
+  if (func_type == kJitFuncReduce) {
+    for (uint32_t i = 0; i < kReduceStateSize; i++) {
+      uc.v_storeu64_f64(ujit::mem_ptr(result_ptr, int32_t(i * sizeof(double))), acc[i]);
+    }
+  }
+
+  if (hoisted_nodes) {
+    arena.free_reusable(hoisted_nodes, sizeof(AstNode*) * hoisted_count);
+    arena.free_reusable(hoisted_vars, sizeof(JitVar) * hoisted_count);
+
+    hoisted_nodes = nullptr;
+    hoisted_vars = nullptr;
+    hoisted_count = 0;
+  }
+}
+
+// Accumulates a single result into `acc` registers. NaN results are skipped by masking them - the sum and count are
+// incremented by zero and min/max get INF/-INF, which keeps the code branch-free.
+void JitCompiler::reduce_value(const ujit::Vec& value) {
+  ujit::Vec mask = uc.new_vec128_f64x1();
+  ujit::Vec val = uc.new_vec128_f64x1();
+  ujit::Vec tmp = uc.new_vec128_f64x1();
+
+  uc.s_cmp_eq_f64(mask, value, value);
+  uc.v_and_f64(val, mask, value);
+
+  uc.v_and_f64(tmp, mask, get_constant_f64_as_f64x2(1.0).op());
+  uc.s_add_f64(acc[kReduceCount], acc[kReduceCount], tmp);
+
+  if (options & kOptionKahanSum) {
+    // y = val - comp; t = sum + y; comp = (t - sum) - y; sum = t. The compensation is cleared if `t` is not finite
+    // (`t - t` is NaN), otherwise it would be NaN (INF - INF) and it would turn the sum into NaN.
+    ujit::Vec y = uc.new_vec128_f64x1();
+    ujit::Vec finite = uc.new_vec128_f64x1();
+
+    uc.s_sub_f64(y, val, acc[kReduceSumComp]);
+    uc.s_add_f64(tmp, acc[kReduceSum], y);
+    uc.s_sub_f64(acc[kReduceSumComp], tmp, acc[kReduceSum]);
+    uc.s_sub_f64(acc[kReduceSumComp], acc[kReduceSumComp], y);
+    uc.s_sub_f64(finite, tmp, tmp);
+    uc.s_cmp_eq_f64(finite, finite, finite);
+    uc.v_and_f64(acc[kReduceSumComp], finite, acc[kReduceSumComp]);
+    uc.v_mov(acc[kReduceSum], tmp);
+  }
+  else {
+    uc.s_add_f64(acc[kReduceSum], acc[kReduceSum], val);
+  }
+
+  uc.v_andn_f64(tmp, mask, get_constant_f64_as_f64x2(mp_get_inf()).op());
+  uc.v_or_f64(tmp, tmp, val);
+  uc.s_min_f64(acc[kReduceMin], acc[kReduceMin], tmp);
+
+  uc.v_andn_f64(tmp, mask, get_constant_f64_as_f64x2(-mp_get_inf()).op());
+  uc.v_or_f64(tmp, tmp, val);
+  uc.s_max_f64(acc[kReduceMax], acc[kReduceMax], tmp);
+}
+
+// Sets bit 63 of `dst` if `value` is non-zero and not NaN, all other bits are cleared.
+void JitCompiler::predicate_to_bit(const ujit::Gp& dst, const ujit::Vec& value) {
+  ujit::Vec is_zero = uc.new_vec128_f64x1();
+  ujit::Vec mask = uc.new_vec128_f64x1();
+
+  uc.s_cmp_eq_f64(is_zero, value, get_constant_f64(0.0).op());
+  uc.s_cmp_eq_f64(mask, value, value);
+  uc.v_andn_f64(mask, is_zero, mask);
+
+  // Move the low lane of the mask to `dst` - only bit 0 (X86) or all bits (AArch64) are relevant, the shift drops
+  // the rest.
+#if defined(ASMJIT_UJIT_X86)
+  if (uc.has_avx())
+    uc.cc->vmovmskpd(dst.r32(), mask);
   else
-    var = register_var(result).vec();
-  uc.v_storeu64_f64(ujit::mem_ptr(result_ptr), var);
+    uc.cc->movmskpd(dst.r32(), mask);
+#elif defined(ASMJIT_UJIT_AARCH64)
+  uc.cc->fmov(dst, mask.d());
+#endif
 
-  if (num_slots != 0) {
-    arena.free_reusable(var_slots, sizeof(JitVar) * num_slots);
+  uc.shl(dst, dst, Imm(63));
+}
+
+// Stores `value` to `result_ptr` by using a non-temporal store. X86 only provides a scalar non-temporal store of a
+// general purpose register (MOVNTI), which doesn't require an alignment, so there is no need to peel the head. Other
+// targets (and 32-bit X86) use a regular store.
+void JitCompiler::store_result_nt(const ujit::Vec& value) {
+#if defined(ASMJIT_UJIT_X86)
+  if (uc.cc->is_64bit()) {
+    x86::Gp tmp = uc.new_gp64("tmp");
+
+    if (uc.has_avx())
+      uc.cc->vmovq(tmp, value);
+    else
+      uc.cc->movq(tmp, value);
+
+    uc.cc->movnti(x86::qword_ptr(result_ptr), tmp);
+    return;
+  }
+#endif
+
+  uc.v_storeu64_f64(ujit::mem_ptr(result_ptr), value);
+}
+
+// Counts uniform nodes that would be computed before the loop by `hoist_uniform()`.
+uint32_t JitCompiler::count_hoistable(AstNode* node) {
+  // Variables are only loaded, which is as cheap as reading a hoisted value from the stack if it was spilled.
+  if (node->has_node_flag(kAstNodeIsUniform))
+    return node->node_type() != kAstNodeVar;
+
+  uint32_t n = 0;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      n += count_hoistable(child);
+  }
+  return n;
+}
+
+// Computes all outermost uniform nodes and keeps their results, which are then used by `on_node()`.
+void JitCompiler::hoist_uniform(AstNode* node) {
+  if (node->has_node_flag(kAstNodeIsUniform)) {
+    if (node->node_type() != kAstNodeVar) {
+      JitVar v = register_var(on_node(node));
+      v.setRO();
+
+      hoisted_nodes[hoisted_count] = node;
+      hoisted_vars[hoisted_count] = v;
+      hoisted_count++;
+    }
+    return;
+  }
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      hoist_uniform(child);
+  }
+}
+
+const JitVar* JitCompiler::find_hoisted(AstNode* node) const {
+  for (uint32_t i = 0; i < hoisted_count; i++) {
+    if (hoisted_nodes[i] == node)
+      return &hoisted_vars[i];
   }
+  return nullptr;
 }
 
 JitVar JitCompiler::on_node(AstNode* node) {
+  if (node->has_node_flag(kAstNodeIsUniform)) {
+    const JitVar* hoisted = find_hoisted(node);
+    if (hoisted)
+      return *hoisted;
+  }
+
+  JitVar result;
+
   switch (node->node_type()) {
-    case kAstNodeBlock    : return on_block    (static_cast<AstBlock*   >(node));
-    case kAstNodeVarDecl  : return on_var_decl (static_cast<AstVarDecl* >(node));
-    case kAstNodeVar      : return on_var      (static_cast<AstVar*     >(node));
-    case kAstNodeImm      : return on_imm      (static_cast<AstImm*     >(node));
-    case kAstNodeUnaryOp  : return on_unary_op (static_cast<AstUnaryOp* >(node));
-    case kAstNodeBinaryOp : return on_binary_op(static_cast<AstBinaryOp*>(node));
-    case kAstNodeCall     : return on_invoke   (static_cast<AstCall*    >(node));
+    case kAstNodeProgram  : result = on_block    (static_cast<AstBlock*   >(node)); break;
+    case kAstNodeBlock    : result = on_block    (static_cast<AstBlock*   >(node)); break;
+    case kAstNodeVarDecl  : result = on_var_decl (static_cast<AstVarDecl* >(node)); break;
+    case kAstNodeVar      : result = on_var      (static_cast<AstVar*     >(node)); break;
+    case kAstNodeImm      : result = on_imm      (static_cast<AstImm*     >(node)); break;
+    case kAstNodeIndex    : result = on_index    (static_cast<AstIndex*   >(node)); break;
+    case kAstNodeUnaryOp  : result = on_unary_op (static_cast<AstUnaryOp* >(node)); break;
+    case kAstNodeBinaryOp : result = on_binary_op(static_cast<AstBinaryOp*>(node)); break;
+    case kAstNodeCall     : result = on_invoke   (static_cast<AstCall*    >(node)); break;
+    case kAstNodeRepeat   : result = on_repeat   (static_cast<AstRepeat*  >(node)); break;
 
     default:
       MATHPRESSO_ASSERT_NOT_REACHED();
       return JitVar();
   }
+
+  if (tape)
+    record_tape_entry(node, result);
+
+  return result;
 }
 
 JitVar JitCompiler::on_block(AstBlock* node) {
@@ -335,20 +896,25 @@ JitVar JitCompiler::on_var_decl(AstVarDecl* node) {
 }
 
 JitVar JitCompiler::on_var(AstVar* node) {
-  AstSymbol* sym = node->symbol();
+  return symbol_var(node->symbol());
+}
+
+JitVar JitCompiler::symbol_var(AstSymbol* sym) {
   uint32_t slot_id = sym->var_slot_id();
 
   JitVar result = var_slots[slot_id];
   if (result.is_none()) {
     if (sym->is_global()) {
-      result = JitVar(ujit::mem_ptr(var_ptr, sym->var_offset()), JitVar::FLAG_RO);
+      // Intervals are twice as large as doubles, so their offsets are scaled.
+      int32_t offset = is_interval() ? sym->var_offset() * 2 : sym->var_offset();
+      result = JitVar(ujit::mem_ptr(base_ptr(sym->var_base()), offset), JitVar::FLAG_RO);
       var_slots[slot_id] = result;
       if (sym->write_count() > 0) {
         result = copy_var(result, JitVar::FLAG_NONE);
       }
     }
     else {
-      result = get_constant_f64(mp_get_nan());
+      result = is_interval() ? get_constant_f64_aligned(mp_get_nan()) : get_constant_f64(mp_get_nan());
       var_slots[slot_id] = result;
     }
   }
@@ -357,18 +923,160 @@ JitVar JitCompiler::on_var(AstVar* node) {
 }
 
 JitVar JitCompiler::on_imm(AstImm* node) {
-  return get_constant_f64(node->value());
+  if (is_interval())
+    return get_constant_f64_aligned(node->value());
+  else
+    return get_constant_f64(node->value());
+}
+
+JitVar JitCompiler::on_index(AstIndex* node) {
+  AstSymbol* sym = node->symbol();
+  AstNode* child = node->child();
+  uint32_t max = sym->array_length() - 1;
+
+  // Elements are not intervals (and can be NaN), but the index is still evaluated for its side effects.
+  if (is_interval()) {
+    on_node(child);
+    return get_constant_interval(mp_get_inf(), -mp_get_inf());
+  }
+
+  if (sym->symbol_type() == kAstSymbolTable)
+    return on_table(sym, register_var(on_node(child)).vec());
+
+  ujit::Gp base = base_ptr(sym->var_base());
+
+  // Constant indexes are clamped here, the element is then addressed directly.
+  if (child->is_imm()) {
+    double value = static_cast<AstImm*>(child)->value();
+    uint32_t index = value >= double(max) ? max : value >= 0.0 ? uint32_t(value) : uint32_t(0);
+
+    int32_t offset = sym->var_offset() + int32_t(index * sym->array_stride());
+    return JitVar(ujit::mem_ptr(base, offset), JitVar::FLAG_RO);
+  }
+
+  JitVar index = register_var(on_node(child));
+  ujit::Gp ptr = uc.new_gpz("element_ptr");
+
+  element_ptr(ptr, index.vec(), max, sym->array_stride(), base);
+  return JitVar(ujit::mem_ptr(ptr, sym->var_offset()), JitVar::FLAG_RO);
+}
+
+// Interpolates a value of a table at `x`. The position is clamped to knots (NaN gives NaN) and the interval is found
+// without branches - by scaling `x` if knots are uniform, otherwise by a binary search having a fixed number of steps.
+// Values around the interval are loaded by clamped indexes, so no load is out of bounds.
+JitVar JitCompiler::on_table(AstSymbol* sym, const ujit::Vec& x) {
+  uint32_t n = sym->array_length();
+  int32_t offset = sym->var_offset();
+  ujit::Gp base = base_ptr(sym->var_base());
+
+  ujit::Gp ptr = uc.new_gpz("table_ptr");
+  ujit::Vec fi = uc.new_vec128_f64x1();
+  ujit::Vec f = uc.new_vec128_f64x1();
+  ujit::Vec v0 = uc.new_vec128_f64x1();
+  ujit::Vec v1 = uc.new_vec128_f64x1();
+  ujit::Vec result = uc.new_vec128_f64x1();
+
+  if (sym->table_flags() & _kTableKnots) {
+    int32_t knots = sym->table_knots();
+    ujit::Vec candidate = uc.new_vec128_f64x1();
+    ujit::Vec mask = uc.new_vec128_f64x1();
+
+    // Finds the last knot that is less than or equal to `x` - candidates past the end are clamped to the last knot.
+    uint32_t step = 1;
+    while (step * 2u <= n - 1)
+      step *= 2u;
+
+    uc.v_loadu64_f64(fi, get_constant_f64(0.0).mem());
+    for (; step; step >>= 1) {
+      uc.s_add_f64(candidate, fi, get_constant_f64(double(step)).op());
+      element_ptr(ptr, candidate, n - 1, sizeof(double), base);
+      uc.s_cmp_ge_f64(mask, x, ujit::mem_ptr(ptr, knots));
+      select_f64(fi, mask, candidate, fi);
+    }
+
+    element_ptr(ptr, fi, n - 2, sizeof(double), base);
+    uc.v_loadu64_f64(v0, ujit::mem_ptr(ptr, knots));
+    uc.v_loadu64_f64(v1, ujit::mem_ptr(ptr, knots + int32_t(sizeof(double))));
+    uc.s_sub_f64(f, x, v0);
+    uc.s_sub_f64(v1, v1, v0);
+    uc.s_div_f64(f, f, v1);
+    clamp_f64(f, 0.0, 1.0);
+  }
+  else {
+    uc.s_sub_f64(f, x, get_constant_f64(sym->table_x0()).op());
+    uc.s_mul_f64(f, f, get_constant_f64(sym->table_scale()).op());
+    clamp_f64(f, 0.0, double(n - 1));
+    uc.s_trunc_f64(fi, f);
+    clamp_f64(fi, 0.0, double(n - 2));
+    uc.s_sub_f64(f, f, fi);
+    element_ptr(ptr, fi, n - 2, sizeof(double), base);
+  }
+
+  uc.v_loadu64_f64(v0, ujit::mem_ptr(ptr, offset));
+  uc.v_loadu64_f64(v1, ujit::mem_ptr(ptr, offset + int32_t(sizeof(double))));
+
+  if (sym->table_flags() & kTableCubic) {
+    // Catmull-Rom spline - `v1 + t/2 * (c + t * (b + t * a))` having `v(-1)` and `v(2)` clamped to the table.
+    ujit::Vec vm = uc.new_vec128_f64x1();
+    ujit::Vec vp = uc.new_vec128_f64x1();
+    ujit::Vec a = uc.new_vec128_f64x1();
+    ujit::Vec b = uc.new_vec128_f64x1();
+    ujit::Gp neighbor_ptr = uc.new_gpz("neighbor_ptr");
+
+    uc.s_sub_f64(a, fi, get_constant_f64(1.0).op());
+    element_ptr(neighbor_ptr, a, n - 1, sizeof(double), base);
+    uc.v_loadu64_f64(vm, ujit::mem_ptr(neighbor_ptr, offset));
+
+    uc.s_add_f64(a, fi, get_constant_f64(2.0).op());
+    element_ptr(neighbor_ptr, a, n - 1, sizeof(double), base);
+    uc.v_loadu64_f64(vp, ujit::mem_ptr(neighbor_ptr, offset));
+
+    // a = 3 * (v0 - v1) + vp - vm
+    uc.s_sub_f64(a, v0, v1);
+    uc.s_madd_f64(a, a, get_constant_f64(3.0).op(), vp);
+    uc.s_sub_f64(a, a, vm);
+
+    // b = 2 * vm - 5 * v0 + 4 * v1 - vp
+    uc.s_mul_f64(b, vm, get_constant_f64(2.0).op());
+    uc.s_madd_f64(b, v0, get_constant_f64(-5.0).op(), b);
+    uc.s_madd_f64(b, v1, get_constant_f64(4.0).op(), b);
+    uc.s_sub_f64(b, b, vp);
+
+    // c = v1 - vm
+    uc.s_sub_f64(vm, v1, vm);
+
+    uc.s_madd_f64(result, a, f, b);
+    uc.s_madd_f64(result, result, f, vm);
+    uc.s_mul_f64(result, result, f);
+    uc.s_madd_f64(result, result, get_constant_f64(0.5).op(), v0);
+  }
+  else {
+    uc.s_sub_f64(v1, v1, v0);
+    uc.s_madd_f64(result, v1, f, v0);
+  }
+
+  return JitVar(result, JitVar::FLAG_NONE);
 }
 
 JitVar JitCompiler::on_unary_op(AstUnaryOp* node) {
   uint32_t op = node->op_type();
 
   JitVar var = on_node(node->child());
+
+  if (op == kOpNone)
+    return var;
+
+  if (is_interval()) {
+    ujit::Vec result = uc.new_vec128_f64x2("interval");
+    ujit::Vec args[1] = { register_var(var).vec() };
+
+    interval_invoke(result, args, 1, interval_func_by_op(op));
+    return JitVar(result, JitVar::FLAG_NONE);
+  }
+
   ujit::Vec result = uc.new_vec128_f64x1();
 
   switch (op) {
-    case kOpNone:
-      return var;
 
     case kOpNeg: uc.s_neg_f64(result, var.op()); break;
     case kOpNot: uc.v_not_f64(result, register_var(var).op()); break;
@@ -461,11 +1169,32 @@ JitVar JitCompiler::on_binary_op(AstBinaryOp* node) {
     return result;
   }
 
-  // Handle the case that the operands are the same variable.
   JitVar vl, vr;
-  if (left->node_type() == kAstNodeVar &&
-      right->node_type() == kAstNodeVar &&
-      static_cast<AstVar*>(left)->symbol() == static_cast<AstVar*>(right)->symbol()) {
+
+  if (is_interval()) {
+    ujit::Vec result = uc.new_vec128_f64x2("interval");
+    ujit::Vec args[2];
+
+    args[0] = register_var(on_node(left)).vec();
+    args[1] = register_var(on_node(right)).vec();
+
+    interval_invoke(result, args, 2, interval_func_by_op(op));
+    return JitVar(result, JitVar::FLAG_NONE);
+  }
+
+  // Logical operators combine masks of their operands, which are only converted to 0.0 or 1.0 once. A tape needs
+  // values of all operands, so they are compiled by the generic path when recording it.
+  if ((op == kOpLogAnd || op == kOpLogOr) && !tape) {
+    ujit::Vec result = condition_mask(node);
+    uc.v_and_f64(result, result, uc.simd_const(&uc.ct().f64_1, ujit::Bcst::k64, result));
+    return JitVar(result, JitVar::FLAG_NONE);
+  }
+
+  // Handle the case that the operands are the same variable (not when recording a tape, which needs both operands).
+  if (!tape &&
+           left->node_type() == kAstNodeVar &&
+           right->node_type() == kAstNodeVar &&
+           static_cast<AstVar*>(left)->symbol() == static_cast<AstVar*>(right)->symbol()) {
     vl = vr = writable_var(on_node(node->left()));
   }
   else {
@@ -492,6 +1221,22 @@ JitVar JitCompiler::on_binary_op(AstBinaryOp* node) {
     case kOpLt: uc.s_cmp_lt_f64(result, register_var(vl).vec(), vr.op()); uc.v_and_f64(result, result, uc.simd_const(&uc.ct().f64_1, ujit::Bcst::k64, result)); break;
     case kOpLe: uc.s_cmp_le_f64(result, register_var(vl).vec(), vr.op()); uc.v_and_f64(result, result, uc.simd_const(&uc.ct().f64_1, ujit::Bcst::k64, result)); break;
 
+    case kOpLogAnd:
+    case kOpLogOr: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+
+      uc.s_cmp_ne_f64(result, register_var(vl).vec(), get_constant_f64(0.0).op());
+      uc.s_cmp_ne_f64(tmp, register_var(vr).vec(), get_constant_f64(0.0).op());
+
+      if (op == kOpLogAnd)
+        uc.v_and_f64(result, result, tmp);
+      else
+        uc.v_or_f64(result, result, tmp);
+
+      uc.v_and_f64(result, result, uc.simd_const(&uc.ct().f64_1, ujit::Bcst::k64, result));
+      break;
+    }
+
     case kOpAdd: uc.s_add_f64(result, register_var(vl).vec(), vr.op()); break;
     case kOpSub: uc.s_sub_f64(result, register_var(vl).vec(), vr.op()); break;
     case kOpMul: uc.s_mul_f64(result, register_var(vl).vec(), vr.op()); break;
@@ -534,13 +1279,92 @@ JitVar JitCompiler::on_binary_op(AstBinaryOp* node) {
     }
   }
 
+  if (conditions && op >= kOpEq && op <= kOpGe)
+    count_condition(node, result);
+
   return JitVar(result, JitVar::FLAG_NONE);
 }
 
+// Compiles `node` to a mask of its truth - all ones if its value is non-zero (including NaN) and zeros otherwise.
+// Comparisons are compiled directly to masks and logical operators combine masks of their operands.
+ujit::Vec JitCompiler::condition_mask(AstNode* node) {
+  ujit::Vec mask = uc.new_vec128_f64x1();
+
+  if (node->node_type() == kAstNodeBinaryOp && !(node->has_node_flag(kAstNodeIsUniform) && find_hoisted(node))) {
+    AstBinaryOp* binary = static_cast<AstBinaryOp*>(node);
+    uint32_t op = binary->op_type();
+
+    if (op == kOpLogAnd || op == kOpLogOr) {
+      ujit::Vec l = condition_mask(binary->left());
+      ujit::Vec r = condition_mask(binary->right());
+
+      if (op == kOpLogAnd)
+        uc.v_and_f64(mask, l, r);
+      else
+        uc.v_or_f64(mask, l, r);
+      return mask;
+    }
+
+    if (op >= kOpEq && op <= kOpGe) {
+      JitVar vl = register_var(on_node(binary->left()));
+      JitVar vr = on_node(binary->right());
+
+      switch (op) {
+        case kOpEq: uc.s_cmp_eq_f64(mask, vl.vec(), vr.op()); break;
+        case kOpNe: uc.s_cmp_ne_f64(mask, vl.vec(), vr.op()); break;
+        case kOpLt: uc.s_cmp_lt_f64(mask, vl.vec(), vr.op()); break;
+        case kOpLe: uc.s_cmp_le_f64(mask, vl.vec(), vr.op()); break;
+        case kOpGt: uc.s_cmp_gt_f64(mask, vl.vec(), vr.op()); break;
+        case kOpGe: uc.s_cmp_ge_f64(mask, vl.vec(), vr.op()); break;
+      }
+
+      if (conditions) {
+        ujit::Vec truth = uc.new_vec128_f64x1();
+        uc.v_and_f64(truth, mask, uc.simd_const(&uc.ct().f64_1, ujit::Bcst::k64, truth));
+        count_condition(node, truth);
+      }
+      return mask;
+    }
+  }
+
+  uc.s_cmp_ne_f64(mask, register_var(on_node(node)).vec(), get_constant_f64(0.0).op());
+  return mask;
+}
+
+// Adds 1 to the evaluation count of the comparison `node` and `truth` (0.0 or 1.0) to the count of its outcomes that
+// were true, see `JitConditions`. Counters are updated in memory, so a comparison in a `repeat` loop is counted once
+// per iteration.
+void JitCompiler::count_condition(AstNode* node, const ujit::Vec& truth) {
+  MATHPRESSO_ASSERT(conditions->count < conditions->capacity);
+  uint32_t index = conditions->count++;
+  conditions->positions[index] = node->position();
+
+  ujit::Gp counters_ptr = uc.new_gp_ptr("counters_ptr");
+  ujit::Vec counter = uc.new_vec128_f64x1();
+  uc.mov(counters_ptr, (uint64_t)(conditions->counters + index * 2u));
+
+  uc.v_loadu64_f64(counter, ujit::mem_ptr(counters_ptr));
+  uc.s_add_f64(counter, counter, get_constant_f64(1.0).op());
+  uc.v_storeu64_f64(ujit::mem_ptr(counters_ptr), counter);
+
+  uc.v_loadu64_f64(counter, ujit::mem_ptr(counters_ptr, int32_t(sizeof(double))));
+  uc.s_add_f64(counter, counter, truth);
+  uc.v_storeu64_f64(ujit::mem_ptr(counters_ptr, int32_t(sizeof(double))), counter);
+}
+
 JitVar JitCompiler::on_invoke(AstCall* node) {
   uint32_t i, size = node->size();
   AstSymbol* sym = node->symbol();
 
+  // Nothing is known about results of user functions (they can be NaN), but arguments are still evaluated for their
+  // side effects.
+  if (is_interval()) {
+    for (i = 0; i < size; i++) {
+      on_node(node->child_at(i));
+    }
+    return get_constant_interval(mp_get_inf(), -mp_get_inf());
+  }
+
   ujit::Vec result = uc.new_vec128_f64x1();
   ujit::Vec args[8];
   MATHPRESSO_ASSERT(size <= 8);
@@ -553,61 +1377,1132 @@ JitVar JitCompiler::on_invoke(AstCall* node) {
   return JitVar(result, JitVar::FLAG_NONE);
 }
 
-void JitCompiler::inline_invoke(const ujit::Vec& dst, const ujit::Vec* args, uint32_t count, void* fn) {
-  uint32_t i;
-
-  // Use function builder to build a function prototype.
-  FuncSignature signature;
-  signature.set_ret_t<double>();
-
-  for (i = 0; i < count; i++) {
-    signature.add_arg_t<double>();
+// Compiles a `repeat` loop to a machine loop. Variables assigned by the body (and declared outside of it) are
+// loop-carried - they are moved to registers before the loop and values computed by an iteration are moved back to
+// them at its end, so the next iteration and the code after the loop see them. Other slots are restored after the
+// loop, as values created by the body don't exist if the loop doesn't iterate.
+JitVar JitCompiler::on_repeat(AstRepeat* node) {
+  AstBlock* body = node->body();
+  JitVar count = register_var(on_node(node->count()));
+
+  // The last target is the value of the body.
+  uint32_t capacity = count_nodes(body);
+  size_t symbols_size = sizeof(AstSymbol*) * capacity * 2;
+  size_t vars_size = sizeof(JitVar) * ((capacity + 1) * 2 + num_slots);
+
+  AstSymbol** symbols = static_cast<AstSymbol**>(arena.alloc_reusable(Arena::aligned_size(symbols_size)));
+  JitVar* targets = static_cast<JitVar*>(arena.alloc_reusable(Arena::aligned_size(vars_size)));
+
+  if (!symbols || !targets) {
+    if (symbols) arena.free_reusable(symbols, symbols_size);
+    if (targets) arena.free_reusable(targets, vars_size);
+    return JitVar();
   }
 
-  // Create the function call.
-  InvokeNode* invoke_node;
+  JitVar* values = targets + capacity + 1;
+  JitVar* saved = values + capacity + 1;
 
-#if defined(ASMJIT_UJIT_AARCH64)
-  ujit::Gp func_ptr = uc.new_gp_ptr("func_ptr");
-  uc.mov(func_ptr, (uint64_t)fn);
-  uc.cc->invoke(asmjit::Out(invoke_node), func_ptr, signature);
-#else
-  uc.cc->invoke(asmjit::Out(invoke_node), (uint64_t)fn, signature);
-#endif
-  invoke_node->set_ret(0, dst);
+  uint32_t i, j;
+  uint32_t carried_count = collect_carried(body, symbols, symbols + capacity);
 
-  for (i = 0; i < count; i++) {
-    invoke_node->set_arg(i, args[i]);
+  for (i = 0; i < carried_count; i++) {
+    JitVar v = copy_var(symbol_var(symbols[i]), JitVar::FLAG_RO);
+    var_slots[symbols[i]->var_slot_id()] = v;
+    targets[i] = v;
   }
-}
+  targets[carried_count] = copy_var(is_interval() ? get_constant_f64_aligned(mp_get_nan()) : get_constant_f64(mp_get_nan()), JitVar::FLAG_RO);
 
-void JitCompiler::prepare_const_pool() {
-  if (!const_pool) {
-    uc.cc->new_const_pool_node(asmjit::Out(const_pool));
+  for (i = 0; i < num_slots; i++) {
+    saved[i] = var_slots[i];
   }
-}
 
-JitVar JitCompiler::get_constant_u64(uint64_t value) {
-  prepare_const_pool();
+  Label L_Loop = uc.new_label();
+  Label L_Done = uc.new_label();
+  ujit::Gp n = uc.new_gp32("repeat_count");
 
-  size_t offset;
-  if (const_pool->add(&value, sizeof(uint64_t), asmjit::Out(offset)) != asmjit::Error::kOk)
-    return JitVar();
+  clamp_to_index(n, count.vec(), kMaxRepeatCount);
+  uc.j(L_Done, ujit::test_z(n));
+  uc.bind(L_Loop);
 
-  return JitVar(ujit::mem_ptr(const_pool->label(), static_cast<int>(offset)), JitVar::FLAG_NONE);
-}
+  JitVar result = on_node(body);
 
-JitVar JitCompiler::get_constant_u64_as_f64x2(uint64_t value) {
-  prepare_const_pool();
+  // A value can be a loop-carried register of another variable (like when variables are swapped), which would be
+  // overwritten before it's moved, so it's copied first.
+  for (i = 0; i <= carried_count; i++) {
+    JitVar v = i < carried_count ? var_slots[symbols[i]->var_slot_id()] : result;
+    values[i].reset();
 
-  uint64_t data[2] = { value, 0 };
-  size_t offset;
+    if (v.is_none() || (v.is_vec() && v.vec().id() == targets[i].vec().id()))
+      continue;
 
-  if (const_pool->add(data, sizeof(data), asmjit::Out(offset)) != asmjit::Error::kOk)
-    return JitVar();
+    if (v.is_vec()) {
+      for (j = 0; j <= carried_count; j++) {
+        if (j != i && v.vec().id() == targets[j].vec().id()) {
+          v = copy_var(v, JitVar::FLAG_RO);
+          break;
+        }
+      }
+    }
 
-  return JitVar(ujit::mem_ptr(const_pool->label(), static_cast<int>(offset)), JitVar::FLAG_NONE);
-}
+    values[i] = v;
+  }
+
+  for (i = 0; i <= carried_count; i++) {
+    if (!values[i].is_none())
+      move_var(targets[i].vec(), values[i]);
+  }
+
+  uc.j(L_Loop, ujit::sub_nz(n, Imm(1)));
+  uc.bind(L_Done);
+
+  // The loop iterates the count of the lower bound of an interval. If the upper bound truncates to another count or
+  // the count can be NaN (`lo > hi`), values computed by the loop are unknown.
+  if (is_interval()) {
+    ujit::Vec lo = uc.new_vec128_f64x1();
+    ujit::Vec hi = uc.new_vec128_f64x1();
+    ujit::Vec ordered = uc.new_vec128_f64x1();
+    ujit::Vec entire = register_var(get_constant_interval(mp_get_inf(), -mp_get_inf())).vec();
+
+    uc.v_swap_f64(hi, count.vec());
+    uc.s_cmp_le_f64(ordered, count.vec(), hi);
+    uc.s_trunc_f64(hi, hi);
+    uc.s_trunc_f64(lo, count.vec());
+    uc.s_cmp_eq_f64(lo, lo, hi);
+    uc.v_and_f64(lo, lo, ordered);
+    uc.v_interleave_lo_u64(lo, lo, lo);
+
+    for (i = 0; i <= carried_count; i++) {
+      select_f64(targets[i].vec(), lo, targets[i].vec(), entire);
+    }
+  }
+
+  for (i = 0; i < num_slots; i++) {
+    var_slots[i] = saved[i];
+  }
+
+  result = targets[carried_count];
+
+  arena.free_reusable(symbols, symbols_size);
+  arena.free_reusable(targets, vars_size);
+  return result;
+}
+
+// Collects variables assigned by `body` and not declared by it to `carried` (without duplicates), returns their
+// count. Both `carried` and `declared` must be able to hold a symbol per node of `body`.
+uint32_t JitCompiler::collect_carried(AstBlock* body, AstSymbol** carried, AstSymbol** declared) {
+  uint32_t assigned_count = 0;
+  uint32_t declared_count = 0;
+  uint32_t carried_count = 0;
+
+  collect_vars(body, carried, assigned_count, declared, declared_count);
+
+  for (uint32_t i = 0; i < assigned_count; i++) {
+    AstSymbol* sym = carried[i];
+    bool skip = false;
+
+    for (uint32_t j = 0; j < declared_count && !skip; j++)
+      skip = declared[j] == sym;
+
+    for (uint32_t j = 0; j < carried_count && !skip; j++)
+      skip = carried[j] == sym;
+
+    if (!skip)
+      carried[carried_count++] = sym;
+  }
+
+  return carried_count;
+}
+
+void JitCompiler::collect_vars(AstNode* node, AstSymbol** assigned, uint32_t& assigned_count, AstSymbol** declared, uint32_t& declared_count) {
+  if (node->node_type() == kAstNodeVarDecl)
+    declared[declared_count++] = static_cast<AstVarDecl*>(node)->symbol();
+
+  if (node->node_type() == kAstNodeBinaryOp && node->op_type() == kOpAssign)
+    assigned[assigned_count++] = static_cast<AstVar*>(static_cast<AstBinaryOp*>(node)->left())->symbol();
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      collect_vars(child, assigned, assigned_count, declared, declared_count);
+  }
+}
+
+// Converts the count of a `repeat` loop or an array index to an integer - it's truncated and clamped to `[0, max]`,
+// NaN is zero. Only the low lane of `value` is used.
+void JitCompiler::clamp_to_index(const ujit::Gp& dst, const ujit::Vec& value, uint32_t max) {
+  ujit::Vec v = uc.new_vec128_f64x1();
+  ujit::Vec mask = uc.new_vec128_f64x1();
+  ujit::Vec tmp = uc.new_vec128_f64x1();
+
+  // Clamp to the maximum (NaN is kept), then zero NaN and negative counts.
+  uc.s_cmp_gt_f64(mask, value, get_constant_f64(double(max)).op());
+  uc.v_andn_f64(v, mask, value);
+  uc.v_and_f64(tmp, mask, get_constant_f64_as_f64x2(double(max)).op());
+  uc.v_or_f64(v, v, tmp);
+
+  uc.s_cmp_ge_f64(mask, v, get_constant_f64(0.0).op());
+  uc.v_and_f64(v, v, mask);
+
+#if defined(ASMJIT_UJIT_X86)
+  if (uc.has_avx())
+    uc.cc->vcvttsd2si(dst, v);
+  else
+    uc.cc->cvttsd2si(dst, v);
+#elif defined(ASMJIT_UJIT_AARCH64)
+  uc.cc->fcvtzs(dst, v.d());
+#endif
+}
+
+// Computes the address of an element of an array - `index` is converted by `clamp_to_index()` and scaled by `stride`,
+// then `base` is added. The offset of the array is left to memory operands.
+void JitCompiler::element_ptr(const ujit::Gp& dst, const ujit::Vec& index, uint32_t max, uint32_t stride, const ujit::Gp& base) {
+  clamp_to_index(dst, index, max);
+  if ((stride & (stride - 1)) == 0)
+    uc.shl(dst, dst, Imm(Support::ctz(stride)));
+  else
+    uc.mul(dst, dst, Imm(stride));
+  uc.add(dst, dst, base);
+}
+
+// Clamps the low lane of `v` to `[lo, hi]` in place, NaN is kept.
+void JitCompiler::clamp_f64(const ujit::Vec& v, double lo, double hi) {
+  ujit::Vec mask = uc.new_vec128_f64x1();
+
+  uc.s_cmp_lt_f64(mask, v, get_constant_f64(lo).op());
+  uc.v_andn_f64(v, mask, v);
+  uc.v_and_f64(mask, mask, get_constant_f64_as_f64x2(lo).op());
+  uc.v_or_f64(v, v, mask);
+
+  uc.s_cmp_gt_f64(mask, v, get_constant_f64(hi).op());
+  uc.v_andn_f64(v, mask, v);
+  uc.v_and_f64(mask, mask, get_constant_f64_as_f64x2(hi).op());
+  uc.v_or_f64(v, v, mask);
+}
+
+// Compiles the program followed by a reverse sweep over values it computed (reverse-mode automatic differentiation).
+//
+// The forward pass records the value of each node in evaluation order. The reverse sweep visits them backwards and
+// propagates the adjoint of each node to its children, multiplied by the partial derivative of the node with respect
+// to the child. Adjoints of variables are accumulated per slot - an assignment (or a declaration) passes the adjoint
+// of its variable to the assigned value and resets it, as reads before the assignment saw another value. Adjoints of
+// global variables that remain after the sweep are partial derivatives with respect to their inputs.
+void JitCompiler::compile_gradient(AstBlock* node, AstScope* root_scope) {
+  tape_capacity = count_nodes(node);
+  tape = static_cast<JitTapeEntry*>(arena.alloc_reusable(Arena::aligned_size(sizeof(JitTapeEntry) * tape_capacity)));
+  if (tape == nullptr)
+    return;
+
+  // At most half of the buckets are used, `count_nodes()` is an upper bound of distinct recorded nodes.
+  uint32_t table_size = 16;
+  while (table_size < tape_capacity * 2u)
+    table_size *= 2u;
+
+  tape_table = static_cast<uint32_t*>(arena.alloc_reusable(Arena::aligned_size(sizeof(uint32_t) * table_size)));
+  if (tape_table == nullptr) {
+    arena.free_reusable(tape, sizeof(JitTapeEntry) * tape_capacity);
+    tape = nullptr;
+    return;
+  }
+  tape_table_mask = table_size - 1u;
+
+  for (uint32_t i = 0; i < table_size; i++) {
+    tape_table[i] = kJitTapeNone;
+  }
+
+  if (num_slots != 0) {
+    var_adjoints = static_cast<JitVar*>(arena.alloc_reusable(Arena::aligned_size(sizeof(JitVar) * num_slots)));
+    if (var_adjoints == nullptr) {
+      arena.free_reusable(tape_table, sizeof(uint32_t) * table_size);
+      arena.free_reusable(tape, sizeof(JitTapeEntry) * tape_capacity);
+      tape_table = nullptr;
+      tape = nullptr;
+      return;
+    }
+
+    for (uint32_t i = 0; i < num_slots; i++) {
+      var_adjoints[i] = JitVar();
+    }
+  }
+
+  for (uint32_t i = 0; i < tape_capacity; i++) {
+    tape[i].node = nullptr;
+    tape[i].value = JitVar();
+    tape[i].adjoint = JitVar();
+    tape[i].prev = kJitTapeNone;
+  }
+
+  mark_active(node);
+
+  ujit::Vec result = compile_body(node, root_scope);
+  uc.v_storeu64_f64(ujit::mem_ptr(result_ptr), result);
+
+  // The program block is compiled by `compile_body()`, which doesn't record it. Its adjoint is the seed.
+  record_tape_entry(node, JitVar(result, JitVar::FLAG_NONE));
+  tape[tape_size - 1].adjoint = get_constant_f64(1.0);
+
+  for (uint32_t i = tape_size; i != 0; i--) {
+    backprop(i - 1);
+  }
+
+  for (uint32_t i = 0; i < gradient->count; i++) {
+    AstSymbol* sym = gradient->symbols[i];
+    JitVar partial;
+
+    if (sym)
+      partial = var_adjoints[sym->var_slot_id()];
+
+    if (partial.is_none())
+      partial = get_constant_f64(0.0);
+
+    uc.v_storeu64_f64(ujit::mem_ptr(var_ptr, gradient->offsets[i]), register_var(partial).vec());
+  }
+
+  if (var_adjoints) {
+    arena.free_reusable(var_adjoints, sizeof(JitVar) * num_slots);
+    var_adjoints = nullptr;
+  }
+
+  arena.free_reusable(tape_table, sizeof(uint32_t) * table_size);
+  tape_table = nullptr;
+  tape_table_mask = 0;
+
+  arena.free_reusable(tape, sizeof(JitTapeEntry) * tape_capacity);
+  tape = nullptr;
+  tape_size = 0;
+  tape_capacity = 0;
+}
+
+uint32_t JitCompiler::count_nodes(AstNode* node) {
+  uint32_t n = 1;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      n += count_nodes(child);
+  }
+  return n;
+}
+
+// Marks nodes whose value depends on a variable (in a single pass) and returns whether `node` is one of them.
+bool JitCompiler::mark_active(AstNode* node) {
+  bool active = node->node_type() == kAstNodeVar;
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child && mark_active(child))
+      active = true;
+  }
+
+  if (active)
+    node->add_node_flags(kAstNodeIsActive);
+  return active;
+}
+
+// Get whether the value of `node` depends on a variable, other nodes have zero derivatives.
+bool JitCompiler::is_active(AstNode* node) {
+  return node->has_node_flag(kAstNodeIsActive);
+}
+
+// Returns the bucket of `node` in `tape_table`, which is either empty or holds the last tape entry of `node`.
+uint32_t* JitCompiler::tape_bucket(AstNode* node) {
+  uint32_t i = HashUtils::hash_pointer(node) & tape_table_mask;
+  while (tape_table[i] != kJitTapeNone && tape[tape_table[i]].node != node)
+    i = (i + 1u) & tape_table_mask;
+  return &tape_table[i];
+}
+
+// Records the value of `node` and links it to the previous entry of the same node.
+void JitCompiler::record_tape_entry(AstNode* node, const JitVar& value) {
+  MATHPRESSO_ASSERT(tape_size < tape_capacity);
+  uint32_t* bucket = tape_bucket(node);
+
+  tape[tape_size].node = node;
+  tape[tape_size].value = value;
+  tape[tape_size].prev = *bucket;
+  *bucket = tape_size++;
+}
+
+// Finds the tape entry of `node` recorded before `end` - children are always recorded before their parent.
+JitTapeEntry* JitCompiler::find_tape_entry(AstNode* node, uint32_t end) {
+  uint32_t i = *tape_bucket(node);
+  while (i != kJitTapeNone && i >= end)
+    i = tape[i].prev;
+  return i != kJitTapeNone ? &tape[i] : nullptr;
+}
+
+// Adds `value` to the adjoint `dst`. Adjoints are never modified in place, they can share registers with values.
+void JitCompiler::accumulate(JitVar& dst, const JitVar& value) {
+  if (dst.is_none()) {
+    dst = value;
+  }
+  else {
+    ujit::Vec sum = uc.new_vec128_f64x1();
+    uc.s_add_f64(sum, register_var(dst).vec(), value.op());
+    dst = JitVar(sum, JitVar::FLAG_NONE);
+  }
+}
+
+// Adds `adjoint * scale` (or `adjoint` if `scale` is none) to the adjoint of `node` recorded before `end`.
+void JitCompiler::add_adjoint(AstNode* node, uint32_t end, const JitVar& adjoint, const JitVar& scale) {
+  if (adjoint.is_none() || !is_active(node))
+    return;
+
+  JitTapeEntry* entry = find_tape_entry(node, end);
+  MATHPRESSO_ASSERT(entry != nullptr);
+
+  if (scale.is_none()) {
+    accumulate(entry->adjoint, adjoint);
+  }
+  else {
+    ujit::Vec product = uc.new_vec128_f64x1();
+    uc.s_mul_f64(product, register_var(adjoint).vec(), scale.op());
+    accumulate(entry->adjoint, JitVar(product, JitVar::FLAG_NONE));
+  }
+}
+
+void JitCompiler::backprop(uint32_t index) {
+  AstNode* node = tape[index].node;
+  JitVar adjoint = tape[index].adjoint;
+
+  switch (node->node_type()) {
+    case kAstNodeBlock: {
+      // Only the last node of a block is its value.
+      if (node->size())
+        add_adjoint(node->child_at(node->size() - 1), index, adjoint, JitVar());
+      break;
+    }
+
+    case kAstNodeVarDecl: {
+      AstVarDecl* decl = static_cast<AstVarDecl*>(node);
+      JitVar& var_adjoint = var_adjoints[decl->symbol()->var_slot_id()];
+
+      if (decl->child()) {
+        add_adjoint(decl->child(), index, adjoint, JitVar());
+        add_adjoint(decl->child(), index, var_adjoint, JitVar());
+      }
+
+      var_adjoint.reset();
+      break;
+    }
+
+    case kAstNodeVar: {
+      if (!adjoint.is_none())
+        accumulate(var_adjoints[static_cast<AstVar*>(node)->symbol()->var_slot_id()], adjoint);
+      break;
+    }
+
+    case kAstNodeImm:
+      break;
+
+    case kAstNodeIndex: {
+      // Elements don't depend on variables and the index only selects one of them (a zero derivative). Derivatives
+      // of tables are unknown.
+      if (!adjoint.is_none() && static_cast<AstIndex*>(node)->symbol()->symbol_type() == kAstSymbolTable)
+        add_adjoint(static_cast<AstIndex*>(node)->child(), index, get_constant_f64(mp_get_nan()), JitVar());
+      break;
+    }
+
+    case kAstNodeUnaryOp:
+      backprop_unary_op(static_cast<AstUnaryOp*>(node), index);
+      break;
+
+    case kAstNodeBinaryOp:
+      backprop_binary_op(static_cast<AstBinaryOp*>(node), index);
+      break;
+
+    case kAstNodeRepeat: {
+      // Derivatives through a loop are unknown (loops having a small constant count are unrolled by the optimizer).
+      // The value of the body and variables assigned by it get NaN adjoints, which the body propagates to its inputs.
+      if (!adjoint.is_none())
+        add_adjoint(static_cast<AstRepeat*>(node)->body(), index, get_constant_f64(mp_get_nan()), JitVar());
+      unknown_adjoints(static_cast<AstRepeat*>(node)->body());
+      break;
+    }
+
+    case kAstNodeCall: {
+      // Derivatives of functions are unknown.
+      if (!adjoint.is_none()) {
+        for (uint32_t i = 0, size = node->size(); i < size; i++)
+          add_adjoint(node->child_at(i), index, get_constant_f64(mp_get_nan()), JitVar());
+      }
+      break;
+    }
+
+    default:
+      MATHPRESSO_ASSERT_NOT_REACHED();
+  }
+}
+
+// Makes non-zero adjoints of variables assigned by `node` unknown (NaN).
+void JitCompiler::unknown_adjoints(AstNode* node) {
+  if (node->node_type() == kAstNodeBinaryOp && node->op_type() == kOpAssign) {
+    JitVar& var_adjoint = var_adjoints[static_cast<AstVar*>(static_cast<AstBinaryOp*>(node)->left())->symbol()->var_slot_id()];
+    if (!var_adjoint.is_none())
+      var_adjoint = get_constant_f64(mp_get_nan());
+  }
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      unknown_adjoints(child);
+  }
+}
+
+void JitCompiler::backprop_unary_op(AstUnaryOp* node, uint32_t index) {
+  uint32_t op = node->op_type();
+  AstNode* child = node->child();
+  JitVar adjoint = tape[index].adjoint;
+
+  if (adjoint.is_none() || !is_active(child))
+    return;
+
+  ujit::Vec a = register_var(find_tape_entry(child, index)->value).vec();
+  ujit::Vec r = register_var(tape[index].value).vec();
+  ujit::Vec d = uc.new_vec128_f64x1();
+
+  switch (op) {
+    case kOpNone:
+    case kOpFrac:
+      add_adjoint(child, index, adjoint, JitVar());
+      return;
+
+    case kOpNeg:
+      add_adjoint(child, index, adjoint, get_constant_f64(-1.0));
+      return;
+
+    // d = copysign(1, a).
+    case kOpAbs: {
+      uc.v_and_f64(d, a, get_constant_u64_as_f64x2(0x8000000000000000u).op());
+      uc.v_or_f64(d, d, get_constant_f64_as_f64x2(1.0).op());
+      break;
+    }
+
+    // d = exp(a).
+    case kOpExp: {
+      add_adjoint(child, index, adjoint, JitVar(r, JitVar::FLAG_NONE));
+      return;
+    }
+
+    // d = 1 / (a * ln(base)).
+    case kOpLog:
+    case kOpLog2:
+    case kOpLog10: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+      uc.v_mov(tmp, a);
+      if (op == kOpLog2) uc.s_mul_f64(tmp, tmp, get_constant_f64(0.69314718055994530942).op());
+      if (op == kOpLog10) uc.s_mul_f64(tmp, tmp, get_constant_f64(2.30258509299404568402).op());
+
+      uc.v_loada64_f64(d, get_constant_f64(1.0).mem());
+      uc.s_div_f64(d, d, tmp);
+      break;
+    }
+
+    // d = 0.5 / sqrt(a).
+    case kOpSqrt: {
+      uc.v_loada64_f64(d, get_constant_f64(0.5).mem());
+      uc.s_div_f64(d, d, r);
+      break;
+    }
+
+    // d = -1 / a^2.
+    case kOpRecip: {
+      uc.s_mul_f64(d, r, r);
+      uc.s_neg_f64(d, d);
+      break;
+    }
+
+    // d = cos(a), -sin(a), cosh(a), sinh(a).
+    case kOpSin:
+    case kOpCos:
+    case kOpSinh:
+    case kOpCosh: {
+      uint32_t derivative_op = op == kOpSin ? kOpCos : op == kOpCos ? kOpSin : op == kOpSinh ? kOpCosh : kOpSinh;
+      inline_invoke(d, &a, 1, JitUtils::func_by_op(derivative_op));
+
+      if (op == kOpCos)
+        uc.s_neg_f64(d, d);
+      break;
+    }
+
+    // d = 1 + tan(a)^2.
+    case kOpTan: {
+      uc.s_mul_f64(d, r, r);
+      uc.s_add_f64(d, d, get_constant_f64(1.0).op());
+      break;
+    }
+
+    // d = 1 - tanh(a)^2.
+    case kOpTanh: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+      uc.s_mul_f64(tmp, r, r);
+      uc.v_loada64_f64(d, get_constant_f64(1.0).mem());
+      uc.s_sub_f64(d, d, tmp);
+      break;
+    }
+
+    // d = 1 / sqrt(1 - a^2), -1 / sqrt(1 - a^2).
+    case kOpAsin:
+    case kOpAcos: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+      uc.s_mul_f64(tmp, a, a);
+      uc.v_loada64_f64(d, get_constant_f64(1.0).mem());
+      uc.s_sub_f64(tmp, d, tmp);
+      uc.s_sqrt_f64(tmp, tmp);
+      uc.v_loada64_f64(d, get_constant_f64(op == kOpAsin ? 1.0 : -1.0).mem());
+      uc.s_div_f64(d, d, tmp);
+      break;
+    }
+
+    // d = 1 / (1 + a^2).
+    case kOpAtan: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+      uc.s_mul_f64(tmp, a, a);
+      uc.s_add_f64(tmp, tmp, get_constant_f64(1.0).op());
+      uc.v_loada64_f64(d, get_constant_f64(1.0).mem());
+      uc.s_div_f64(d, d, tmp);
+      break;
+    }
+
+    // Piecewise constant operators (conditions and rounding) have zero derivatives.
+    default:
+      return;
+  }
+
+  add_adjoint(child, index, adjoint, JitVar(d, JitVar::FLAG_NONE));
+}
+
+void JitCompiler::backprop_binary_op(AstBinaryOp* node, uint32_t index) {
+  uint32_t op = node->op_type();
+  AstNode* left = node->left();
+  AstNode* right = node->right();
+  JitVar adjoint = tape[index].adjoint;
+
+  if (op == kOpAssign) {
+    JitVar& var_adjoint = var_adjoints[static_cast<AstVar*>(left)->symbol()->var_slot_id()];
+
+    add_adjoint(right, index, adjoint, JitVar());
+    add_adjoint(right, index, var_adjoint, JitVar());
+    var_adjoint.reset();
+    return;
+  }
+
+  bool left_active = is_active(left);
+  bool right_active = is_active(right);
+
+  if (adjoint.is_none() || (!left_active && !right_active))
+    return;
+
+  ujit::Vec a = register_var(find_tape_entry(left, index)->value).vec();
+  ujit::Vec b = register_var(find_tape_entry(right, index)->value).vec();
+  ujit::Vec r = register_var(tape[index].value).vec();
+
+  // Partial derivatives with respect to `left` and `right`, none means 1.
+  JitVar dl;
+  JitVar dr;
+
+  switch (op) {
+    case kOpAdd:
+      break;
+
+    case kOpSub:
+      dr = get_constant_f64(-1.0);
+      break;
+
+    case kOpMul:
+      dl = JitVar(b, JitVar::FLAG_NONE);
+      dr = JitVar(a, JitVar::FLAG_NONE);
+      break;
+
+    // dl = 1 / b, dr = -(a / b) / b.
+    case kOpDiv: {
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+
+      if (left_active) {
+        uc.v_loada64_f64(tmp, get_constant_f64(1.0).mem());
+        uc.s_div_f64(tmp, tmp, b);
+        dl = JitVar(tmp, JitVar::FLAG_NONE);
+      }
+
+      if (right_active) {
+        ujit::Vec d = uc.new_vec128_f64x1();
+        uc.s_div_f64(d, r, b);
+        uc.s_neg_f64(d, d);
+        dr = JitVar(d, JitVar::FLAG_NONE);
+      }
+      break;
+    }
+
+    // a % b = a - trunc(a / b) * b: dl = 1, dr = -trunc(a / b).
+    case kOpMod: {
+      if (right_active) {
+        ujit::Vec d = uc.new_vec128_f64x1();
+        uc.s_div_f64(d, a, b);
+        uc.s_trunc_f64(d, d);
+        uc.s_neg_f64(d, d);
+        dr = JitVar(d, JitVar::FLAG_NONE);
+      }
+      break;
+    }
+
+    case kOpAvg:
+      dl = get_constant_f64(0.5);
+      dr = get_constant_f64(0.5);
+      break;
+
+    // The adjoint goes to the selected operand.
+    case kOpMin:
+    case kOpMax: {
+      ujit::Vec sel = uc.new_vec128_f64x1();
+      ujit::Vec other = uc.new_vec128_f64x1();
+
+      if (op == kOpMin)
+        uc.s_cmp_le_f64(sel, a, b);
+      else
+        uc.s_cmp_ge_f64(sel, a, b);
+
+      uc.v_and_f64(sel, sel, get_constant_f64_as_f64x2(1.0).op());
+      uc.v_loada64_f64(other, get_constant_f64(1.0).mem());
+      uc.s_sub_f64(other, other, sel);
+
+      dl = JitVar(sel, JitVar::FLAG_NONE);
+      dr = JitVar(other, JitVar::FLAG_NONE);
+      break;
+    }
+
+    // dl = b * pow(a, b - 1), dr = pow(a, b) * log(a).
+    case kOpPow: {
+      if (left_active) {
+        ujit::Vec d = uc.new_vec128_f64x1();
+        ujit::Vec args[2] = { a, uc.new_vec128_f64x1() };
+
+        uc.s_sub_f64(args[1], b, get_constant_f64(1.0).op());
+        inline_invoke(d, args, 2, JitUtils::func_by_op(kOpPow));
+        uc.s_mul_f64(d, d, b);
+        dl = JitVar(d, JitVar::FLAG_NONE);
+      }
+
+      if (right_active) {
+        ujit::Vec d = uc.new_vec128_f64x1();
+        inline_invoke(d, &a, 1, JitUtils::func_by_op(kOpLog));
+        uc.s_mul_f64(d, d, r);
+        dr = JitVar(d, JitVar::FLAG_NONE);
+      }
+      break;
+    }
+
+    // atan2(a, b): dl = b / (a^2 + b^2), dr = -a / (a^2 + b^2).
+    case kOpAtan2: {
+      ujit::Vec den = uc.new_vec128_f64x1();
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+      ujit::Vec dl_vec = uc.new_vec128_f64x1();
+      ujit::Vec dr_vec = uc.new_vec128_f64x1();
+
+      uc.s_mul_f64(den, a, a);
+      uc.s_mul_f64(tmp, b, b);
+      uc.s_add_f64(den, den, tmp);
+
+      uc.s_div_f64(dl_vec, b, den);
+      uc.s_div_f64(dr_vec, a, den);
+      uc.s_neg_f64(dr_vec, dr_vec);
+
+      dl = JitVar(dl_vec, JitVar::FLAG_NONE);
+      dr = JitVar(dr_vec, JitVar::FLAG_NONE);
+      break;
+    }
+
+    // dl = a / hypot(a, b), dr = b / hypot(a, b).
+    case kOpHypot: {
+      ujit::Vec dl_vec = uc.new_vec128_f64x1();
+      ujit::Vec dr_vec = uc.new_vec128_f64x1();
+
+      uc.s_div_f64(dl_vec, a, r);
+      uc.s_div_f64(dr_vec, b, r);
+
+      dl = JitVar(dl_vec, JitVar::FLAG_NONE);
+      dr = JitVar(dr_vec, JitVar::FLAG_NONE);
+      break;
+    }
+
+    // dl = copysign(1, a) * copysign(1, b), the sign of `b` is piecewise constant.
+    case kOpCopySign: {
+      ujit::Vec d = uc.new_vec128_f64x1();
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+
+      uc.v_and_f64(d, a, get_constant_u64_as_f64x2(0x8000000000000000u).op());
+      uc.v_or_f64(d, d, get_constant_f64_as_f64x2(1.0).op());
+      uc.v_and_f64(tmp, b, get_constant_u64_as_f64x2(0x8000000000000000u).op());
+      uc.v_or_f64(tmp, tmp, get_constant_f64_as_f64x2(1.0).op());
+      uc.s_mul_f64(d, d, tmp);
+
+      dl = JitVar(d, JitVar::FLAG_NONE);
+      right_active = false;
+      break;
+    }
+
+    // Conditions are piecewise constant and have zero derivatives.
+    default:
+      return;
+  }
+
+  if (left_active)
+    add_adjoint(left, index, adjoint, dl);
+
+  if (right_active)
+    add_adjoint(right, index, adjoint, dr);
+}
+
+// Compiles a loop that integrates the system of equations (see `JitOde`) by an explicit Runge-Kutta method. The state
+// is loaded before the loop and kept in registers (or spilled to the stack by the register allocator), it's only
+// stored when the loop ends. Right-hand sides of all equations are compiled for each stage of the method.
+//
+// The adaptive method doesn't branch on the error - a rejected step keeps the state and time, then the step is
+// multiplied by the same factor computed from the error in both cases. The factor is computed inline, so the state
+// doesn't have to be spilled across a function call in each step.
+void JitCompiler::compile_ode(AstBlock* node, AstScope* root_scope) {
+  const JitOdeTableau& tableau = ode->method == kOdeRK45 ? jit_ode_dopri5 : jit_ode_rk4;
+
+  uint32_t n = ode->count;
+  uint32_t var_count = n * (tableau.stages + 3);
+
+  MATHPRESSO_ASSERT(node->size() == n);
+
+  JitVar* vars = static_cast<JitVar*>(arena.alloc_reusable(Arena::aligned_size(sizeof(JitVar) * var_count)));
+  if (vars == nullptr)
+    return;
+
+  for (uint32_t i = 0; i < var_count; i++) {
+    vars[i] = JitVar();
+  }
+
+  JitVar* y = vars;
+  JitVar* stage_y = vars + n;
+  JitVar* y_next = vars + n * 2;
+  JitVar* k = vars + n * 3;
+
+  ujit::Gp steps = uc.new_gpz("steps");
+  ujit::Vec t = uc.new_vec128_f64x1();
+  ujit::Vec dt = uc.new_vec128_f64x1();
+
+  uc.load(steps, ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, steps))));
+  uc.v_loadu64_f64(t, ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, t))));
+  uc.v_loadu64_f64(dt, ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, dt))));
+
+  for (uint32_t i = 0; i < n; i++) {
+    y[i] = JitVar(uc.new_vec128_f64x1(), JitVar::FLAG_RO);
+    uc.v_loadu64_f64(y[i].vec(), ode_state_mem(i));
+  }
+
+  Label L_Loop = uc.new_label();
+  Label L_Done = uc.new_label();
+
+  if (!tableau.adaptive) {
+    uc.j(L_Done, ujit::test_z(steps));
+    uc.bind(L_Loop);
+
+    compile_ode_stages(node, root_scope, tableau, t, dt, y, stage_y, k);
+
+    // All increments are computed before the state is updated, stages can share registers with the state.
+    for (uint32_t i = 0; i < n; i++) {
+      y_next[i] = JitVar(uc.new_vec128_f64x1(), JitVar::FLAG_NONE);
+      ode_weighted_sum(y_next[i].vec(), dt, tableau.b, k, tableau.stages, i);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+      uc.s_add_f64(y[i].vec(), y[i].vec(), y_next[i].vec());
+    }
+
+    uc.s_add_f64(t, t, dt);
+    uc.j(L_Loop, ujit::sub_nz(steps, Imm(1)));
+  }
+  else {
+    ujit::Vec t_end = uc.new_vec128_f64x1();
+    ujit::Vec tolerance = uc.new_vec128_f64x1();
+
+    uc.v_loadu64_f64(t_end, ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, t_end))));
+    uc.v_loadu64_f64(tolerance, ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, tolerance))));
+
+    uc.j(L_Done, ujit::test_z(steps));
+    uc.bind(L_Loop);
+
+    ujit::Vec rem = uc.new_vec128_f64x1();
+    ujit::Vec h = uc.new_vec128_f64x1();
+    ujit::Vec last = uc.new_vec128_f64x1();
+    ujit::Vec cond = uc.new_vec128_f64x1();
+    ujit::Gp bit = uc.new_gp64("bit");
+
+    // Stop when `t_end` is reached (also when any of them is NaN).
+    uc.s_sub_f64(rem, t_end, t);
+    uc.s_cmp_gt_f64(cond, rem, get_constant_f64(0.0).op());
+    uc.v_and_f64(cond, cond, get_constant_f64_as_f64x2(1.0).op());
+    predicate_to_bit(bit, cond);
+    uc.j(L_Done, ujit::test_z(bit));
+
+    // The last step ends exactly at `t_end`.
+    uc.s_min_f64(h, dt, rem);
+    uc.s_cmp_ge_f64(last, dt, rem);
+
+    compile_ode_stages(node, root_scope, tableau, t, h, y, stage_y, k);
+
+    // Root mean square of errors of all equations relative to their tolerances.
+    ujit::Vec err = uc.new_vec128_f64x1();
+    uc.v_loadu64_f64(err, get_constant_f64(0.0).mem());
+
+    for (uint32_t i = 0; i < n; i++) {
+      ujit::Vec e = uc.new_vec128_f64x1();
+      ujit::Vec scale = uc.new_vec128_f64x1();
+      ujit::Vec tmp = uc.new_vec128_f64x1();
+
+      y_next[i] = JitVar(uc.new_vec128_f64x1(), JitVar::FLAG_NONE);
+      ode_weighted_sum(y_next[i].vec(), h, tableau.b, k, tableau.stages, i);
+      uc.s_add_f64(y_next[i].vec(), y_next[i].vec(), y[i].vec());
+      ode_weighted_sum(e, h, tableau.e, k, tableau.stages, i);
+
+      uc.s_abs_f64(scale, y[i].vec());
+      uc.s_abs_f64(tmp, y_next[i].vec());
+      uc.s_max_f64(scale, scale, tmp);
+      uc.s_add_f64(scale, scale, get_constant_f64(1.0).op());
+      uc.s_mul_f64(scale, scale, tolerance);
+
+      uc.s_div_f64(e, e, scale);
+      uc.s_mul_f64(e, e, e);
+      uc.s_add_f64(err, err, e);
+    }
+
+    uc.s_mul_f64(err, err, get_constant_f64(1.0 / double(n)).op());
+    uc.s_sqrt_f64(err, err);
+
+    // Accept the step if the error doesn't exceed the tolerance (NaN error rejects it).
+    ujit::Vec accept = uc.new_vec128_f64x1();
+    ujit::Vec t_next = uc.new_vec128_f64x1();
+
+    uc.s_cmp_le_f64(accept, err, get_constant_f64(1.0).op());
+
+    for (uint32_t i = 0; i < n; i++) {
+      select_f64(y[i].vec(), accept, y_next[i].vec(), y[i].vec());
+    }
+
+    uc.s_add_f64(t_next, t, h);
+    select_f64(t_next, last, t_end, t_next);
+    select_f64(t, accept, t_next, t);
+
+    // The next step (or the step to repeat) is `h * 0.9 / err^(1/4)` limited to [0.2, 5] - the safety factor makes
+    // the next step likely to be accepted. The exponent is 1/4 instead of 1/5 of the fourth order error estimate as
+    // two square roots are cheaper than `pow()`, it only makes the step change faster. NaN error (like when the state
+    // overflowed) reduces the step the most.
+    ujit::Vec factor = uc.new_vec128_f64x1();
+    ujit::Vec valid = uc.new_vec128_f64x1();
+    ujit::Vec tmp = uc.new_vec128_f64x1();
+
+    uc.s_sqrt_f64(tmp, err);
+    uc.s_sqrt_f64(tmp, tmp);
+    uc.v_loada64_f64(factor, get_constant_f64(0.9).mem());
+    uc.s_div_f64(factor, factor, tmp);
+    uc.s_min_f64(factor, factor, get_constant_f64(5.0).op());
+    uc.s_max_f64(factor, factor, get_constant_f64(0.2).op());
+
+    uc.s_cmp_ge_f64(valid, err, get_constant_f64(0.0).op());
+    uc.v_loada64_f64(tmp, get_constant_f64(0.2).mem());
+    select_f64(factor, valid, factor, tmp);
+    uc.s_mul_f64(dt, h, factor);
+
+    uc.j(L_Loop, ujit::sub_nz(steps, Imm(1)));
+  }
+
+  uc.bind(L_Done);
+
+  for (uint32_t i = 0; i < n; i++) {
+    uc.v_storeu64_f64(ode_state_mem(i), y[i].vec());
+  }
+
+  uc.v_storeu64_f64(ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, t))), t);
+  uc.v_storeu64_f64(ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, dt))), dt);
+  uc.store(ujit::mem_ptr(result_ptr, int32_t(offsetof(OdeIntegration, steps))), steps);
+
+  arena.free_reusable(vars, sizeof(JitVar) * var_count);
+}
+
+// Compiles all stages of a step of the length `h` starting at `t` and the state `y`. Derivatives of the equation `i`
+// computed by the stage `s` are stored to `k[s * n + i]`.
+void JitCompiler::compile_ode_stages(AstBlock* node, AstScope* root_scope, const JitOdeTableau& tableau, const ujit::Vec& t, const ujit::Vec& h, const JitVar* y, JitVar* stage_y, JitVar* k) {
+  uint32_t n = ode->count;
+
+  for (uint32_t s = 0; s < tableau.stages; s++) {
+    ujit::Vec stage_t = t;
+
+    if (tableau.c[s] != 0.0) {
+      stage_t = uc.new_vec128_f64x1();
+      uc.s_mul_f64(stage_t, h, get_constant_f64(tableau.c[s]).op());
+      uc.s_add_f64(stage_t, stage_t, t);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+      if (s == 0) {
+        stage_y[i] = y[i];
+      }
+      else {
+        ujit::Vec v = uc.new_vec128_f64x1();
+        ode_weighted_sum(v, h, tableau.a[s], k, s, i);
+        uc.s_add_f64(v, v, y[i].vec());
+        stage_y[i] = JitVar(v, JitVar::FLAG_RO);
+      }
+    }
+
+    // Right-hand sides see the state of the stage, other global variables are read from memory again.
+    for (uint32_t i = 0; i < num_slots; i++) {
+      var_slots[i] = JitVar();
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+      var_slots[ode->state[i]->var_slot_id()] = stage_y[i];
+    }
+
+    if (ode->time)
+      var_slots[ode->time->var_slot_id()] = JitVar(stage_t, JitVar::FLAG_RO);
+
+    for (uint32_t i = 0; i < n; i++) {
+      JitVar result = on_node(node->child_at(i));
+      if (result.is_none())
+        result = get_constant_f64(mp_get_nan());
+      k[s * n + i] = register_var(result);
+    }
+
+    store_altered(root_scope);
+  }
+}
+
+// Computes `dst = h * sum(weights[j] * k[j])` of the equation `index` over `stages` - stages of zero weights are
+// skipped.
+void JitCompiler::ode_weighted_sum(const ujit::Vec& dst, const ujit::Vec& h, const double* weights, const JitVar* k, uint32_t stages, uint32_t index) {
+  uint32_t n = ode->count;
+  bool first = true;
+
+  for (uint32_t j = 0; j < stages; j++) {
+    if (weights[j] == 0.0)
+      continue;
+
+    if (first) {
+      uc.s_mul_f64(dst, k[j * n + index].vec(), get_constant_f64(weights[j]).op());
+      first = false;
+    }
+    else {
+      ujit::Vec term = uc.new_vec128_f64x1();
+      uc.s_mul_f64(term, k[j * n + index].vec(), get_constant_f64(weights[j]).op());
+      uc.s_add_f64(dst, dst, term);
+    }
+  }
+
+  if (first)
+    uc.v_loadu64_f64(dst, get_constant_f64(0.0).mem());
+  else
+    uc.s_mul_f64(dst, dst, h);
+}
+
+ujit::Mem JitCompiler::ode_state_mem(uint32_t index) {
+  AstSymbol* sym = ode->state[index];
+  return ujit::mem_ptr(base_ptr(sym->var_base()), sym->var_offset());
+}
+
+// Computes `dst = mask ? a : b` - the mask is all ones or zeros (a result of a comparison).
+void JitCompiler::select_f64(const ujit::Vec& dst, const ujit::Vec& mask, const ujit::Vec& a, const ujit::Vec& b) {
+  ujit::Vec tmp = uc.new_vec128_f64x1();
+
+  uc.v_and_f64(tmp, mask, a);
+  uc.v_andn_f64(dst, mask, b);
+  uc.v_or_f64(dst, dst, tmp);
+}
+
+void JitCompiler::inline_invoke(const ujit::Vec& dst, const ujit::Vec* args, uint32_t count, void* fn) {
+  uint32_t i;
+
+  // Use function builder to build a function prototype.
+  FuncSignature signature;
+  signature.set_ret_t<double>();
+
+  for (i = 0; i < count; i++) {
+    signature.add_arg_t<double>();
+  }
+
+  // Create the function call.
+  InvokeNode* invoke_node;
+
+#if defined(ASMJIT_UJIT_AARCH64)
+  ujit::Gp func_ptr = uc.new_gp_ptr("func_ptr");
+  uc.mov(func_ptr, (uint64_t)fn);
+  uc.cc->invoke(asmjit::Out(invoke_node), func_ptr, signature);
+#else
+  uc.cc->invoke(asmjit::Out(invoke_node), (uint64_t)fn, signature);
+#endif
+  invoke_node->set_ret(0, dst);
+
+  for (i = 0; i < count; i++) {
+    invoke_node->set_arg(i, args[i]);
+  }
+}
+
+// Calls an interval operator (see `interval_func_by_op()`), which stores its result to `result_ptr` - the result of
+// the function isn't stored until the whole program is evaluated, so it's used as a scratch space. Each interval
+// argument is passed as two doubles (`lo` in the low lane of `args[i]`, `hi` swapped from its high lane).
+void JitCompiler::interval_invoke(const ujit::Vec& dst, const ujit::Vec* args, uint32_t count, void* fn) {
+  uint32_t i;
+  ujit::Vec hi[2];
+  MATHPRESSO_ASSERT(count <= 2);
+
+  FuncSignature signature;
+  signature.add_arg_t<double*>();
+
+  for (i = 0; i < count; i++) {
+    hi[i] = uc.new_vec128_f64x1();
+    uc.v_swap_f64(hi[i], args[i]);
+
+    signature.add_arg_t<double>();
+    signature.add_arg_t<double>();
+  }
+
+  InvokeNode* invoke_node;
+
+#if defined(ASMJIT_UJIT_AARCH64)
+  ujit::Gp func_ptr = uc.new_gp_ptr("func_ptr");
+  uc.mov(func_ptr, (uint64_t)fn);
+  uc.cc->invoke(asmjit::Out(invoke_node), func_ptr, signature);
+#else
+  uc.cc->invoke(asmjit::Out(invoke_node), (uint64_t)fn, signature);
+#endif
+  invoke_node->set_arg(0, result_ptr);
+
+  for (i = 0; i < count; i++) {
+    invoke_node->set_arg(1 + i * 2, args[i]);
+    invoke_node->set_arg(2 + i * 2, hi[i]);
+  }
+
+  uc.v_loadu128_f64(dst, ujit::mem_ptr(result_ptr));
+}
+
+void JitCompiler::prepare_const_pool() {
+  if (!const_pool) {
+    uc.cc->new_const_pool_node(asmjit::Out(const_pool));
+  }
+}
+
+JitVar JitCompiler::get_constant_u64(uint64_t value) {
+  prepare_const_pool();
+
+  size_t offset;
+  if (const_pool->add(&value, sizeof(uint64_t), asmjit::Out(offset)) != asmjit::Error::kOk)
+    return JitVar();
+
+  return JitVar(ujit::mem_ptr(const_pool->label(), static_cast<int>(offset)), JitVar::FLAG_NONE);
+}
+
+JitVar JitCompiler::get_constant_u64_as_f64x2(uint64_t value) {
+  prepare_const_pool();
+
+  uint64_t data[2] = { value, 0 };
+  size_t offset;
+
+  if (const_pool->add(data, sizeof(data), asmjit::Out(offset)) != asmjit::Error::kOk)
+    return JitVar();
+
+  return JitVar(ujit::mem_ptr(const_pool->label(), static_cast<int>(offset)), JitVar::FLAG_NONE);
+}
 
 JitVar JitCompiler::get_constant_u64_aligned(uint64_t value) {
   prepare_const_pool();
@@ -639,7 +2534,19 @@ JitVar JitCompiler::get_constant_f64_aligned(double value) {
   return get_constant_u64_aligned(bits.u);
 }
 
-CompiledFunc compile_function(AstBuilder* ast, [[maybe_unused]] uint32_t options, OutputLog* log) {
+JitVar JitCompiler::get_constant_interval(double lo, double hi) {
+  prepare_const_pool();
+
+  double data[2] = { lo, hi };
+  size_t offset;
+
+  if (const_pool->add(data, sizeof(data), asmjit::Out(offset)) != asmjit::Error::kOk)
+    return JitVar();
+
+  return JitVar(ujit::mem_ptr(const_pool->label(), static_cast<int>(offset)), JitVar::FLAG_NONE);
+}
+
+void* compile_function(AstBuilder* ast, uint32_t func_type, uint32_t options, OutputLog* log, const JitGradient* gradient, const JitOde* ode, JitConditions* conditions) {
   StringLogger logger;
   CpuFeatures features = jit_global.runtime.cpu_features();
 
@@ -679,7 +2586,7 @@ CompiledFunc compile_function(AstBuilder* ast, [[maybe_unused]] uint32_t options
   }
 
   {
-    JitCompiler jit_compiler(ast->arena(), cc, features, CpuInfo::recalculate_hints(CpuInfo::host(), features));
+    JitCompiler jit_compiler(ast->arena(), cc, features, CpuInfo::recalculate_hints(CpuInfo::host(), features), func_type, options, gradient, ode, conditions);
     jit_compiler.begin_function();
     jit_compiler.compile(ast->program_node(), ast->root_scope(), ast->_num_slots);
     jit_compiler.end_function();
@@ -689,7 +2596,7 @@ CompiledFunc compile_function(AstBuilder* ast, [[maybe_unused]] uint32_t options
     return nullptr;
   }
 
-  CompiledFunc fn;
+  void* fn;
   if (jit_global.runtime.add(&fn, &code) != asmjit::Error::kOk) {
     return nullptr;
   }
@@ -13,7 +13,129 @@
 
 namespace mathpresso {
 
-MATHPRESSO_NOAPI CompiledFunc compile_function(AstBuilder* ast, uint32_t options, OutputLog* log);
+// MathPresso - JIT Function Type
+// ==============================
+
+//! \internal
+//!
+//! Type of the function generated by `compile_function()`.
+enum JitFuncType {
+  //! Evaluates a single row, see \ref CompiledFunc.
+  kJitFuncScalar = 0,
+  //! Evaluates `count` rows in a loop, see \ref ArrayFunc.
+  kJitFuncArray,
+  //! The same as \ref kJitFuncArray, but uses non-temporal stores to store results.
+  kJitFuncArrayStream,
+  //! Evaluates `count` rows in a loop and accumulates their results, see \ref ReduceState.
+  kJitFuncReduce,
+  //! Evaluates `count` rows in a loop as a predicate and stores a bit per row (`count` must be a multiple of 64).
+  kJitFuncBitmap,
+  //! Evaluates `count` rows selected by indexes in a loop, see \ref GatherFunc.
+  kJitFuncGather,
+  //! Evaluates a single row and partial derivatives of its result, see \ref JitGradient.
+  kJitFuncGradient,
+  //! Evaluates a single row over intervals, see \ref kOptionInterval.
+  //!
+  //! The function has the same prototype as \ref CompiledFunc, but each variable at offset `o` is an \ref Interval
+  //! at `data + o * 2` and the result is an \ref Interval. The result is also used as a scratch space by operators.
+  kJitFuncInterval,
+  //! Integrates a system of ordinary differential equations, see \ref JitOde.
+  kJitFuncOde,
+  //! Evaluates a single row like \ref kJitFuncScalar and counts outcomes of comparisons, see \ref JitConditions.
+  kJitFuncProfile,
+
+  //! Count of function types.
+  kJitFuncCount
+};
+
+//! \internal
+//!
+//! Prototype of a \ref kJitFuncArray function - evaluates `count` rows starting at `data` (separated by `stride`
+//! bytes) and stores their results to `results`.
+//!
+//! A \ref kJitFuncReduce function has the same prototype, but `results` points to \ref ReduceState, which is
+//! updated by the function, so a reduction can be split to multiple calls. A \ref kJitFuncBitmap function stores
+//! `count / 64` 64-bit words to `results`.
+typedef void (*ArrayFunc)(double* results, void* data, void* const* bases, size_t stride, size_t count);
+
+//! \internal
+//!
+//! Prototype of a \ref kJitFuncGather function - like \ref ArrayFunc, but the row `i` starts at
+//! `data + indices[i] * stride`.
+typedef void (*GatherFunc)(double* results, void* data, void* const* bases, size_t stride, size_t count, const uint32_t* indices);
+
+//! \internal
+//!
+//! Indexes of accumulators passed to a \ref kJitFuncReduce function. Results that are NaN are skipped.
+enum ReduceState {
+  //! Sum of results.
+  kReduceSum = 0,
+  //! Compensation of `kReduceSum` (only used by Kahan summation, see \ref kOptionKahanSum).
+  kReduceSumComp,
+  //! Minimum of results (starts at INF).
+  kReduceMin,
+  //! Maximum of results (starts at -INF).
+  kReduceMax,
+  //! Number of results (as double).
+  kReduceCount,
+
+  //! Count of accumulators.
+  kReduceStateSize
+};
+
+//! \internal
+//!
+//! Variables a \ref kJitFuncGradient function differentiates the result with respect to.
+//!
+//! The function has the same prototype as \ref CompiledFunc, the partial derivative with respect to `symbols[i]`
+//! is stored to `data + offsets[i]`. Symbols that are null (variables not referenced by the program) get zero.
+struct JitGradient {
+  AstSymbol** symbols;
+  const int* offsets;
+  uint32_t count;
+};
+
+//! \internal
+//!
+//! System of ordinary differential equations integrated by a \ref kJitFuncOde function.
+//!
+//! The program node has a child program per equation, which computes the derivative of `state[i]`. The function has
+//! the prototype of \ref OdeFunc.
+struct JitOde {
+  //! State variables (symbols of the root scope).
+  AstSymbol** state;
+  //! Time variable (or null).
+  AstSymbol* time;
+  //! Number of equations.
+  uint32_t count;
+  //! Integration method, see \ref OdeMethod.
+  uint32_t method;
+};
+
+//! \internal
+//!
+//! Comparisons counted by a \ref kJitFuncProfile function.
+//!
+//! The function has the same prototype as \ref CompiledFunc. Comparisons are numbered in the order they are compiled
+//! and their positions are stored to `positions`. Each evaluation of comparison `i` adds 1 to `counters[i * 2]` and
+//! its result (0 or 1) to `counters[i * 2 + 1]` - the address of `counters` is embedded in the function.
+struct JitConditions {
+  //! Two counters per comparison.
+  double* counters;
+  //! Source code positions of comparisons.
+  uint32_t* positions;
+  //! Number of comparisons `counters` and `positions` have space for.
+  uint32_t capacity;
+  //! Number of compiled comparisons.
+  uint32_t count;
+};
+
+//! \internal
+//!
+//! Prototype of a \ref kJitFuncOde function.
+typedef void (*OdeFunc)(OdeIntegration* ode, void* data, void* const* bases);
+
+MATHPRESSO_NOAPI void* compile_function(AstBuilder* ast, uint32_t func_type, uint32_t options, OutputLog* log, const JitGradient* gradient = nullptr, const JitOde* ode = nullptr, JitConditions* conditions = nullptr);
 MATHPRESSO_NOAPI void free_compiled_function(void* fn);
 
 } // {mathpresso}
@@ -0,0 +1,338 @@
+// [MathPresso]
+// Mathematical Expression Parser and JIT Compiler.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define MATHPRESSO_BUILD_EXPORT
+
+// [Dependencies]
+#include "./mpeval_p.h"
+#include "./mphash_p.h"
+#include "./mpcse_p.h"
+
+namespace mathpresso {
+
+// MathPresso - CseBlock - Utilities
+// =================================
+
+static uint32_t cse_count_nodes(AstNode* node) {
+  uint32_t n = 1;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      n += cse_count_nodes(child);
+  }
+  return n;
+}
+
+// Get whether the value is numbered - it's a variable, an immediate, or it can be shared.
+static MATHPRESSO_INLINE bool cse_is_numbered(const CseValue& v) {
+  return v.node->is_var() || v.node->is_imm() || (v.flags & kCseValueShareable) != 0;
+}
+
+static uint32_t cse_hash(const CseValue& v, const uint32_t* call_args) {
+  AstNode* node = v.node;
+  uint32_t h = node->node_type() * 31u + node->op_type();
+
+  if (node->node_type() == kAstNodeCall) {
+    h = h * 65599u + HashUtils::hash_pointer(static_cast<AstCall*>(node)->symbol());
+    for (uint32_t i = 0; i < v.args[1]; i++)
+      h = h * 65599u + call_args[v.args[0] + i];
+    return h;
+  }
+
+  h = h * 65599u + v.args[0];
+  h = h * 65599u + v.args[1];
+  h = h * 65599u + v.version;
+
+  switch (node->node_type()) {
+    case kAstNodeImm: {
+      uint64_t bits = DoubleBits::from_double(static_cast<AstImm*>(node)->value()).u;
+      h = h * 65599u + static_cast<uint32_t>(bits ^ (bits >> 32));
+      break;
+    }
+
+    case kAstNodeVar:
+      h = h * 65599u + HashUtils::hash_pointer(static_cast<AstVar*>(node)->symbol());
+      break;
+
+    case kAstNodeIndex:
+      h = h * 65599u + HashUtils::hash_pointer(static_cast<AstIndex*>(node)->symbol());
+      break;
+  }
+
+  return h;
+}
+
+static bool cse_equals(const CseValue& a, const CseValue& b, const uint32_t* call_args) {
+  AstNode* a_node = a.node;
+  AstNode* b_node = b.node;
+
+  if (a_node->node_type() != b_node->node_type() || a_node->op_type() != b_node->op_type())
+    return false;
+
+  // Arguments of calls are compared by their numbers, which are stored separately.
+  if (a_node->node_type() == kAstNodeCall) {
+    if (static_cast<AstCall*>(a_node)->symbol() != static_cast<AstCall*>(b_node)->symbol() || a.args[1] != b.args[1])
+      return false;
+
+    for (uint32_t i = 0; i < a.args[1]; i++) {
+      if (call_args[a.args[0] + i] != call_args[b.args[0] + i])
+        return false;
+    }
+    return true;
+  }
+
+  if (a.args[0] != b.args[0] || a.args[1] != b.args[1] || a.version != b.version)
+    return false;
+
+  switch (a_node->node_type()) {
+    // Compared bitwise, so -0 and 0 differ and NaNs are equal.
+    case kAstNodeImm:
+      return DoubleBits::from_double(static_cast<AstImm*>(a_node)->value()).u ==
+             DoubleBits::from_double(static_cast<AstImm*>(b_node)->value()).u;
+
+    case kAstNodeVar:
+      return static_cast<AstVar*>(a_node)->symbol() == static_cast<AstVar*>(b_node)->symbol();
+
+    case kAstNodeIndex:
+      return static_cast<AstIndex*>(a_node)->symbol() == static_cast<AstIndex*>(b_node)->symbol();
+
+    default:
+      return true;
+  }
+}
+
+// MathPresso - CseBlock
+// ====================
+
+CseBlock::CseBlock(AstBuilder* ast)
+  : _ast(ast),
+    _values(nullptr),
+    _size(0),
+    _capacity(0),
+    _call_args(nullptr),
+    _call_args_size(0),
+    _buckets(nullptr),
+    _buckets_mask(0),
+    _versions(nullptr),
+    _num_slots(0),
+    _serial(0),
+    _statement_serial(0) {}
+
+CseBlock::~CseBlock() {
+  Arena& arena = _ast->arena();
+
+  if (_values)
+    arena.free_reusable(_values, Arena::aligned_size(_capacity * sizeof(CseValue)));
+  if (_call_args)
+    arena.free_reusable(_call_args, Arena::aligned_size(_capacity * sizeof(uint32_t)));
+  if (_buckets)
+    arena.free_reusable(_buckets, Arena::aligned_size((size_t(_buckets_mask) + 1) * sizeof(uint32_t)));
+  if (_versions)
+    arena.free_reusable(_versions, Arena::aligned_size((size_t(_num_slots) + 1) * sizeof(uint32_t)));
+}
+
+Error CseBlock::build(AstBlock* block) {
+  MATHPRESSO_ASSERT(_values == nullptr);
+
+  uint32_t i, size = block->size();
+  uint32_t capacity = 0;
+
+  for (i = 0; i < size; i++)
+    capacity += cse_count_nodes(block->child_at(i));
+
+  if (capacity == 0)
+    return kErrorOk;
+
+  // The hash table is at most half full.
+  uint32_t buckets_count = 16;
+  while (buckets_count < capacity * 2)
+    buckets_count *= 2;
+
+  Arena& arena = _ast->arena();
+
+  _values = static_cast<CseValue*>(arena.alloc_reusable(Arena::aligned_size(capacity * sizeof(CseValue))));
+  MATHPRESSO_NULLCHECK(_values);
+  _capacity = capacity;
+
+  // Each argument is a node, so there are less arguments than nodes.
+  _call_args = static_cast<uint32_t*>(arena.alloc_reusable(Arena::aligned_size(capacity * sizeof(uint32_t))));
+  MATHPRESSO_NULLCHECK(_call_args);
+
+  _buckets = static_cast<uint32_t*>(arena.alloc_reusable(Arena::aligned_size(buckets_count * sizeof(uint32_t))));
+  MATHPRESSO_NULLCHECK(_buckets);
+  _buckets_mask = buckets_count - 1;
+
+  _num_slots = _ast->_num_slots;
+  _versions = static_cast<uint32_t*>(arena.alloc_reusable(Arena::aligned_size((size_t(_num_slots) + 1) * sizeof(uint32_t))));
+  MATHPRESSO_NULLCHECK(_versions);
+
+  ::memset(_buckets, 0, buckets_count * sizeof(uint32_t));
+  ::memset(_versions, 0, (size_t(_num_slots) + 1) * sizeof(uint32_t));
+
+  for (i = 0; i < size; i++) {
+    AstNode* node = block->child_at(i);
+    _statement_serial = _serial;
+
+    switch (node->node_type()) {
+      case kAstNodeProgram:
+      case kAstNodeBlock:
+      case kAstNodeRepeat:
+        store_all(node);
+        break;
+
+      default:
+        number_node(node);
+        break;
+    }
+  }
+
+  return kErrorOk;
+}
+
+uint32_t CseBlock::number_node(AstNode* node) {
+  uint32_t begin = _size;
+
+  switch (node->node_type()) {
+    case kAstNodeImm:
+      return add_value(node, begin, kCseValueStable, kCseInvalid, kCseInvalid, 0);
+
+    case kAstNodeVar: {
+      uint32_t slot_id = static_cast<AstVar*>(node)->symbol()->var_slot_id();
+      uint32_t version = slot_id < _num_slots ? _versions[slot_id] : 0;
+      return add_value(node, begin, version <= _statement_serial ? kCseValueStable : 0, kCseInvalid, kCseInvalid, version);
+    }
+
+    case kAstNodeIndex:
+    case kAstNodeUnaryOp: {
+      const CseValue& a = _values[number_node(static_cast<AstUnary*>(node)->child())];
+      return add_value(node, begin, kCseValueShareable | (a.flags & kCseValueStable), a.number, kCseInvalid, 0);
+    }
+
+    case kAstNodeBinaryOp: {
+      AstBinaryOp* binary = static_cast<AstBinaryOp*>(node);
+
+      // The assigned variable is not read - a store creates a new version of it after its value is computed.
+      if (OpInfo::get(binary->op_type()).is_assignment()) {
+        number_node(binary->right());
+        store(static_cast<AstVar*>(binary->left())->symbol());
+        return add_value(node, begin, 0, kCseInvalid, kCseInvalid, 0);
+      }
+
+      uint32_t a_index = number_node(binary->left());
+      uint32_t b_index = number_node(binary->right());
+
+      const CseValue& a = _values[a_index];
+      const CseValue& b = _values[b_index];
+      return add_value(node, begin, kCseValueShareable | (a.flags & b.flags & kCseValueStable), a.number, b.number, 0);
+    }
+
+    case kAstNodeVarDecl: {
+      AstVarDecl* decl = static_cast<AstVarDecl*>(node);
+      if (decl->child())
+        number_node(decl->child());
+
+      store(decl->symbol());
+      return add_value(node, begin, 0, kCseInvalid, kCseInvalid, 0);
+    }
+
+    // A call of a function added with `kFunctionNoSideEffects` is shared like an operator.
+    case kAstNodeCall: {
+      uint32_t i, size = node->size();
+      uint32_t args_index = _call_args_size;
+      uint32_t flags = kCseValueStable;
+
+      MATHPRESSO_ASSERT(_call_args_size + size <= _capacity);
+      _call_args_size += size;
+
+      for (i = 0; i < size; i++) {
+        const CseValue& a = _values[number_node(node->child_at(i))];
+        _call_args[args_index + i] = a.number;
+        flags &= a.flags;
+      }
+
+      if (static_cast<AstCall*>(node)->symbol()->has_symbol_flag(kAstSymbolIsPure))
+        flags |= kCseValueShareable;
+      else
+        flags = 0;
+
+      return add_value(node, begin, flags, args_index, size, 0);
+    }
+
+    default:
+      store_all(node);
+      return add_value(node, begin, 0, kCseInvalid, kCseInvalid, 0);
+  }
+}
+
+uint32_t CseBlock::add_value(AstNode* node, uint32_t begin, uint32_t flags, uint32_t arg0, uint32_t arg1, uint32_t version) {
+  MATHPRESSO_ASSERT(_size < _capacity);
+
+  uint32_t index = _size++;
+  CseValue& v = _values[index];
+
+  v.node = node;
+  v.args[0] = arg0;
+  v.args[1] = arg1;
+  v.version = version;
+  v.number = index;
+  v.next = kCseInvalid;
+  v.last = index;
+  v.size = _size - begin;
+  v.flags = flags;
+
+  if (!cse_is_numbered(v))
+    return index;
+
+  uint32_t bucket = cse_hash(v, _call_args) & _buckets_mask;
+  for (;;) {
+    uint32_t n = _buckets[bucket];
+
+    if (n == 0) {
+      _buckets[bucket] = index + 1;
+      return index;
+    }
+
+    CseValue& first = _values[n - 1];
+    if (cse_equals(first, v, _call_args)) {
+      v.number = n - 1;
+      _values[first.last].next = index;
+      first.last = index;
+      return index;
+    }
+
+    bucket = (bucket + 1) & _buckets_mask;
+  }
+}
+
+void CseBlock::store(AstSymbol* sym) {
+  uint32_t slot_id = sym->var_slot_id();
+  if (slot_id < _num_slots)
+    _versions[slot_id] = ++_serial;
+}
+
+// Creates new versions of all variables assigned by `node`, which is not numbered.
+void CseBlock::store_all(AstNode* node) {
+  if (node->node_type() == kAstNodeVarDecl)
+    store(static_cast<AstVarDecl*>(node)->symbol());
+
+  if (node->node_type() == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment())
+    store(static_cast<AstVar*>(static_cast<AstBinaryOp*>(node)->left())->symbol());
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      store_all(child);
+  }
+}
+
+void CseBlock::mark_deleted(uint32_t index) {
+  uint32_t size = _values[index].size;
+  for (uint32_t i = index + 1 - size; i <= index; i++)
+    _values[i].node = nullptr;
+}
+
+} // {mathpresso}
@@ -0,0 +1,131 @@
+// [MathPresso]
+// Mathematical Expression Parser and JIT Compiler.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _MATHPRESSO_MPCSE_P_H
+#define _MATHPRESSO_MPCSE_P_H
+
+// [Dependencies]
+#include "./mpast_p.h"
+
+namespace mathpresso {
+
+// MathPresso - CseValue
+// =====================
+
+//! \internal
+//!
+//! Flags of \ref CseValue.
+enum CseValueFlags {
+  //! The value is an operator (or a call of a function added with `kFunctionNoSideEffects`), so values of the same
+  //! number can share a single evaluation.
+  kCseValueShareable = 0x01,
+  //! The value only reads variables stored before its statement, so it can be evaluated before the statement.
+  kCseValueStable = 0x02
+};
+
+//! \internal
+//!
+//! Value of \ref CseBlock - a node of the AST and the number of values it's equal to.
+//!
+//! Values are stored in post-order, so operands of a value precede it and values of its subtree are `size` values
+//! ending at it. Each store creates a new version of a variable and reads are versioned, so values that have the same
+//! operator and operands (compared by their numbers) compute the same result.
+struct CseValue {
+  //! AST node of the value (null if the node was deleted).
+  AstNode* node;
+  //! Value numbers of operands of unary and binary operators and indexes. Calls store the index of numbers of their
+  //! arguments in `CseBlock::_call_args` and their count instead.
+  uint32_t args[2];
+  //! Version of the variable read (only variables).
+  uint32_t version;
+  //! Value number - index of the first value that is equal to this one.
+  uint32_t number;
+  //! Index of the next value of the same number or `kCseInvalid`.
+  uint32_t next;
+  //! Index of the last value of the same number (only valid if the value is the first one).
+  uint32_t last;
+  //! Number of values of the subtree of the value (including itself).
+  uint32_t size;
+  //! Flags, see \ref CseValueFlags.
+  uint32_t flags;
+};
+
+//! \internal
+//!
+//! Invalid index of \ref CseValue.
+static constexpr uint32_t kCseInvalid = 0xFFFFFFFFu;
+
+// MathPresso - CseBlock
+// =====================
+
+//! \internal
+//!
+//! Value numbering of statements of a block, used by `AstOptimizer::eliminate_common_subexpressions()`.
+//!
+//! Nodes are numbered into a flat array of values, see \ref CseValue, which makes finding equal values a linear pass
+//! instead of comparing subtrees. It's only a lookup table of the pass - the AST stays the only representation that
+//! passes transform and the JIT compiles, so the table is built for each block the pass visits and then discarded.
+//! Nested blocks (and bodies of loops) are not numbered, they are opaque statements that create new versions of all
+//! variables they assign.
+struct CseBlock {
+  MATHPRESSO_NONCOPYABLE(CseBlock)
+
+  // Members
+  // -------
+
+  AstBuilder* _ast;
+
+  CseValue* _values;
+  uint32_t _size;
+  uint32_t _capacity;
+
+  //! Value numbers of arguments of calls, see \ref CseValue::args.
+  uint32_t* _call_args;
+  uint32_t _call_args_size;
+
+  //! Hash table of value numbers (indexes of values + 1, zero is an empty bucket).
+  uint32_t* _buckets;
+  uint32_t _buckets_mask;
+
+  //! Serial number of the last store of each variable slot (its version).
+  uint32_t* _versions;
+  uint32_t _num_slots;
+  uint32_t _serial;
+  //! Serial number of the last store before the current statement.
+  uint32_t _statement_serial;
+
+  // Construction & Destruction
+  // --------------------------
+
+  CseBlock(AstBuilder* ast);
+  ~CseBlock();
+
+  // Accessors
+  // ---------
+
+  MATHPRESSO_INLINE uint32_t size() const { return _size; }
+  MATHPRESSO_INLINE CseValue& value_at(uint32_t index) { return _values[index]; }
+
+  // Numbering
+  // ---------
+
+  //! Number statements of `block` - it can be only called once.
+  Error build(AstBlock* block);
+
+  uint32_t number_node(AstNode* node);
+  uint32_t add_value(AstNode* node, uint32_t begin, uint32_t flags, uint32_t arg0, uint32_t arg1, uint32_t version);
+  void store(AstSymbol* sym);
+  void store_all(AstNode* node);
+
+  //! Mark values of the subtree of the value at `index` as deleted.
+  void mark_deleted(uint32_t index);
+};
+
+} // {mathpresso}
+
+// [Guard]
+#endif // _MATHPRESSO_MPCSE_P_H
@@ -0,0 +1,777 @@
+// [MathPresso]
+// Mathematical Expression Parser and JIT Compiler.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define MATHPRESSO_BUILD_EXPORT
+
+// [Dependencies]
+#include "./mpeval_p.h"
+#include "./mpinterval_p.h"
+
+namespace mathpresso {
+
+// MathPresso - Interval Utilities
+// ===============================
+
+//! Maximum error of libm functions (in units in the last place) results of the functions are widened by.
+static constexpr int kIntervalLibmUlps = 2;
+
+//! Periodic functions of arguments greater than this (in magnitude) are not reduced, their range is returned.
+static constexpr double kIntervalTrigLimit = 1048576.0;
+
+static constexpr double kIntervalPi = 3.14159265358979323846;
+
+static MATHPRESSO_INLINE double mp_min2(double a, double b) { return a < b ? a : b; }
+static MATHPRESSO_INLINE double mp_max2(double a, double b) { return a > b ? a : b; }
+
+static MATHPRESSO_INLINE double mp_min4(double a, double b, double c, double d) { return mp_min2(mp_min2(a, b), mp_min2(c, d)); }
+static MATHPRESSO_INLINE double mp_max4(double a, double b, double c, double d) { return mp_max2(mp_max2(a, b), mp_max2(c, d)); }
+
+static MATHPRESSO_INLINE bool mp_interval_is_empty(double lo, double hi) { return !(lo <= hi); }
+
+static MATHPRESSO_INLINE void mp_interval_store(double* out, double lo, double hi) {
+  out[0] = lo;
+  out[1] = hi;
+}
+
+static MATHPRESSO_INLINE void mp_interval_store_empty(double* out) {
+  mp_interval_store(out, mp_get_nan(), mp_get_nan());
+}
+
+static MATHPRESSO_INLINE void mp_interval_store_entire(double* out) {
+  mp_interval_store(out, -mp_get_inf(), mp_get_inf());
+}
+
+//! Decodes an interval that may contain NaN (see \ref interval_func_by_op()) - swaps its bounds to `lo <= hi` and
+//! returns true if they were swapped. Empty intervals are kept as is.
+static MATHPRESSO_INLINE bool mp_interval_decode(double& lo, double& hi) {
+  if (!(lo > hi))
+    return false;
+
+  double t = lo;
+  lo = hi;
+  hi = t;
+  return true;
+}
+
+//! Marks the result stored to `out` as an interval that may also contain NaN by swapping its bounds. A point is
+//! widened by 1 ulp first, as its swapped bounds would be the same. Empty and already marked results are kept.
+static void mp_interval_add_nan(double* out) {
+  double lo = out[0];
+  double hi = out[1];
+
+  if (lo < hi)
+    mp_interval_store(out, hi, lo);
+  else if (lo == hi && lo > -mp_get_inf())
+    mp_interval_store(out, lo, ::nextafter(lo, -mp_get_inf()));
+  else if (lo == hi)
+    mp_interval_store(out, ::nextafter(lo, mp_get_inf()), lo);
+}
+
+//! Get whether `[lo, hi]` contains zero.
+static MATHPRESSO_INLINE bool mp_interval_has_zero(double lo, double hi) { return lo <= 0.0 && hi >= 0.0; }
+
+//! Get whether `[lo, hi]` contains an infinity.
+static MATHPRESSO_INLINE bool mp_interval_has_inf(double lo, double hi) { return lo == -mp_get_inf() || hi == mp_get_inf(); }
+
+//! Decodes an operand of a condition. Returns whether it has points that are not NaN and sets `nan` if it has a NaN
+//! point - an empty operand is the result of an operation that is NaN for all points.
+static MATHPRESSO_INLINE bool mp_interval_condition_arg(double& lo, double& hi, bool& nan) {
+  nan = mp_interval_decode(lo, hi);
+  if (mp_interval_is_empty(lo, hi)) {
+    nan = true;
+    return false;
+  }
+  return true;
+}
+
+//! Stores `[lo, hi]` widened by `ulps` units in the last place, which encloses results of operations that are not
+//! exact. Correctly rounded operations (`+`, `-`, `*`, `/`, and `sqrt`) need 1 ulp.
+static void mp_interval_store_outward(double* out, double lo, double hi, int ulps) {
+  // A NaN bound means that some points don't have a non-NaN result, the others are unbounded.
+  if (lo != lo) lo = -mp_get_inf();
+  if (hi != hi) hi = mp_get_inf();
+
+  for (int i = 0; i < ulps; i++) {
+    lo = ::nextafter(lo, -mp_get_inf());
+    hi = ::nextafter(hi, mp_get_inf());
+  }
+
+  mp_interval_store(out, lo, hi);
+}
+
+//! Stores a result of a condition, which is `[0, 0]`, `[1, 1]`, or `[0, 1]` if it's not known (conditions are never
+//! NaN).
+static MATHPRESSO_INLINE void mp_interval_store_condition(double* out, bool may_be_false, bool may_be_true) {
+  mp_interval_store(out, may_be_false ? 0.0 : 1.0, may_be_true ? 1.0 : 0.0);
+}
+
+//! Multiplication that treats `0 * inf` as zero, which is the limit used by interval multiplication.
+static MATHPRESSO_INLINE double mp_interval_mul_bound(double a, double b) {
+  return (a == 0.0 || b == 0.0) ? 0.0 : a * b;
+}
+
+//! Get whether `[lo, hi]` may contain a point `phase + k * period` for an integer `k`. The test is conservative, it
+//! can also return true for points slightly outside of the interval, as `phase` and `period` are not exact.
+static bool mp_interval_has_periodic_point(double lo, double hi, double phase, double period) {
+  double k_lo = (lo - phase) / period;
+  double k_hi = (hi - phase) / period;
+
+  // Much larger than rounding errors of `k` for arguments up to `kIntervalTrigLimit`.
+  const double slack = 1e-9;
+  return ::floor(k_hi + slack) >= ::ceil(k_lo - slack);
+}
+
+//! Monotonically increasing function `fn` widened by libm error.
+static MATHPRESSO_INLINE void mp_interval_increasing(double* out, double lo, double hi, Arg1Func fn) {
+  mp_interval_store_outward(out, fn(lo), fn(hi), kIntervalLibmUlps);
+}
+
+// MathPresso - Interval Operators (Unary)
+// =======================================
+
+#define MP_INTERVAL_UNARY(NAME) \
+  static void mp_interval_##NAME(double* out, double lo, double hi)
+
+#define MP_INTERVAL_CHECK_EMPTY() \
+  if (mp_interval_is_empty(lo, hi)) { \
+    mp_interval_store_empty(out); \
+    return; \
+  }
+
+MP_INTERVAL_UNARY(neg) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store(out, -hi, -lo);
+}
+
+// Conditions include results of NaN points of their operands - `!NaN`, `isinf(NaN)`, and `isfinite(NaN)` are false,
+// `isnan(NaN)` is true, and the sign bit of NaN can be both.
+MP_INTERVAL_UNARY(not) {
+  bool nan;
+  bool has_points = mp_interval_condition_arg(lo, hi, nan);
+  mp_interval_store_condition(out, nan || (has_points && (lo != 0.0 || hi != 0.0)), has_points && mp_interval_has_zero(lo, hi));
+}
+
+MP_INTERVAL_UNARY(is_nan) {
+  bool nan;
+  bool has_points = mp_interval_condition_arg(lo, hi, nan);
+  mp_interval_store_condition(out, has_points, nan);
+}
+
+MP_INTERVAL_UNARY(is_inf) {
+  bool nan;
+  bool has_points = mp_interval_condition_arg(lo, hi, nan);
+  bool lo_inf = has_points && mp_is_inf(lo) != 0.0;
+  bool hi_inf = has_points && mp_is_inf(hi) != 0.0;
+  mp_interval_store_condition(out, nan || (has_points && !(lo_inf && lo == hi)), lo_inf || hi_inf);
+}
+
+MP_INTERVAL_UNARY(is_finite) {
+  bool nan;
+  bool has_points = mp_interval_condition_arg(lo, hi, nan);
+  bool lo_inf = has_points && mp_is_inf(lo) != 0.0;
+  bool hi_inf = has_points && mp_is_inf(hi) != 0.0;
+  mp_interval_store_condition(out, nan || lo_inf || hi_inf, has_points && !(lo_inf && lo == hi));
+}
+
+MP_INTERVAL_UNARY(sign_bit) {
+  bool nan;
+  bool has_points = mp_interval_condition_arg(lo, hi, nan);
+  bool all_negative = has_points && (hi < 0.0 || (hi == 0.0 && DoubleBits::from_double(hi).sign_bit()));
+  bool all_positive = has_points && (lo > 0.0 || (lo == 0.0 && !DoubleBits::from_double(lo).sign_bit()));
+  mp_interval_store_condition(out, nan || (has_points && !all_negative), nan || (has_points && !all_positive));
+}
+
+// Rounding functions are monotonic and exact.
+MP_INTERVAL_UNARY(trunc) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_trunc(lo), mp_trunc(hi)); }
+MP_INTERVAL_UNARY(floor) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_floor(lo), mp_floor(hi)); }
+MP_INTERVAL_UNARY(ceil) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_ceil(lo), mp_ceil(hi)); }
+MP_INTERVAL_UNARY(round_even) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_round_even(lo), mp_round_even(hi)); }
+MP_INTERVAL_UNARY(round_half_away) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_round_half_away(lo), mp_round_half_away(hi)); }
+MP_INTERVAL_UNARY(round_half_up) { MP_INTERVAL_CHECK_EMPTY() mp_interval_store(out, mp_round_half_up(lo), mp_round_half_up(hi)); }
+
+MP_INTERVAL_UNARY(abs) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  if (lo >= 0.0)
+    mp_interval_store(out, lo, hi);
+  else if (hi <= 0.0)
+    mp_interval_store(out, -hi, -lo);
+  else
+    mp_interval_store(out, 0.0, mp_max2(-lo, hi));
+}
+
+MP_INTERVAL_UNARY(exp) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_increasing(out, lo, hi, mp_exp);
+  out[0] = mp_max2(out[0], 0.0);
+}
+
+// Logarithms are defined for [0, inf], results of negative points are NaN.
+static void mp_interval_log_base(double* out, double lo, double hi, Arg1Func fn) {
+  if (mp_interval_is_empty(lo, hi) || hi < 0.0) {
+    mp_interval_store_empty(out);
+    return;
+  }
+
+  mp_interval_increasing(out, mp_max2(lo, 0.0), hi, fn);
+  if (lo < 0.0)
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_UNARY(log) { mp_interval_log_base(out, lo, hi, mp_log); }
+MP_INTERVAL_UNARY(log2) { mp_interval_log_base(out, lo, hi, mp_log2); }
+MP_INTERVAL_UNARY(log10) { mp_interval_log_base(out, lo, hi, mp_log10); }
+
+MP_INTERVAL_UNARY(sqrt) {
+  if (mp_interval_is_empty(lo, hi) || hi < 0.0) {
+    mp_interval_store_empty(out);
+    return;
+  }
+
+  mp_interval_store_outward(out, mp_sqrt(mp_max2(lo, 0.0)), mp_sqrt(hi), 1);
+  out[0] = mp_max2(out[0], 0.0);
+
+  if (lo < 0.0)
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_UNARY(frac) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  double f = mp_floor(lo);
+  if (mp_is_finite(lo) != 0.0 && mp_is_finite(hi) != 0.0 && mp_floor(hi) == f)
+    mp_interval_store(out, lo - f, hi - f);
+  else
+    mp_interval_store(out, 0.0, 1.0);
+
+  if (mp_interval_has_inf(lo, hi))
+    mp_interval_add_nan(out);
+}
+
+static void mp_interval_div(double* out, double a_lo, double a_hi, double b_lo, double b_hi);
+
+MP_INTERVAL_UNARY(recip) {
+  mp_interval_div(out, 1.0, 1.0, lo, hi);
+}
+
+// Trigonometric functions are NaN at infinities, which are outside of `kIntervalTrigLimit`.
+MP_INTERVAL_UNARY(sin) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  if (mp_interval_has_inf(lo, hi)) {
+    mp_interval_store(out, -1.0, 1.0);
+    mp_interval_add_nan(out);
+    return;
+  }
+
+  if (!(hi - lo < 2.0 * kIntervalPi) || mp_max2(-lo, hi) > kIntervalTrigLimit) {
+    mp_interval_store(out, -1.0, 1.0);
+    return;
+  }
+
+  double s_lo = mp_sin(lo);
+  double s_hi = mp_sin(hi);
+  mp_interval_store_outward(out, mp_min2(s_lo, s_hi), mp_max2(s_lo, s_hi), kIntervalLibmUlps);
+
+  // Extremes of sin() are at PI/2 + 2*k*PI and -PI/2 + 2*k*PI.
+  if (mp_interval_has_periodic_point(lo, hi, 0.5 * kIntervalPi, 2.0 * kIntervalPi)) out[1] = 1.0;
+  if (mp_interval_has_periodic_point(lo, hi, -0.5 * kIntervalPi, 2.0 * kIntervalPi)) out[0] = -1.0;
+
+  out[0] = mp_max2(out[0], -1.0);
+  out[1] = mp_min2(out[1], 1.0);
+}
+
+MP_INTERVAL_UNARY(cos) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  if (mp_interval_has_inf(lo, hi)) {
+    mp_interval_store(out, -1.0, 1.0);
+    mp_interval_add_nan(out);
+    return;
+  }
+
+  if (!(hi - lo < 2.0 * kIntervalPi) || mp_max2(-lo, hi) > kIntervalTrigLimit) {
+    mp_interval_store(out, -1.0, 1.0);
+    return;
+  }
+
+  double c_lo = mp_cos(lo);
+  double c_hi = mp_cos(hi);
+  mp_interval_store_outward(out, mp_min2(c_lo, c_hi), mp_max2(c_lo, c_hi), kIntervalLibmUlps);
+
+  // Extremes of cos() are at 2*k*PI and PI + 2*k*PI.
+  if (mp_interval_has_periodic_point(lo, hi, 0.0, 2.0 * kIntervalPi)) out[1] = 1.0;
+  if (mp_interval_has_periodic_point(lo, hi, kIntervalPi, 2.0 * kIntervalPi)) out[0] = -1.0;
+
+  out[0] = mp_max2(out[0], -1.0);
+  out[1] = mp_min2(out[1], 1.0);
+}
+
+MP_INTERVAL_UNARY(tan) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  // Poles of tan() are at PI/2 + k*PI, tan() is increasing between them.
+  if (!(hi - lo < kIntervalPi) || mp_max2(-lo, hi) > kIntervalTrigLimit ||
+      mp_interval_has_periodic_point(lo, hi, 0.5 * kIntervalPi, kIntervalPi)) {
+    mp_interval_store_entire(out);
+    if (mp_interval_has_inf(lo, hi))
+      mp_interval_add_nan(out);
+    return;
+  }
+
+  mp_interval_increasing(out, lo, hi, mp_tan);
+}
+
+MP_INTERVAL_UNARY(sinh) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_increasing(out, lo, hi, mp_sinh);
+}
+
+MP_INTERVAL_UNARY(cosh) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  if (lo >= 0.0)
+    mp_interval_increasing(out, lo, hi, mp_cosh);
+  else if (hi <= 0.0)
+    mp_interval_increasing(out, -hi, -lo, mp_cosh);
+  else
+    mp_interval_increasing(out, 0.0, mp_max2(-lo, hi), mp_cosh);
+
+  out[0] = mp_max2(out[0], 1.0);
+}
+
+MP_INTERVAL_UNARY(tanh) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_increasing(out, lo, hi, mp_tanh);
+
+  out[0] = mp_max2(out[0], -1.0);
+  out[1] = mp_min2(out[1], 1.0);
+}
+
+// Inverse sine and cosine are defined for [-1, 1], results of other points are NaN.
+MP_INTERVAL_UNARY(asin) {
+  if (mp_interval_is_empty(lo, hi) || lo > 1.0 || hi < -1.0) {
+    mp_interval_store_empty(out);
+    return;
+  }
+
+  mp_interval_increasing(out, mp_max2(lo, -1.0), mp_min2(hi, 1.0), mp_asin);
+  if (lo < -1.0 || hi > 1.0)
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_UNARY(acos) {
+  if (mp_interval_is_empty(lo, hi) || lo > 1.0 || hi < -1.0) {
+    mp_interval_store_empty(out);
+    return;
+  }
+
+  // Decreasing.
+  mp_interval_store_outward(out, mp_acos(mp_min2(hi, 1.0)), mp_acos(mp_max2(lo, -1.0)), kIntervalLibmUlps);
+  out[0] = mp_max2(out[0], 0.0);
+
+  if (lo < -1.0 || hi > 1.0)
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_UNARY(atan) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_increasing(out, lo, hi, mp_atan);
+}
+
+#undef MP_INTERVAL_CHECK_EMPTY
+#undef MP_INTERVAL_UNARY
+
+// MathPresso - Interval Operators (Binary)
+// ========================================
+
+#define MP_INTERVAL_BINARY(NAME) \
+  static void mp_interval_##NAME(double* out, double a_lo, double a_hi, double b_lo, double b_hi)
+
+#define MP_INTERVAL_CHECK_EMPTY() \
+  if (mp_interval_is_empty(a_lo, a_hi) || mp_interval_is_empty(b_lo, b_hi)) { \
+    mp_interval_store_empty(out); \
+    return; \
+  }
+
+// Comparisons include results of NaN points of their operands - a comparison with NaN is false, except `!=`.
+MP_INTERVAL_BINARY(eq) {
+  bool a_nan, b_nan;
+  bool has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan) & mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  bool may_be_equal = has_points && a_lo <= b_hi && b_lo <= a_hi;
+  bool always_equal = has_points && a_lo == a_hi && b_lo == b_hi && a_lo == b_lo;
+  mp_interval_store_condition(out, a_nan || b_nan || !always_equal, may_be_equal);
+}
+
+MP_INTERVAL_BINARY(ne) {
+  bool a_nan, b_nan;
+  bool has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan) & mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  bool may_be_equal = has_points && a_lo <= b_hi && b_lo <= a_hi;
+  bool always_equal = has_points && a_lo == a_hi && b_lo == b_hi && a_lo == b_lo;
+  mp_interval_store_condition(out, may_be_equal, a_nan || b_nan || !always_equal);
+}
+
+MP_INTERVAL_BINARY(lt) {
+  bool a_nan, b_nan;
+  bool has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan) & mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  mp_interval_store_condition(out, a_nan || b_nan || !(a_hi < b_lo), has_points && a_lo < b_hi);
+}
+
+MP_INTERVAL_BINARY(le) {
+  bool a_nan, b_nan;
+  bool has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan) & mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  mp_interval_store_condition(out, a_nan || b_nan || !(a_hi <= b_lo), has_points && a_lo <= b_hi);
+}
+
+MP_INTERVAL_BINARY(gt) { mp_interval_lt(out, b_lo, b_hi, a_lo, a_hi); }
+MP_INTERVAL_BINARY(ge) { mp_interval_le(out, b_lo, b_hi, a_lo, a_hi); }
+
+// A value is false if it's zero, the same as `!`, so NaN is true.
+MP_INTERVAL_BINARY(log_and) {
+  bool a_nan, b_nan;
+  bool a_has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan);
+  bool b_has_points = mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  bool a_may_be_false = a_has_points && mp_interval_has_zero(a_lo, a_hi);
+  bool b_may_be_false = b_has_points && mp_interval_has_zero(b_lo, b_hi);
+  bool a_may_be_true = a_nan || (a_has_points && (a_lo != 0.0 || a_hi != 0.0));
+  bool b_may_be_true = b_nan || (b_has_points && (b_lo != 0.0 || b_hi != 0.0));
+  mp_interval_store_condition(out, a_may_be_false || b_may_be_false, a_may_be_true && b_may_be_true);
+}
+
+MP_INTERVAL_BINARY(log_or) {
+  bool a_nan, b_nan;
+  bool a_has_points = mp_interval_condition_arg(a_lo, a_hi, a_nan);
+  bool b_has_points = mp_interval_condition_arg(b_lo, b_hi, b_nan);
+  bool a_may_be_false = a_has_points && mp_interval_has_zero(a_lo, a_hi);
+  bool b_may_be_false = b_has_points && mp_interval_has_zero(b_lo, b_hi);
+  bool a_may_be_true = a_nan || (a_has_points && (a_lo != 0.0 || a_hi != 0.0));
+  bool b_may_be_true = b_nan || (b_has_points && (b_lo != 0.0 || b_hi != 0.0));
+  mp_interval_store_condition(out, a_may_be_false && b_may_be_false, a_may_be_true || b_may_be_true);
+}
+
+// Sums of infinities of different signs are NaN.
+static MATHPRESSO_INLINE bool mp_interval_add_has_nan(double a_lo, double a_hi, double b_lo, double b_hi) {
+  return (a_hi == mp_get_inf() && b_lo == -mp_get_inf()) || (a_lo == -mp_get_inf() && b_hi == mp_get_inf());
+}
+
+MP_INTERVAL_BINARY(add) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store_outward(out, a_lo + b_lo, a_hi + b_hi, 1);
+
+  if (mp_interval_add_has_nan(a_lo, a_hi, b_lo, b_hi))
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_BINARY(sub) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store_outward(out, a_lo - b_hi, a_hi - b_lo, 1);
+
+  if (mp_interval_add_has_nan(a_lo, a_hi, -b_hi, -b_lo))
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_BINARY(mul) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  double p0 = mp_interval_mul_bound(a_lo, b_lo);
+  double p1 = mp_interval_mul_bound(a_lo, b_hi);
+  double p2 = mp_interval_mul_bound(a_hi, b_lo);
+  double p3 = mp_interval_mul_bound(a_hi, b_hi);
+
+  mp_interval_store_outward(out, mp_min4(p0, p1, p2, p3), mp_max4(p0, p1, p2, p3), 1);
+
+  // Zero times infinity is NaN.
+  if ((mp_interval_has_zero(a_lo, a_hi) && mp_interval_has_inf(b_lo, b_hi)) ||
+      (mp_interval_has_zero(b_lo, b_hi) && mp_interval_has_inf(a_lo, a_hi)))
+    mp_interval_add_nan(out);
+}
+
+static void mp_interval_div_points(double* out, double a_lo, double a_hi, double b_lo, double b_hi);
+
+// Zero divided by zero and infinity divided by infinity are NaN.
+static void mp_interval_div(double* out, double a_lo, double a_hi, double b_lo, double b_hi) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_div_points(out, a_lo, a_hi, b_lo, b_hi);
+
+  if ((mp_interval_has_zero(a_lo, a_hi) && mp_interval_has_zero(b_lo, b_hi)) ||
+      (mp_interval_has_inf(a_lo, a_hi) && mp_interval_has_inf(b_lo, b_hi)))
+    mp_interval_add_nan(out);
+}
+
+static void mp_interval_div_points(double* out, double a_lo, double a_hi, double b_lo, double b_hi) {
+  // Zero divided by anything is zero (or NaN).
+  if (a_lo == 0.0 && a_hi == 0.0) {
+    if (b_lo == 0.0 && b_hi == 0.0)
+      mp_interval_store_empty(out);
+    else
+      mp_interval_store(out, 0.0, 0.0);
+    return;
+  }
+
+  if (b_lo > 0.0 || b_hi < 0.0) {
+    double q0 = a_lo / b_lo;
+    double q1 = a_lo / b_hi;
+    double q2 = a_hi / b_lo;
+    double q3 = a_hi / b_hi;
+
+    // Only `inf / inf` is NaN, which is a limit of unbounded values.
+    if (q0 != q0 || q1 != q1 || q2 != q2 || q3 != q3)
+      mp_interval_store_entire(out);
+    else
+      mp_interval_store_outward(out, mp_min4(q0, q1, q2, q3), mp_max4(q0, q1, q2, q3), 1);
+    return;
+  }
+
+  // The divisor contains zero - only divisors that have zero as a bound give a half-bounded result.
+  if (b_lo == 0.0 && b_hi > 0.0) {
+    if (a_lo >= 0.0)
+      mp_interval_store_outward(out, a_lo / b_hi, mp_get_inf(), 1);
+    else if (a_hi <= 0.0)
+      mp_interval_store_outward(out, -mp_get_inf(), a_hi / b_hi, 1);
+    else
+      mp_interval_store_entire(out);
+  }
+  else if (b_hi == 0.0 && b_lo < 0.0) {
+    if (a_lo >= 0.0)
+      mp_interval_store_outward(out, -mp_get_inf(), a_lo / b_lo, 1);
+    else if (a_hi <= 0.0)
+      mp_interval_store_outward(out, a_hi / b_lo, mp_get_inf(), 1);
+    else
+      mp_interval_store_entire(out);
+  }
+  else {
+    mp_interval_store_entire(out);
+  }
+}
+
+MP_INTERVAL_BINARY(mod) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  if (b_lo == 0.0 && b_hi == 0.0) {
+    mp_interval_store_empty(out);
+    return;
+  }
+
+  // The result has the sign of `a` and its magnitude is less than `|b|`.
+  double m = mp_max2(-b_lo, b_hi);
+
+  if (a_lo >= 0.0)
+    mp_interval_store(out, 0.0, mp_min2(a_hi, m));
+  else if (a_hi <= 0.0)
+    mp_interval_store(out, mp_max2(a_lo, -m), 0.0);
+  else
+    mp_interval_store(out, mp_max2(a_lo, -m), mp_min2(a_hi, m));
+
+  // Remainders of infinities and remainders by zero are NaN.
+  if (mp_interval_has_inf(a_lo, a_hi) || mp_interval_has_zero(b_lo, b_hi))
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_BINARY(avg) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store_outward(out, (a_lo + b_lo) * 0.5, (a_hi + b_hi) * 0.5, 1);
+
+  if (mp_interval_add_has_nan(a_lo, a_hi, b_lo, b_hi))
+    mp_interval_add_nan(out);
+}
+
+MP_INTERVAL_BINARY(min) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store(out, mp_min2(a_lo, b_lo), mp_min2(a_hi, b_hi));
+}
+
+MP_INTERVAL_BINARY(max) {
+  MP_INTERVAL_CHECK_EMPTY()
+  mp_interval_store(out, mp_max2(a_lo, b_lo), mp_max2(a_hi, b_hi));
+}
+
+MP_INTERVAL_BINARY(pow) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  double p0 = mp_pow(a_lo, b_lo);
+  double p1 = mp_pow(a_lo, b_hi);
+  double p2 = mp_pow(a_hi, b_lo);
+  double p3 = mp_pow(a_hi, b_hi);
+
+  if (a_lo >= 0.0) {
+    // Non-negative base - pow() is monotonic in both operands, so its extremes are at corners.
+    mp_interval_store_outward(out, mp_min4(p0, p1, p2, p3), mp_max4(p0, p1, p2, p3), kIntervalLibmUlps);
+    return;
+  }
+
+  if (b_lo != b_hi || mp_trunc(b_lo) != b_lo) {
+    // Negative bases only have non-NaN results for integer exponents.
+    if (a_hi < 0.0 && b_lo == b_hi) {
+      mp_interval_store_empty(out);
+    }
+    else {
+      mp_interval_store_entire(out);
+      mp_interval_add_nan(out);
+    }
+    return;
+  }
+
+  // Integer exponent `n` - x^n is monotonic for x < 0 and x > 0.
+  double n = b_lo;
+  bool has_zero = a_hi >= 0.0;
+
+  if (n == 0.0) {
+    mp_interval_store(out, 1.0, 1.0);
+  }
+  else if (n < 0.0 && has_zero) {
+    mp_interval_store_entire(out);
+  }
+  else {
+    mp_interval_store_outward(out, mp_min2(p0, p2), mp_max2(p0, p2), kIntervalLibmUlps);
+    // Even powers of intervals containing zero have a zero minimum.
+    if (has_zero && n > 0.0 && mp_floor(n * 0.5) * 2.0 == n)
+      out[0] = 0.0;
+  }
+}
+
+MP_INTERVAL_BINARY(atan2) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  // Boxes containing the origin or crossing the branch cut (negative x axis) get the whole range.
+  if (b_lo <= 0.0 && a_lo <= 0.0 && a_hi >= 0.0) {
+    mp_interval_store_outward(out, -kIntervalPi, kIntervalPi, kIntervalLibmUlps);
+    return;
+  }
+
+  // Otherwise the angles of the box are between angles of its corners.
+  double t0 = mp_atan2(a_lo, b_lo);
+  double t1 = mp_atan2(a_lo, b_hi);
+  double t2 = mp_atan2(a_hi, b_lo);
+  double t3 = mp_atan2(a_hi, b_hi);
+  mp_interval_store_outward(out, mp_min4(t0, t1, t2, t3), mp_max4(t0, t1, t2, t3), kIntervalLibmUlps);
+}
+
+MP_INTERVAL_BINARY(hypot) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  double abs_a[2];
+  double abs_b[2];
+
+  mp_interval_abs(abs_a, a_lo, a_hi);
+  mp_interval_abs(abs_b, b_lo, b_hi);
+
+  mp_interval_store_outward(out, mp_hypot(abs_a[0], abs_b[0]), mp_hypot(abs_a[1], abs_b[1]), kIntervalLibmUlps);
+  out[0] = mp_max2(out[0], 0.0);
+}
+
+MP_INTERVAL_BINARY(copy_sign) {
+  MP_INTERVAL_CHECK_EMPTY()
+
+  double m[2];
+  mp_interval_abs(m, a_lo, a_hi);
+
+  bool all_negative = b_hi < 0.0 || (b_hi == 0.0 && DoubleBits::from_double(b_hi).sign_bit());
+  bool all_positive = b_lo > 0.0 || (b_lo == 0.0 && !DoubleBits::from_double(b_lo).sign_bit());
+
+  if (all_positive)
+    mp_interval_store(out, m[0], m[1]);
+  else if (all_negative)
+    mp_interval_store(out, -m[1], -m[0]);
+  else
+    mp_interval_store(out, -m[1], m[1]);
+}
+
+#undef MP_INTERVAL_CHECK_EMPTY
+#undef MP_INTERVAL_BINARY
+
+// MathPresso - Interval Operators (NaN)
+// =====================================
+
+// Operators other than conditions are NaN if any operand is NaN - they compute the result of non-NaN points of their
+// operands and mark it if an operand may be NaN.
+template<IntervalArg1Func Fn>
+static void mp_interval_unary_nan(double* out, double lo, double hi) {
+  bool nan = mp_interval_decode(lo, hi);
+  Fn(out, lo, hi);
+
+  if (nan)
+    mp_interval_add_nan(out);
+}
+
+template<IntervalArg2Func Fn>
+static void mp_interval_binary_nan(double* out, double a_lo, double a_hi, double b_lo, double b_hi) {
+  bool nan = mp_interval_decode(a_lo, a_hi) | mp_interval_decode(b_lo, b_hi);
+  Fn(out, a_lo, a_hi, b_lo, b_hi);
+
+  if (nan)
+    mp_interval_add_nan(out);
+}
+
+// MathPresso - Interval API
+// =========================
+
+void* interval_func_by_op(uint32_t op) {
+  switch (op) {
+    case kOpNeg          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_neg>;
+    case kOpNot          : return (void*)(IntervalArg1Func)mp_interval_not;
+
+    case kOpIsNan        : return (void*)(IntervalArg1Func)mp_interval_is_nan;
+    case kOpIsInf        : return (void*)(IntervalArg1Func)mp_interval_is_inf;
+    case kOpIsFinite     : return (void*)(IntervalArg1Func)mp_interval_is_finite;
+    case kOpSignBit      : return (void*)(IntervalArg1Func)mp_interval_sign_bit;
+
+    case kOpTrunc        : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_trunc>;
+    case kOpFloor        : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_floor>;
+    case kOpCeil         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_ceil>;
+    case kOpRoundEven    : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_round_even>;
+    case kOpRoundHalfAway: return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_round_half_away>;
+    case kOpRoundHalfUp  : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_round_half_up>;
+
+    case kOpAbs          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_abs>;
+    case kOpExp          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_exp>;
+    case kOpLog          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_log>;
+    case kOpLog2         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_log2>;
+    case kOpLog10        : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_log10>;
+    case kOpSqrt         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_sqrt>;
+    case kOpFrac         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_frac>;
+    case kOpRecip        : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_recip>;
+
+    case kOpSin          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_sin>;
+    case kOpCos          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_cos>;
+    case kOpTan          : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_tan>;
+    case kOpSinh         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_sinh>;
+    case kOpCosh         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_cosh>;
+    case kOpTanh         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_tanh>;
+    case kOpAsin         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_asin>;
+    case kOpAcos         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_acos>;
+    case kOpAtan         : return (void*)(IntervalArg1Func)mp_interval_unary_nan<mp_interval_atan>;
+
+    case kOpEq           : return (void*)(IntervalArg2Func)mp_interval_eq;
+    case kOpNe           : return (void*)(IntervalArg2Func)mp_interval_ne;
+    case kOpLt           : return (void*)(IntervalArg2Func)mp_interval_lt;
+    case kOpLe           : return (void*)(IntervalArg2Func)mp_interval_le;
+    case kOpGt           : return (void*)(IntervalArg2Func)mp_interval_gt;
+    case kOpGe           : return (void*)(IntervalArg2Func)mp_interval_ge;
+    case kOpLogAnd       : return (void*)(IntervalArg2Func)mp_interval_log_and;
+    case kOpLogOr        : return (void*)(IntervalArg2Func)mp_interval_log_or;
+
+    case kOpAdd          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_add>;
+    case kOpSub          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_sub>;
+    case kOpMul          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_mul>;
+    case kOpDiv          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_div>;
+    case kOpMod          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_mod>;
+
+    case kOpAvg          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_avg>;
+    case kOpMin          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_min>;
+    case kOpMax          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_max>;
+    case kOpPow          : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_pow>;
+    case kOpAtan2        : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_atan2>;
+    case kOpHypot        : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_hypot>;
+    case kOpCopySign     : return (void*)(IntervalArg2Func)mp_interval_binary_nan<mp_interval_copy_sign>;
+
+    default:
+      MATHPRESSO_ASSERT_NOT_REACHED();
+      return nullptr;
+  }
+}
+
+} // {mathpresso}
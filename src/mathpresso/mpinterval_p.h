@@ -0,0 +1,43 @@
+// [MathPresso]
+// Mathematical Expression Parser and JIT Compiler.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _MATHPRESSO_MPINTERVAL_P_H
+#define _MATHPRESSO_MPINTERVAL_P_H
+
+// [Dependencies]
+#include "./mathpresso_p.h"
+
+namespace mathpresso {
+
+// MathPresso - Interval Arithmetic
+// ================================
+
+//! \internal
+//!
+//! Prototype of an interval operator with one operand - stores the enclosure of `op([lo, hi])` to `out[0..1]`.
+typedef void (*IntervalArg1Func)(double* out, double lo, double hi);
+
+//! \internal
+//!
+//! Prototype of an interval operator with two operands - stores the enclosure of `[a_lo, a_hi] op [b_lo, b_hi]` to
+//! `out[0..1]`.
+typedef void (*IntervalArg2Func)(double* out, double a_lo, double a_hi, double b_lo, double b_hi);
+
+//! \internal
+//!
+//! Get the implementation of `op` (\ref IntervalArg1Func or \ref IntervalArg2Func) over intervals.
+//!
+//! The result of each operator encloses results of all points of its operands (like IEEE 1788, zeros are unsigned).
+//! NaN is a point as well - an interval with `lo > hi` is `[hi, lo]` that may also be NaN, and an interval having a
+//! NaN bound is empty, having only NaN points. The result of an operator with an empty operand (or without any
+//! non-NaN result) is empty. Conditions are never NaN, they include results of NaN points of their operands.
+MATHPRESSO_NOAPI void* interval_func_by_op(uint32_t op);
+
+} // {mathpresso}
+
+// [Guard]
+#endif // _MATHPRESSO_MPINTERVAL_P_H
@@ -10,6 +10,8 @@
 // [Dependencies]
 #include "./mpast_p.h"
 #include "./mpeval_p.h"
+#include "./mphash_p.h"
+#include "./mpcse_p.h"
 #include "./mpoptimizer_p.h"
 
 namespace mathpresso {
@@ -19,9 +21,428 @@ namespace mathpresso {
 
 AstOptimizer::AstOptimizer(AstBuilder* ast, ErrorReporter* error_reporter)
   : AstVisitor(ast),
-    _error_reporter(error_reporter) {}
+    _error_reporter(error_reporter),
+    _finite_inputs((error_reporter->_options & kInternalOptionFiniteInputs) != 0),
+    _overwritten(nullptr) {}
 AstOptimizer::~AstOptimizer() {}
 
+// Get whether the `node` is known to evaluate to a finite value. Global variables of the base 0 (rows checked by
+// `Expression::evaluate_array()`) that are never written are only considered finite when compiling with
+// `kInternalOptionFiniteInputs`. Operations that can overflow even when their inputs are finite (addition,
+// multiplication, exp, ...) are never considered finite.
+bool AstOptimizer::is_known_finite(AstNode* node) const {
+  switch (node->node_type()) {
+    case kAstNodeImm:
+      return mp_is_finite(static_cast<AstImm*>(node)->value()) != 0.0;
+
+    case kAstNodeVar: {
+      AstSymbol* sym = static_cast<AstVar*>(node)->symbol();
+      return _finite_inputs && sym->is_global() && sym->var_base() == 0 && sym->write_count() == 0;
+    }
+
+    case kAstNodeUnaryOp: {
+      const OpInfo& op = OpInfo::get(node->op_type());
+      if (op.is_condition())
+        return true;
+
+      switch (op.type) {
+        case kOpNeg:
+        case kOpAbs:
+        case kOpFrac:
+        case kOpSin:
+        case kOpCos:
+        case kOpTanh:
+        case kOpAtan:
+          return is_known_finite(static_cast<AstUnaryOp*>(node)->child());
+
+        default:
+          return op.is_rounding() && is_known_finite(static_cast<AstUnaryOp*>(node)->child());
+      }
+    }
+
+    case kAstNodeBinaryOp: {
+      const OpInfo& op = OpInfo::get(node->op_type());
+      if (op.is_condition())
+        return true;
+
+      switch (op.type) {
+        case kOpMin:
+        case kOpMax:
+        case kOpAtan2:
+        case kOpCopySign:
+          return is_known_finite(static_cast<AstBinaryOp*>(node)->left()) &&
+                 is_known_finite(static_cast<AstBinaryOp*>(node)->right());
+
+        default:
+          return false;
+      }
+    }
+
+    default:
+      return false;
+  }
+}
+
+// Marks `node` as uniform if all its children are uniform or immediates, see `kAstNodeIsUniform`. Nodes having only
+// immediates as children are not marked as they would be folded if it was possible.
+void AstOptimizer::mark_uniform(AstNode* node) {
+  uint32_t i, size = node->size();
+  bool has_uniform = false;
+
+  for (i = 0; i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (!child)
+      return;
+
+    if (child->has_node_flag(kAstNodeIsUniform))
+      has_uniform = true;
+    else if (!child->is_imm())
+      return;
+  }
+
+  if (has_uniform)
+    node->add_node_flags(kAstNodeIsUniform);
+}
+
+Error AstOptimizer::replace_by_imm(AstNode* node, double value) {
+  AstImm* imm = _ast->new_node<AstImm>(value);
+  MATHPRESSO_NULLCHECK(imm);
+
+  imm->set_position(node->position());
+  _ast->delete_node(node->parent()->replace_node(node, imm));
+  return kErrorOk;
+}
+
+// Forgets values of variables assigned by `node` - they are not known at the beginning of an iteration of a loop
+// (which follows the previous iteration) and after it (the loop doesn't have to iterate).
+void AstOptimizer::forget_assigned(AstNode* node) {
+  if (node->node_type() == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment()) {
+    AstNode* left = static_cast<AstBinaryOp*>(node)->left();
+    if (left->is_var())
+      static_cast<AstVar*>(left)->symbol()->clear_assigned();
+  }
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      forget_assigned(child);
+  }
+}
+
+uint32_t AstOptimizer::count_nodes(AstNode* node) {
+  uint32_t n = 1;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      n += count_nodes(child);
+  }
+  return n;
+}
+
+// Get whether evaluating `node` has an effect other than computing its value - it declares or writes a variable,
+// calls a function that wasn't added with `kFunctionNoSideEffects`, or it's a program (an equation of an ODE system).
+bool AstOptimizer::has_side_effect(AstNode* node) const {
+  switch (node->node_type()) {
+    case kAstNodeProgram:
+    case kAstNodeVarDecl:
+      return true;
+
+    case kAstNodeBinaryOp:
+      if (OpInfo::get(node->op_type()).is_assignment())
+        return true;
+      break;
+
+    case kAstNodeCall:
+      if (!static_cast<AstCall*>(node)->symbol()->has_symbol_flag(kAstSymbolIsPure))
+        return true;
+      break;
+  }
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child && has_side_effect(child))
+      return true;
+  }
+
+  return false;
+}
+
+// Get whether a store to `sym` can be removed - it's a local variable that is never read or that is written again
+// before it's read. Global variables are visible after the program, so they are always stored.
+bool AstOptimizer::is_dead_store(AstSymbol* sym) const {
+  return !sym->is_global() && (sym->read_count() == 0 || _overwritten[sym->var_slot_id()]);
+}
+
+// Clears `_overwritten` of variables read by `node`.
+void AstOptimizer::mark_read(AstNode* node) {
+  if (node->is_var()) {
+    uint32_t slot_id = static_cast<AstVar*>(node)->symbol()->var_slot_id();
+    if (slot_id < _ast->_num_slots)
+      _overwritten[slot_id] = 0;
+    return;
+  }
+
+  // The assigned variable (the left child of an assignment) is not read.
+  uint32_t i = node->node_type() == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment();
+  for (uint32_t size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      mark_read(child);
+  }
+}
+
+// Replaces assignments to local variables that are never read by their values, returns the replacement of `node`.
+AstNode* AstOptimizer::remove_unread_stores(AstNode* node, bool* changed) {
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      remove_unread_stores(child, changed);
+  }
+
+  if (node->node_type() == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment()) {
+    AstSymbol* sym = static_cast<AstVar*>(static_cast<AstBinaryOp*>(node)->left())->symbol();
+
+    if (!sym->is_global() && sym->read_count() == 0) {
+      AstNode* value = static_cast<AstBinaryOp*>(node)->unlink_right();
+      node->parent()->replace_node(node, value);
+      _ast->delete_node(node);
+
+      *changed = true;
+      return value;
+    }
+  }
+
+  return node;
+}
+
+// Removes stores to local variables that are never read or that are written again before they are read, and
+// statements without side effects. The last statement is the value of the block, so it's never removed (a store
+// is only replaced by its value). Statements are visited backwards - a variable is marked as overwritten by a store
+// and unmarked by a read. Stores nested in expressions or other blocks don't mark variables, as they are either
+// conditional or evaluated in an order that is not tracked. Variables declared by a `scoped` block (not a body of
+// a loop, which is followed by the next iteration) are not read after it.
+Error AstOptimizer::eliminate_dead_code(AstBlock* block, bool scoped, bool* changed) {
+  uint32_t i, size = block->size();
+
+  // Nested blocks use `_overwritten` as well, so they must be processed first.
+  for (i = 0; i < size; i++) {
+    AstNode* child = block->child_at(i);
+
+    if (child->node_type() == kAstNodeBlock || child->node_type() == kAstNodeProgram)
+      MATHPRESSO_PROPAGATE(eliminate_dead_code(static_cast<AstBlock*>(child), true, changed));
+    else if (child->node_type() == kAstNodeRepeat)
+      MATHPRESSO_PROPAGATE(eliminate_dead_code(static_cast<AstRepeat*>(child)->body(), false, changed));
+  }
+
+  ::memset(_overwritten, 0, _ast->_num_slots);
+  if (scoped) {
+    for (i = 0; i < size; i++) {
+      AstNode* child = block->child_at(i);
+      if (child->node_type() == kAstNodeVarDecl)
+        _overwritten[static_cast<AstVarDecl*>(child)->symbol()->var_slot_id()] = 1;
+    }
+  }
+
+  i = size;
+  while (i) {
+    AstNode* node = block->child_at(--i);
+    bool is_last = i + 1 == block->size();
+
+    if (node->node_type() == kAstNodeVarDecl) {
+      AstVarDecl* decl = static_cast<AstVarDecl*>(node);
+      AstSymbol* sym = decl->symbol();
+      AstNode* hoisted = nullptr;
+
+      // The declaration is kept without its initializer, a loop would consider the variable loop-carried if it was
+      // assigned and not declared by its body. The initializer is kept as a statement if it has a side effect.
+      if (decl->child() && !is_last && is_dead_store(sym)) {
+        AstNode* value = decl->unlink_child();
+        sym->decrement_used_count();
+        sym->decrement_write_count();
+
+        if (has_side_effect(value))
+          hoisted = value;
+        else
+          _ast->delete_node(value);
+        *changed = true;
+      }
+      else if (decl->child()) {
+        mark_read(remove_unread_stores(decl->child(), changed));
+      }
+
+      _overwritten[sym->var_slot_id()] = 0;
+
+      if (!decl->child() && !is_last && sym->used_count() == 0) {
+        _ast->delete_node(block->remove_at(i));
+        *changed = true;
+      }
+
+      if (hoisted) {
+        MATHPRESSO_PROPAGATE_(block->will_add(), { _ast->delete_node(hoisted); });
+        block->insert_at(i, hoisted);
+
+        // The initializer is visited as the next statement.
+        i++;
+      }
+      continue;
+    }
+
+    if (node->node_type() == kAstNodeBinaryOp && OpInfo::get(node->op_type()).is_assignment()) {
+      AstBinaryOp* store = static_cast<AstBinaryOp*>(node);
+      AstSymbol* sym = static_cast<AstVar*>(store->left())->symbol();
+
+      if (!is_dead_store(sym)) {
+        AstNode* value = remove_unread_stores(store->right(), changed);
+        if (!sym->is_global())
+          _overwritten[sym->var_slot_id()] = 1;
+        mark_read(value);
+        continue;
+      }
+
+      node = store->unlink_right();
+      block->replace_at(i, node);
+      _ast->delete_node(store);
+      *changed = true;
+    }
+
+    node = remove_unread_stores(node, changed);
+    if (!is_last && !has_side_effect(node)) {
+      _ast->delete_node(block->remove_at(i));
+      *changed = true;
+      continue;
+    }
+
+    mark_read(node);
+  }
+
+  return kErrorOk;
+}
+
+// Replaces values that are computed more than once by `block` by a variable declared before the first of them. Equal
+// values are found by numbering the block by `CseBlock`, values computed by nested blocks are not shared. Uniform
+// values are not shared - they are already computed once by the compiler before the loop over rows, and their
+// parents are marked uniform too, which would make the compiler hoist a parent that reads the declared variable.
+Error AstOptimizer::eliminate_common_subexpressions(AstBlock* block) {
+  uint32_t i, size = block->size();
+
+  for (i = 0; i < size; i++) {
+    AstNode* child = block->child_at(i);
+
+    if (child->node_type() == kAstNodeBlock || child->node_type() == kAstNodeProgram)
+      MATHPRESSO_PROPAGATE(eliminate_common_subexpressions(static_cast<AstBlock*>(child)));
+    else if (child->node_type() == kAstNodeRepeat)
+      MATHPRESSO_PROPAGATE(eliminate_common_subexpressions(static_cast<AstRepeat*>(child)->body()));
+  }
+
+  CseBlock cse(_ast);
+  MATHPRESSO_PROPAGATE(cse.build(block));
+
+  // Values are in post-order, so a shared value is replaced before values it's an operand of. Values of the same
+  // number that precede the first stable one read a variable stored by their statement, so they are not shared.
+  for (i = 0; i < cse.size(); i++) {
+    CseValue& v = cse.value_at(i);
+    if (v.number != i || v.next == kCseInvalid || !(v.flags & kCseValueShareable))
+      continue;
+
+    uint32_t first = i;
+    while (first != kCseInvalid && !(cse.value_at(first).node && (cse.value_at(first).flags & kCseValueStable)))
+      first = cse.value_at(first).next;
+
+    if (first == kCseInvalid)
+      continue;
+
+    uint32_t count = 0;
+    for (uint32_t j = first; j != kCseInvalid; j = cse.value_at(j).next)
+      count += cse.value_at(j).node != nullptr;
+
+    if (count < 2)
+      continue;
+
+    AstNode* node = cse.value_at(first).node;
+    if (node->has_node_flag(kAstNodeIsUniform))
+      continue;
+
+    AstNode* statement = node;
+
+    while (statement->parent() != block)
+      statement = statement->parent();
+
+    uint32_t index = 0;
+    while (block->child_at(index) != statement)
+      index++;
+
+    AstSymbol* sym = _ast->new_symbol(StringRef("@t", 2), HashUtils::hash_string("@t", 2), kAstSymbolVariable, kAstScopeNested);
+    MATHPRESSO_NULLCHECK(sym);
+
+    sym->add_symbol_flags(kAstSymbolIsDeclared);
+    sym->set_var_slot_id(_ast->new_slot_id());
+    sym->set_var_offset(0);
+
+    AstVarDecl* decl = _ast->new_node<AstVarDecl>();
+    MATHPRESSO_NULLCHECK(decl);
+    MATHPRESSO_PROPAGATE_(block->will_add(), { _ast->delete_node(decl); });
+
+    decl->set_symbol(sym);
+    decl->set_position(node->position());
+
+    // The first value is moved to the declaration, others are deleted.
+    for (uint32_t j = first; j != kCseInvalid; j = cse.value_at(j).next) {
+      AstNode* value = cse.value_at(j).node;
+      if (!value)
+        continue;
+
+      AstVar* var = _ast->new_node<AstVar>();
+      MATHPRESSO_NULLCHECK(var);
+
+      var->set_symbol(sym);
+      var->set_position(value->position());
+      sym->increment_used_count();
+
+      value->parent()->replace_node(value, var);
+      if (j == first) {
+        decl->set_child(value);
+        sym->increment_used_count();
+        sym->increment_write_count();
+      }
+      else {
+        _ast->delete_node(value);
+        cse.mark_deleted(j);
+      }
+    }
+
+    block->insert_at(index, decl);
+  }
+
+  return kErrorOk;
+}
+
+Error AstOptimizer::on_program(AstProgram* node) {
+  MATHPRESSO_PROPAGATE(on_block(node));
+
+  // Programs of an ODE system are children of the root program, which eliminates their dead code.
+  if (node->has_parent())
+    return kErrorOk;
+
+  size_t overwritten_size = Arena::aligned_size(_ast->_num_slots + 1);
+  _overwritten = static_cast<uint8_t*>(_ast->arena().alloc_reusable(overwritten_size));
+  MATHPRESSO_NULLCHECK(_overwritten);
+
+  // Removing a statement can make other statements dead, so it's repeated until nothing changes.
+  Error err;
+  bool changed;
+
+  do {
+    changed = false;
+    err = eliminate_dead_code(node, true, &changed);
+  } while (err == kErrorOk && changed);
+
+  _ast->arena().free_reusable(_overwritten, overwritten_size);
+  _overwritten = nullptr;
+
+  MATHPRESSO_PROPAGATE(err);
+  return eliminate_common_subexpressions(node);
+}
+
 Error AstOptimizer::on_block(AstBlock* node) {
   // Prevent removing nodes that are not stored in pure `AstBlock`. For example
   // function call inherits from `AstBlock`, but it needs each expression passed.
@@ -75,8 +496,13 @@ Error AstOptimizer::on_var(AstVar* node) {
   if (sym->is_assigned() && !node->has_node_flag(kAstNodeHasSideEffect)) {
     AstImm* imm = _ast->new_node<AstImm>(sym->value());
     _ast->delete_node(node->parent()->replace_node(node, imm));
+    return kErrorOk;
   }
 
+  // Variables of other bases than the row data are the same for all rows, unless the program writes them.
+  if (sym->is_global() && sym->var_base() != 0 && sym->write_count() == 0)
+    node->add_node_flags(kAstNodeIsUniform);
+
   return kErrorOk;
 }
 
@@ -85,6 +511,20 @@ Error AstOptimizer::on_imm(AstImm* node) {
   return kErrorOk;
 }
 
+Error AstOptimizer::on_index(AstIndex* node) {
+  MATHPRESSO_PROPAGATE(on_node(node->child()));
+
+  // Arrays are read-only, so elements of arrays of other bases than the row data are the same for all rows.
+  if (node->symbol()->var_base() != 0) {
+    if (node->child()->is_imm())
+      node->add_node_flags(kAstNodeIsUniform);
+    else
+      mark_uniform(node);
+  }
+
+  return kErrorOk;
+}
+
 Error AstOptimizer::on_unary_op(AstUnaryOp* node) {
   const OpInfo& op = OpInfo::get(node->op_type());
 
@@ -143,6 +583,10 @@ Error AstOptimizer::on_unary_op(AstUnaryOp* node) {
     node->parent()->replace_node(node, child);
 
     _ast->delete_node(node);
+    return kErrorOk;
+  }
+  else if (_finite_inputs && (op.type == kOpIsNan || op.type == kOpIsInf || op.type == kOpIsFinite) && is_known_finite(child)) {
+    return replace_by_imm(node, op.type == kOpIsFinite ? 1.0 : 0.0);
   }
   else if (child->node_type() == kAstNodeUnaryOp && node->op_type() == child->op_type()) {
     // Simplify `-(-(x))` -> `x`.
@@ -150,9 +594,11 @@ Error AstOptimizer::on_unary_op(AstUnaryOp* node) {
       AstNode* child_of_child = static_cast<AstUnaryOp*>(child)->unlink_child();
       node->parent()->replace_node(node, child_of_child);
       _ast->delete_node(node);
+      return kErrorOk;
     }
   }
 
+  mark_uniform(node);
   return kErrorOk;
 }
 
@@ -190,6 +636,8 @@ Error AstOptimizer::on_binary_op(AstBinaryOp* node) {
       case kOpLe      : result = l_val <= r_val; break;
       case kOpGt      : result = l_val > r_val; break;
       case kOpGe      : result = l_val >= r_val; break;
+      case kOpLogAnd  : result = l_val != 0.0 && r_val != 0.0; break;
+      case kOpLogOr   : result = l_val != 0.0 || r_val != 0.0; break;
       case kOpAdd     : result = l_val + r_val; break;
       case kOpSub     : result = l_val - r_val; break;
       case kOpMul     : result = l_val * r_val; break;
@@ -213,6 +661,24 @@ Error AstOptimizer::on_binary_op(AstBinaryOp* node) {
     node->parent()->replace_node(node, l_node);
 
     _ast->delete_node(node);
+    return kErrorOk;
+  }
+  // A logical operator having a constant operand is either constant or the other operand converted by `0 != x`.
+  else if ((l_is_imm || r_is_imm) && (op.type == kOpLogAnd || op.type == kOpLogOr)) {
+    AstImm* imm = static_cast<AstImm*>(l_is_imm ? left : right);
+    bool truth = imm->value() != 0.0;
+
+    // The other operand is still evaluated if it has a side effect (like `impure(x) && 0`), so it's kept.
+    if (truth == (op.type == kOpLogOr)) {
+      if (!has_side_effect(l_is_imm ? right : left))
+        return replace_by_imm(node, truth ? 1.0 : 0.0);
+      return kErrorOk;
+    }
+
+    imm->set_value(0.0);
+    node->set_op_type(kOpNe);
+    mark_uniform(node);
+    return kErrorOk;
   }
   // There is still a little optimization opportunity.
   else if (l_is_imm) {
@@ -225,6 +691,7 @@ Error AstOptimizer::on_binary_op(AstBinaryOp* node) {
       node->parent()->replace_node(node, right);
 
       _ast->delete_node(node);
+      return kErrorOk;
     }
   }
   else if (r_is_imm) {
@@ -246,10 +713,39 @@ Error AstOptimizer::on_binary_op(AstBinaryOp* node) {
         node->parent()->replace_node(node, left);
 
         _ast->delete_node(node);
+        return kErrorOk;
       }
     }
   }
+  // Operations having the same variable on both sides can be folded if the variable is finite, which is only
+  // known when compiling the variant that assumes finite inputs (`x - x` is NaN and `x == x` is false if `x` is NaN).
+  else if (_finite_inputs && left->is_var() && right->is_var() &&
+           static_cast<AstVar*>(left)->symbol() == static_cast<AstVar*>(right)->symbol() && is_known_finite(left)) {
+    switch (op.type) {
+      case kOpEq:
+      case kOpLe:
+      case kOpGe:
+        return replace_by_imm(node, 1.0);
+
+      case kOpNe:
+      case kOpLt:
+      case kOpGt:
+      case kOpSub:
+        return replace_by_imm(node, 0.0);
 
+      default:
+        break;
+    }
+  }
+
+  // The variable isn't known anymore if the assigned value isn't an immediate.
+  if (op.is_assignment()) {
+    if (!r_is_imm && left->is_var())
+      static_cast<AstVar*>(left)->symbol()->clear_assigned();
+  }
+  else {
+    mark_uniform(node);
+  }
   return kErrorOk;
 }
 
@@ -286,8 +782,61 @@ Error AstOptimizer::on_invoke(AstCall* node) {
     AstNode* replacement = _ast->new_node<AstImm>(result);
     node->parent()->replace_node(node, replacement);
     _ast->delete_node(node);
+    return kErrorOk;
+  }
+
+  // Only calls without side effects can be computed once before a loop (calls having constant arguments are folded
+  // above).
+  if (!has_side_effect(node))
+    mark_uniform(node);
+  return kErrorOk;
+}
+
+// Loops having a small constant count are unrolled, so values of variables can be propagated through iterations.
+// Other loops are kept (a NaN or non-positive count means no iteration) and values of variables they assign are
+// forgotten.
+Error AstOptimizer::on_repeat(AstRepeat* node) {
+  MATHPRESSO_PROPAGATE(on_node(node->count()));
+  AstNode* count = node->count();
+
+  if (count->is_imm()) {
+    double value = static_cast<AstImm*>(count)->value();
+    if (!(value >= 1.0))
+      return replace_by_imm(node, mp_get_nan());
+
+    uint32_t n = value >= double(kRepeatUnrollCount) ? uint32_t(kRepeatUnrollCount) + 1u : uint32_t(value);
+    if (n <= kRepeatUnrollCount && n * count_nodes(node->body()) <= kRepeatUnrollNodes) {
+      AstBlock* unrolled = _ast->new_node<AstBlock>();
+      MATHPRESSO_NULLCHECK(unrolled);
+      unrolled->set_position(node->position());
+
+      // The last iteration uses the body itself.
+      for (uint32_t i = 0; i < n; i++) {
+        AstNode* body = i + 1 < n ? _ast->clone_node(node->body()) : node->unlink_body();
+        Error err = body ? unrolled->will_add() : MATHPRESSO_TRACE_ERROR(kErrorNoMemory);
+
+        if (err != kErrorOk) {
+          if (body)
+            _ast->delete_node(body);
+          _ast->delete_node(unrolled);
+          return err;
+        }
+        unrolled->append_node(body);
+      }
+
+      _ast->delete_node(node->parent()->replace_node(node, unrolled));
+      return on_block(unrolled);
+    }
   }
 
+  forget_assigned(node->body());
+  MATHPRESSO_PROPAGATE(on_block(node->body()));
+  forget_assigned(node->body());
+
+  // An empty body has no value.
+  if (node->body()->empty())
+    return replace_by_imm(node, mp_get_nan());
+
   return kErrorOk;
 }
 
@@ -23,6 +23,10 @@ struct AstOptimizer : public AstVisitor {
   // -------
 
   ErrorReporter* _error_reporter;
+  //! Inputs can be assumed finite, see \ref kInternalOptionFiniteInputs.
+  bool _finite_inputs;
+  //! Whether a variable (indexed by its slot) is written before it's read again, see `eliminate_dead_code()`.
+  uint8_t* _overwritten;
 
   // Construction & Destruction
   // --------------------------
@@ -30,13 +34,32 @@ struct AstOptimizer : public AstVisitor {
   AstOptimizer(AstBuilder* ast, ErrorReporter* error_reporter);
   virtual ~AstOptimizer();
 
+  // Helpers
+  // -------
+
+  bool is_known_finite(AstNode* node) const;
+  void mark_uniform(AstNode* node);
+  Error replace_by_imm(AstNode* node, double value);
+  void forget_assigned(AstNode* node);
+  uint32_t count_nodes(AstNode* node);
+
+  bool has_side_effect(AstNode* node) const;
+  bool is_dead_store(AstSymbol* sym) const;
+  void mark_read(AstNode* node);
+  AstNode* remove_unread_stores(AstNode* node, bool* changed);
+  Error eliminate_dead_code(AstBlock* block, bool scoped, bool* changed);
+  Error eliminate_common_subexpressions(AstBlock* block);
+
+  virtual Error on_program(AstProgram* node);
   virtual Error on_block(AstBlock* node);
   virtual Error on_var_decl(AstVarDecl* node);
   virtual Error on_var(AstVar* node);
   virtual Error on_imm(AstImm* node);
+  virtual Error on_index(AstIndex* node);
   virtual Error on_unary_op(AstUnaryOp* node);
   virtual Error on_binary_op(AstBinaryOp* node);
   virtual Error on_invoke(AstCall* node);
+  virtual Error on_repeat(AstRepeat* node);
 };
 
 } // {mathpresso}
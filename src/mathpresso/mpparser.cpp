@@ -55,6 +55,43 @@ struct AstNestedScope : public AstScope {
   _error_reporter->on_warning( \
     static_cast<uint32_t>((size_t)(_Token_.position())), __VA_ARGS__)
 
+// MathPresso - Parser Utilities
+// =============================
+
+//! \internal
+//!
+//! Get whether `node` calls a function that wasn't added with `kFunctionNoSideEffects` (expressions can't contain
+//! assignments, intrinsics are already operators, and inline functions are already spliced).
+static bool mp_has_impure_call(AstNode* node) {
+  if (node->node_type() == kAstNodeCall && !static_cast<AstCall*>(node)->symbol()->has_symbol_flag(kAstSymbolIsPure))
+    return true;
+
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child && mp_has_impure_call(child))
+      return true;
+  }
+
+  return false;
+}
+
+//! \internal
+//!
+//! Get the number of uses of the parameter `index` in the body of an inline function (all variables of the body are
+//! parameters, constants are immediates).
+static uint32_t mp_count_param_uses(AstNode* node, uint32_t index) {
+  if (node->node_type() == kAstNodeVar)
+    return static_cast<AstVar*>(node)->symbol()->var_slot_id() == index;
+
+  uint32_t count = 0;
+  for (uint32_t i = 0, size = node->size(); i < size; i++) {
+    AstNode* child = node->child_at(i);
+    if (child)
+      count += mp_count_param_uses(child, index);
+  }
+  return count;
+}
+
 // MathPresso - Parser
 // ===================
 
@@ -75,6 +112,12 @@ Error Parser::parse_program(AstProgram* block) {
   return kErrorOk;
 }
 
+// Parse a program that has its own scope, so its locals are not visible to other programs parsed into the same AST.
+Error Parser::parse_scoped_program(AstProgram* block) {
+  AstNestedScope tmpScope(this);
+  return parse_program(block);
+}
+
 // Parse <statement>; or { [<statement>; ...] }
 Error Parser::parse_statement(AstBlock* block, uint32_t flags) {
   Token token;
@@ -108,6 +151,10 @@ Error Parser::parse_statement(AstBlock* block, uint32_t flags) {
     return parse_variable_decl(block);
   }
 
+  // Parse a loop, its body has its own scope like a nested block.
+  if (uToken == kTokenRepeat)
+    return parse_repeat(block);
+
   // Parse an expression.
   AstNode* expression;
 
@@ -223,6 +270,7 @@ Error Parser::parse_variable_decl(AstBlock* block) {
       MATHPRESSO_PROPAGATE_(parse_expression(&expression, false), { _ast->delete_node(decl); });
 
       decl->set_child(expression);
+      vSym->increment_used_count();
       vSym->increment_write_count();
 
       uToken = _tokenizer.next(&token);
@@ -250,6 +298,45 @@ Error Parser::parse_variable_decl(AstBlock* block) {
   return kErrorOk;
 }
 
+// Parse "repeat (<expression>) <block|statement>".
+Error Parser::parse_repeat(AstBlock* block) {
+  Token token;
+  uint32_t uToken = _tokenizer.next(&token);
+  uint32_t position = token.positionAsUInt();
+
+  // Parse the 'repeat' keyword.
+  if (uToken != kTokenRepeat)
+    MATHPRESSO_PARSER_ERROR(token, "Expected 'repeat' keyword.");
+
+  if (_tokenizer.next(&token) != kTokenLParen)
+    MATHPRESSO_PARSER_ERROR(token, "Expected a '(' token after 'repeat' keyword.");
+
+  MATHPRESSO_PROPAGATE(block->will_add());
+
+  AstRepeat* repeat = _ast->new_node<AstRepeat>();
+  MATHPRESSO_NULLCHECK(repeat);
+  repeat->set_position(position);
+
+  // Parse the count, which is evaluated once before the first iteration.
+  AstNode* count;
+  MATHPRESSO_PROPAGATE_(parse_expression(&count, true), { _ast->delete_node(repeat); });
+  repeat->set_count(count);
+
+  if (_tokenizer.next(&token) != kTokenRParen) {
+    _ast->delete_node(repeat);
+    MATHPRESSO_PARSER_ERROR(token, "Expected a ')' token.");
+  }
+
+  AstBlock* body = _ast->new_node<AstBlock>();
+  MATHPRESSO_NULLCHECK_(body, { _ast->delete_node(repeat); });
+
+  repeat->set_body(body);
+  block->append_node(repeat);
+
+  AstNestedScope tmpScope(this);
+  return parse_block_or_statement(body);
+}
+
 Error Parser::parse_expression(AstNode** pNode, bool isNested) {
   AstScope* scope = _current_scope;
 
@@ -326,15 +413,25 @@ _Repeat1:
           MATHPRESSO_PARSER_ERROR(token, "Unresolved symbol %.*s.", static_cast<int>(str.size()), str.data());
 
         uint32_t symType = sym->symbol_type();
-        AstNode* zNode;
+        AstNode* zNode = nullptr;
 
         if (symType == kAstSymbolVariable) {
           if (!sym->is_declared())
             MATHPRESSO_PARSER_ERROR(token, "Can't use variable '%s' that is being declared.", sym->name());
 
+          // An inline function is stored in the context, so it can only reference constants, which are copied.
+          if (_inline_body && symScope->is_global()) {
+            if (!sym->is_assigned())
+              MATHPRESSO_PARSER_ERROR(token, "Inline function can't use variable '%s'.", sym->name());
+
+            zNode = _ast->new_node<AstImm>(sym->value());
+            MATHPRESSO_NULLCHECK(zNode);
+
+            zNode->set_position(token.positionAsUInt());
+          }
           // Put symbol to shadow scope if it's global. This is done lazily and
           // only once per symbol when it's referenced.
-          if (symScope->is_global()) {
+          else if (symScope->is_global()) {
             sym = _ast->shadow_symbol(sym);
             MATHPRESSO_NULLCHECK(sym);
 
@@ -343,12 +440,39 @@ _Repeat1:
             symScope->put_symbol(sym);
           }
 
-          zNode = _ast->new_node<AstVar>();
-          MATHPRESSO_NULLCHECK(zNode);
-          static_cast<AstVar*>(zNode)->set_symbol(sym);
+          if (!zNode) {
+            zNode = _ast->new_node<AstVar>();
+            MATHPRESSO_NULLCHECK(zNode);
+            static_cast<AstVar*>(zNode)->set_symbol(sym);
 
-          zNode->set_position(token.positionAsUInt());
-          sym->increment_used_count();
+            zNode->set_position(token.positionAsUInt());
+            sym->increment_used_count();
+          }
+        }
+        else if (symType == kAstSymbolArray || symType == kAstSymbolTable) {
+          if (_inline_body)
+            MATHPRESSO_PARSER_ERROR(token, "Inline function can't use '%s'.", sym->name());
+
+          // Parse "array[index]" or "table(x)".
+          bool isArray = symType == kAstSymbolArray;
+
+          AstIndex* index = _ast->new_node<AstIndex>();
+          MATHPRESSO_NULLCHECK(index);
+
+          index->set_symbol(sym);
+          index->set_position(token.positionAsUInt());
+
+          if (_tokenizer.next(&token) != (isArray ? kTokenLBracket : kTokenLParen))
+            MATHPRESSO_PARSER_ERROR(token, isArray ? "Expected a '[' token after an array '%s'." : "Expected a '(' token after a table '%s'.", sym->name());
+
+          AstNode* iNode;
+          MATHPRESSO_PROPAGATE(parse_expression(&iNode, true));
+          index->set_child(iNode);
+
+          if (_tokenizer.next(&token) != (isArray ? kTokenRBracket : kTokenRParen))
+            MATHPRESSO_PARSER_ERROR(token, isArray ? "Expected a ']' token." : "Expected a ')' token.");
+
+          zNode = index;
         }
         else {
           // Will be parsed by `parse_call()` again.
@@ -378,11 +502,12 @@ _Repeat1:
         break;
       }
 
-      // Parse expression terminators - ',', ':', ';' or ')'.
+      // Parse expression terminators - ',', ':', ';', ')' or ']'.
       case kTokenComma:
       case kTokenColon:
       case kTokenSemicolon:
-      case kTokenRParen: {
+      case kTokenRParen:
+      case kTokenRBracket: {
         MATHPRESSO_PARSER_ERROR(token, "Expected an expression.");
       }
 
@@ -434,11 +559,12 @@ _Unary: {
 
 // _Repeat2:
     switch (_tokenizer.next(&token)) {
-      // Parse the expression terminators - ',', ':', ';', ')' or EOI.
+      // Parse the expression terminators - ',', ':', ';', ')', ']' or EOI.
       case kTokenComma:
       case kTokenColon:
       case kTokenSemicolon:
       case kTokenRParen:
+      case kTokenRBracket:
       case kTokenEnd: {
         _tokenizer.set(&token);
 
@@ -477,6 +603,8 @@ _Unary: {
       case kTokenNe          : op = kOpNe          ; goto _Binary;
       case kTokenGt          : op = kOpGt          ; goto _Binary;
       case kTokenGe          : op = kOpGe          ; goto _Binary;
+      case kTokenLogAnd      : op = kOpLogAnd      ; goto _Binary;
+      case kTokenLogOr       : op = kOpLogOr       ; goto _Binary;
       case kTokenLt          : op = kOpLt          ; goto _Binary;
       case kTokenLe          : op = kOpLe          ; goto _Binary;
       case kTokenAdd         : op = kOpAdd         ; goto _Binary;
@@ -590,9 +718,13 @@ Error Parser::parse_call(AstNode** pNodeOut) {
   if (sym == nullptr)
     MATHPRESSO_PARSER_ERROR(token, "Unresolved symbol %.*s.", static_cast<int>(str.size()), str.data());
 
-  if (sym->symbol_type() != kAstSymbolIntrinsic && sym->symbol_type() != kAstSymbolFunction)
+  uint32_t symType = sym->symbol_type();
+  if (symType != kAstSymbolIntrinsic && symType != kAstSymbolFunction && symType != kAstSymbolInline)
     MATHPRESSO_PARSER_ERROR(token, "Expected a function name.");
 
+  if (_inline_body && symType == kAstSymbolFunction)
+    MATHPRESSO_PARSER_ERROR(token, "Inline function can't call function '%s'.", sym->name());
+
   uToken = _tokenizer.next(&token);
   if (uToken != kTokenLParen)
     MATHPRESSO_PARSER_ERROR(token, "Expected a '(' token after a function name.");
@@ -642,8 +774,27 @@ Error Parser::parse_call(AstNode** pNodeOut) {
     MATHPRESSO_PARSER_ERROR(token, "Function '%s' requires %u argument(s) (%u provided).", sym->name(), reqArgs, n);
   }
 
+  // Splice the body of an inline function, each use of a parameter is replaced by a copy of its argument. An argument
+  // that calls an impure function would be called once per use of its parameter, so it must be used exactly once.
+  if (symType == kAstSymbolInline) {
+    for (uint32_t i = 0; i < n; i++) {
+      if (mp_has_impure_call(call_node->child_at(i)) && mp_count_param_uses(sym->node(), i) != 1) {
+        _ast->delete_node(call_node);
+        MATHPRESSO_PARSER_ERROR(token, "Argument %u of inline function '%s' has side effects, but its parameter isn't used exactly once.", i + 1, sym->name());
+      }
+    }
+
+    AstNode* body = _ast->clone_node(sym->node(), call_node->children());
+    _ast->delete_node(call_node);
+    MATHPRESSO_NULLCHECK(body);
+
+    body->set_position(position);
+    *pNodeOut = body;
+    return kErrorOk;
+  }
+
   // Transform an intrinsic function into unary or binary operator.
-  if (sym->symbol_type() == kAstSymbolIntrinsic) {
+  if (symType == kAstSymbolIntrinsic) {
     const OpInfo& op = OpInfo::get(sym->op_type());
     MATHPRESSO_ASSERT(n == op.op_count());
 
@@ -676,4 +827,61 @@ Error Parser::parse_call(AstNode** pNodeOut) {
   }
 }
 
+// Parse "[param1 [, param2, ...] ]" - parameters of an inline function, which are put into `scope`.
+Error Parser::parse_inline_params(AstScope* scope, uint32_t* count_out) {
+  Token token;
+  uint32_t count = 0;
+
+  if (_tokenizer.peek(&token) != kTokenEnd) {
+    for (;;) {
+      if (_tokenizer.next(&token) != kTokenSymbol)
+        MATHPRESSO_PARSER_ERROR(token, "Expected a parameter name.");
+
+      StringRef str(_tokenizer._start + token.position(), token.size());
+      uint32_t hash_code = token.hash_code();
+
+      if (scope->get_symbol(str, hash_code) != nullptr)
+        MATHPRESSO_PARSER_ERROR(token, "Attempt to redefine '%.*s'.", static_cast<int>(str.size()), str.data());
+
+      if (count >= kMaxInlineParams)
+        MATHPRESSO_PARSER_ERROR(token, "Inline function can't have more than %u parameters.", unsigned(kMaxInlineParams));
+
+      AstSymbol* sym = _ast->new_symbol(str, hash_code, kAstSymbolVariable, kAstScopeNested);
+      MATHPRESSO_NULLCHECK(sym);
+
+      sym->add_symbol_flags(kAstSymbolIsDeclared | kAstSymbolIsReadOnly);
+      sym->set_var_slot_id(count++);
+      scope->put_symbol(sym);
+
+      uint32_t uToken = _tokenizer.next(&token);
+      if (uToken == kTokenEnd)
+        break;
+
+      if (uToken != kTokenComma)
+        MATHPRESSO_PARSER_ERROR(token, "Expected either ',' or the end of parameters.");
+    }
+  }
+
+  *count_out = count;
+  return kErrorOk;
+}
+
+// Parse a body of an inline function, which is a single expression that uses parameters of `scope`.
+Error Parser::parse_inline_body(AstScope* scope, AstNode** pNodeOut) {
+  _current_scope = scope;
+  _inline_body = true;
+
+  AstNode* node;
+  MATHPRESSO_PROPAGATE(parse_expression(&node, true));
+
+  Token token;
+  if (_tokenizer.next(&token) != kTokenEnd) {
+    _ast->delete_node(node);
+    MATHPRESSO_PARSER_ERROR(token, "Expected the end of an inline function.");
+  }
+
+  *pNodeOut = node;
+  return kErrorOk;
+}
+
 } // {mathpresso}
@@ -41,6 +41,9 @@ struct Parser {
   AstScope* _current_scope;
   Tokenizer _tokenizer;
 
+  //! Parsing a body of an inline function, which can only reference its parameters and constants.
+  bool _inline_body;
+
   // Construction & Destruction
   // --------------------------
 
@@ -48,7 +51,8 @@ struct Parser {
     : _ast(ast),
       _error_reporter(error_reporter),
       _current_scope(ast->root_scope()),
-      _tokenizer(body, size) {}
+      _tokenizer(body, size),
+      _inline_body(false) {}
   MATHPRESSO_INLINE ~Parser() {}
 
   // Accessors
@@ -60,13 +64,18 @@ struct Parser {
   // -----
 
   MATHPRESSO_NOAPI Error parse_program(AstProgram* block);
+  MATHPRESSO_NOAPI Error parse_scoped_program(AstProgram* block);
 
   MATHPRESSO_NOAPI Error parse_statement(AstBlock* block, uint32_t flags);
   MATHPRESSO_NOAPI Error parse_block_or_statement(AstBlock* block);
 
   MATHPRESSO_NOAPI Error parse_variable_decl(AstBlock* block);
+  MATHPRESSO_NOAPI Error parse_repeat(AstBlock* block);
   MATHPRESSO_NOAPI Error parse_expression(AstNode** pNodeOut, bool isNested);
   MATHPRESSO_NOAPI Error parse_call(AstNode** pNodeOut);
+
+  MATHPRESSO_NOAPI Error parse_inline_params(AstScope* scope, uint32_t* count_out);
+  MATHPRESSO_NOAPI Error parse_inline_body(AstScope* scope, AstNode** pNodeOut);
 };
 
 } // {mathpresso}
@@ -135,6 +135,9 @@ static uint32_t mpGetKeyword(const uint8_t* s, size_t size) {
   if (size == 3 && s[0] == 'v' && s[1] == 'a' && s[2] == 'r')
     return kTokenVar;
 
+  if (size == 6 && ::memcmp(s, "repeat", 6) == 0)
+    return kTokenRepeat;
+
   return kTokenSymbol;
 }
 
@@ -27,6 +27,7 @@ enum TokenType {
   kTokenNumber,       // <number>
 
   kTokenVar,          // 'var' keyword
+  kTokenRepeat,       // 'repeat' keyword
   kTokenReserved,     // reserved keyword
 
   kTokenDot = 36,     // .
@@ -0,0 +1,372 @@
+// [MathPresso]
+// Mathematical Expression Parser and JIT Compiler.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+#include "../src/mathpresso/mathpresso.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+// Bench Counters
+// ==============
+
+enum CounterId {
+  kCounterCycles,
+  kCounterInstructions,
+  kCounterBranchMisses,
+  kCounterL1DMisses,
+  kCounterLLCMisses,
+  kCounterITLBMisses,
+  kCounterCount
+};
+
+static const char* const counter_names[kCounterCount] = {
+  "cycles",
+  "instructions",
+  "branch-misses",
+  "L1D-misses",
+  "LLC-misses",
+  "iTLB-misses"
+};
+
+// Hardware performance counters of the calling thread (user space only). Counters that cannot be opened (not Linux,
+// no PMU in a VM, or restricted by `perf_event_paranoid`) stay unavailable and only wall-clock time is reported.
+//
+// Cycles and instructions are opened as a single event group, so they are always scheduled together and IPC is
+// computed from counts of the same interval even if the kernel multiplexes counters.
+struct Counters {
+  int fds[kCounterCount];
+  uint64_t values[kCounterCount];
+  bool available[kCounterCount];
+  bool grouped;
+
+  Counters() {
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      fds[i] = -1;
+      values[i] = 0;
+      available[i] = false;
+    }
+    grouped = false;
+
+#if defined(__linux__)
+    static const uint32_t types[kCounterCount] = {
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HW_CACHE,
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HW_CACHE
+    };
+
+    static const uint64_t configs[kCounterCount] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      // Instructions join the group of cycles (the leader), members are enabled and disabled with their leader.
+      int group_fd = i == kCounterInstructions ? fds[kCounterCycles] : -1;
+
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+
+      attr.size = sizeof(attr);
+      attr.type = types[i];
+      attr.config = configs[i];
+      attr.disabled = group_fd < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      if (i == kCounterCycles)
+        attr.read_format |= PERF_FORMAT_GROUP;
+
+      fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+      available[i] = fds[i] >= 0;
+
+      if (i == kCounterInstructions)
+        grouped = group_fd >= 0 && fds[i] >= 0;
+    }
+#endif
+  }
+
+  ~Counters() {
+#if defined(__linux__)
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      if (fds[i] >= 0)
+        close(fds[i]);
+    }
+#endif
+  }
+
+  bool has_any() const {
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      if (available[i])
+        return true;
+    }
+    return false;
+  }
+
+  // Whether the counter `i` is read and controlled by the leader of its group.
+  bool is_group_member(uint32_t i) const {
+    return grouped && i == kCounterInstructions;
+  }
+
+  void start() {
+#if defined(__linux__)
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      if (fds[i] >= 0 && !is_group_member(i)) {
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      }
+    }
+#endif
+  }
+
+  void stop() {
+#if defined(__linux__)
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      if (fds[i] >= 0 && !is_group_member(i))
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Counters are multiplexed if there are more events than hardware counters, the value is scaled by the time
+    // the counter was actually counting. Members of a group share the enabled and running time of the leader.
+    for (uint32_t i = 0; i < kCounterCount; i++) {
+      if (fds[i] < 0 || is_group_member(i))
+        continue;
+
+      // Group read format is `nr, time_enabled, time_running, values[nr]`, the other is `value, time_enabled,
+      // time_running`.
+      uint64_t data[5];
+      uint32_t n = i == kCounterCycles ? (grouped ? 2u : 1u) : 1u;
+      size_t size = (i == kCounterCycles ? 3 + n : 3) * sizeof(uint64_t);
+
+      uint64_t counts[2] = { 0, 0 };
+      uint64_t enabled = 0;
+      uint64_t running = 0;
+
+      bool ok = read(fds[i], data, size) == ssize_t(size);
+      if (ok) {
+        if (i == kCounterCycles) {
+          ok = data[0] == n;
+          enabled = data[1];
+          running = data[2];
+          counts[0] = data[3];
+          counts[1] = n > 1 ? data[4] : 0;
+        }
+        else {
+          counts[0] = data[0];
+          enabled = data[1];
+          running = data[2];
+        }
+      }
+
+      ok = ok && running != 0;
+      for (uint32_t j = 0; j < n; j++) {
+        uint32_t id = j == 0 ? i : uint32_t(kCounterInstructions);
+        values[id] = !ok ? 0 : running < enabled ? uint64_t(double(counts[j]) * double(enabled) / double(running)) : counts[j];
+        available[id] = ok;
+      }
+    }
+#endif
+  }
+};
+
+// Bench Expression
+// ================
+
+struct BenchExpression {
+  const char* name;
+  const char* body;
+};
+
+// Function called by the "invoke" expression, it does nothing so the expression is bound by the calls emitted by
+// `JitCompiler::inline_invoke()` (the calling convention, and spills of values that live across the calls).
+static double bench_identity(double x) { return x; }
+
+// Expressions range from trivial ones, which are bound by the cost of calling the compiled function, to long chains
+// of dependent operations, which are bound by latency.
+static const BenchExpression bench_expressions[] = {
+  { "trivial"   , "x + y" },
+  { "polynomial", "((((x * 0.5 + y) * x + z) * x + 1.5) * x + y) * x + z" },
+  { "chain"     , "sqrt(x * x + y * y) * sqrt(y * y + z * z) / (x * x + z * z + 1)" },
+  { "select"    , "(x > y) * min(x, z) + (x <= y && z > 0.5) * max(y, z) * 2" },
+  { "builtin"   , "sin(x) * cos(y) + exp(-z * z)" },
+  { "invoke"    , "identity(x) * 2 + identity(y) * 3 + identity(z) * 4" },
+  { "loop"      , "var a = x; repeat (8) a = a * y + z; a" }
+};
+
+struct Row {
+  double x;
+  double y;
+  double z;
+  double w;
+};
+
+// Bench Application
+// =================
+
+struct BenchApp {
+  Counters counters;
+  size_t rows_count;
+  size_t compile_count;
+
+  BenchApp(size_t rows_count, size_t compile_count)
+    : rows_count(rows_count),
+      compile_count(compile_count) {}
+
+  // Print a single phase, `count` is the number of operations the phase performed (compilations or rows).
+  void report(const char* name, const char* phase, size_t count, double ns) {
+    double n = double(count);
+    printf("%-10s %-8s %10.2f ns/op", name, phase, ns / n);
+
+    if (counters.available[kCounterCycles] && counters.available[kCounterInstructions]) {
+      double cycles = double(counters.values[kCounterCycles]);
+      double instructions = double(counters.values[kCounterInstructions]);
+
+      printf("  IPC %5.2f  %8.2f cyc/op  %8.2f ins/op  %6.2f ins/ns",
+             cycles ? instructions / cycles : 0.0, cycles / n, instructions / n, ns ? instructions / ns : 0.0);
+    }
+
+    for (uint32_t i = kCounterBranchMisses; i < kCounterCount; i++) {
+      if (counters.available[i])
+        printf("  %s %.4f/op", counter_names[i], double(counters.values[i]) / n);
+    }
+
+    printf("\n");
+  }
+
+  template<typename Func>
+  double measure(Func&& func) {
+    counters.start();
+    auto start = std::chrono::steady_clock::now();
+
+    func();
+
+    auto end = std::chrono::steady_clock::now();
+    counters.stop();
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+
+  int run() {
+    mathpresso::Context ctx;
+    ctx.add_builtins();
+    ctx.add_variable("x", MATHPRESSO_OFFSET(Row, x));
+    ctx.add_variable("y", MATHPRESSO_OFFSET(Row, y));
+    ctx.add_variable("z", MATHPRESSO_OFFSET(Row, z));
+    ctx.add_function("identity", (void*)bench_identity, mathpresso::kFunctionArg1);
+
+    Row* rows = static_cast<Row*>(malloc(rows_count * sizeof(Row)));
+    double* results = static_cast<double*>(malloc(rows_count * sizeof(double)));
+
+    if (!rows || !results) {
+      printf("Failed to allocate %zu rows\n", rows_count);
+      free(rows);
+      free(results);
+      return 1;
+    }
+
+    // Inputs are deterministic, but not trivially predictable.
+    uint64_t seed = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < rows_count; i++) {
+      seed = seed * 6364136223846793005u + 1442695040888963407u;
+      rows[i].x = double(seed >> 40) / double(1 << 24) * 4.0 - 2.0;
+      rows[i].y = double((seed >> 16) & 0xFFFFFF) / double(1 << 24) * 4.0 - 2.0;
+      rows[i].z = double(i & 1023) / 1024.0;
+      rows[i].w = 0.0;
+    }
+
+    printf("MPBench (%zu rows, %zu compilations)\n", rows_count, compile_count);
+    if (!counters.has_any()) {
+      printf("Hardware counters are not available, only wall-clock time is reported\n");
+    }
+    else {
+      for (uint32_t i = 0; i < kCounterCount; i++) {
+        if (!counters.available[i])
+          printf("Counter '%s' is not available\n", counter_names[i]);
+      }
+    }
+
+    double checksum = 0.0;
+    bool failed = false;
+
+    // The same options are used by all phases, so "evaluate" and "array" only differ in whether
+    // rows are looped over by the host or by the compiled function.
+    const unsigned int options = mathpresso::kOptionArrayLoop | mathpresso::kOptionFiniteFastPath;
+
+    for (const BenchExpression& bench : bench_expressions) {
+      mathpresso::Expression e;
+      mathpresso::Error err = mathpresso::kErrorOk;
+
+      double ns = measure([&]() {
+        for (size_t i = 0; i < compile_count && err == mathpresso::kErrorOk; i++)
+          err = e.compile(ctx, bench.body, options);
+      });
+
+      if (err != mathpresso::kErrorOk) {
+        printf("%-10s [ERROR %u] \"%s\"\n", bench.name, unsigned(err), bench.body);
+        failed = true;
+        continue;
+      }
+
+      report(bench.name, "compile", compile_count, ns);
+
+      // Each row is a call of the compiled function.
+      ns = measure([&]() {
+        for (size_t i = 0; i < rows_count; i++)
+          results[i] = e.evaluate(&rows[i]);
+      });
+      report(bench.name, "evaluate", rows_count, ns);
+      checksum += results[rows_count - 1];
+
+      // Rows evaluated in a loop of the compiled function.
+      ns = measure([&]() {
+        e.evaluate_array(results, rows, sizeof(Row), rows_count);
+      });
+      report(bench.name, "array", rows_count, ns);
+      checksum += results[rows_count - 1];
+    }
+
+    // Printed so the compiler cannot drop the evaluation.
+    printf("Checksum: %.17g\n", checksum);
+
+    free(rows);
+    free(results);
+    return failed ? 1 : 0;
+  }
+};
+
+int main(int argc, char* argv[]) {
+  size_t rows_count = 1024 * 1024;
+  size_t compile_count = 100;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+      rows_count = size_t(strtoull(argv[++i], nullptr, 10));
+    else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc)
+      compile_count = size_t(strtoull(argv[++i], nullptr, 10));
+  }
+
+  if (rows_count == 0)
+    rows_count = 1;
+  if (compile_count == 0)
+    compile_count = 1;
+
+  return BenchApp(rows_count, compile_count).run();
+}
@@ -50,6 +50,11 @@ union DoubleBits {
   double d;
 };
 
+//! Get whether `a` and `b` are the same result - equal, or both NaN (which are never equal).
+static MATHPRESSO_INLINE bool is_same_result(double a, double b) {
+  return a == b || (DoubleBits::from_double(a).is_nan() && DoubleBits::from_double(b).is_nan());
+}
+
 // Test Option
 // ===========
 
@@ -94,6 +99,9 @@ struct TestOutputLog : public mathpresso::OutputLog {
 static double custom1(double x) { return x; }
 static double custom2(double x, double y) { return x + y; }
 
+static int counted_calls;
+static double counted(double x) { counted_calls++; return x; }
+
 // Test Application
 // ================
 
@@ -178,9 +186,22 @@ struct TestApp {
     ctx.add_variable("z"  , 2 * sizeof(double));
     ctx.add_variable("big", 3 * sizeof(double));
 
+    ctx.add_array("row", 0, 4);
+    ctx.add_array("odd", 1 * sizeof(double), 2, 2 * sizeof(double));
+    ctx.add_array("tri", 0 * sizeof(double), 2, 3 * sizeof(double));
+
+    ctx.add_table("lin", 0, 3, 0.0, 2.0);
+    ctx.add_table("cub", 0, 3, 0.0, 4.0, mathpresso::kTableCubic);
+    ctx.add_table_knots("knt", 1 * sizeof(double), 0, 3);
+
     ctx.add_function("custom1", (void*)custom1, mathpresso::kFunctionArg1);
     ctx.add_function("custom2", (void*)custom2, mathpresso::kFunctionArg2);
 
+    ctx.add_inline_function("clamp01", "v", "min(max(v, 0), 1)");
+    ctx.add_inline_function("lerp", "a, b, t", "a + (b - a) * t");
+    ctx.add_inline_function("smoothstep", "e0, e1, v", "clamp01((v - e0) / (e1 - e0)) * clamp01((v - e0) / (e1 - e0)) * (3 - 2 * clamp01((v - e0) / (e1 - e0)))");
+    ctx.add_inline_function("half_pi", "", "PI / 2");
+
     #define TEST_INLINE(exp) { #exp, (double)(exp), { x, y, z } }
     #define TEST_STRING(str, result) { str, result, { x, y, z } }
     #define TEST_OUTPUT(str, result, x, y, z) { str, result, { x, y, z } }
@@ -279,10 +300,15 @@ struct TestApp {
       TEST_STRING("is_nan(1.0 / 0.0)", is_nan(std::numeric_limits<double>::infinity())),
       TEST_STRING("is_finite(1.0 / 0.0)", is_finite(std::numeric_limits<double>::infinity())),
 
+      TEST_STRING("x + 0.0 / 0.0", std::numeric_limits<double>::quiet_NaN()),
+      TEST_STRING("sqrt(-1 - x * x)", std::numeric_limits<double>::quiet_NaN()),
+
       TEST_INLINE(x + y),
       TEST_INLINE(x - y),
       TEST_INLINE(x * y),
       TEST_INLINE(x / y),
+      TEST_INLINE(x / y + z / x),
+      TEST_INLINE((x + 1) / y - (z - 1) / (x + y)),
 
       TEST_INLINE(x * -y),
       TEST_INLINE(x / -y),
@@ -432,6 +458,72 @@ struct TestApp {
       TEST_STRING("var a=x  ; a=a*a*a*a; a", x * x * x * x),
       TEST_STRING("var a=x+1; a=a*a*a  ; a", (x+1.0) * (x+1.0) * (x+1.0)),
       TEST_STRING("var a=x+1; a=a*a*a*a; a", (x+1.0) * (x+1.0) * (x+1.0) * (x+1.0)),
+      TEST_STRING("var a=1; a=a+x; a", 1.0 + x),
+
+      TEST_STRING("var s=0; repeat(4) s=s+x; s", x + x + x + x),
+      TEST_STRING("var s=1; repeat(10) s=s*y; s", ::pow(y, 10.0)),
+      TEST_STRING("var s=5; repeat(0) s=1; s", 5.0),
+      TEST_STRING("var s=5; repeat(-x) s=1; s", 5.0),
+      TEST_STRING("var s=0; repeat(x) { repeat(y) s=s+1; } s", 2.0),
+      TEST_STRING("var a=0, b=1; repeat(z) { var t=a+b; a=b; b=t; } a", 34.0),
+      TEST_STRING("var a=0, b=1; repeat(z) { var t=a; a=b; b=t; } a", 1.0),
+      TEST_STRING("repeat(y) x", x),
+
+      TEST_STRING("var a=x; a=y; a", y),
+      TEST_STRING("var t=x*y; z", z),
+      TEST_STRING("var a=1, b=a+x; b=2; a+b", 3.0),
+      TEST_STRING("var a=x; { a=y; a=z; } a", z),
+      TEST_STRING("var t=0; t=(t=x)+1; t", x + 1.0),
+      TEST_STRING("var a=x; repeat(y) { a=a+1; var t=a; a=a*2; t=a; } a", ((x + 1.0) * 2.0 + 1.0) * 2.0),
+      TEST_OUTPUT("var t=x; x=custom1(y); t=z; t", z, y, y, z),
+
+      TEST_STRING("sqrt(x * y) + sqrt(x * y) * 2", ::sqrt(x * y) * 3.0),
+      TEST_STRING("var a=(x+y)*z; (x+y)*z - a + (x+y)", x + y),
+      TEST_STRING("var a=x+y; var b=x+y; a=1; a+b+(x+y)", 1.0 + (x + y) * 2.0),
+      TEST_OUTPUT("var a=x+y; x=1; a+(x+y)", (x + y) + (1.0 + y), 1.0, y, z),
+      TEST_OUTPUT("x=x*y+(x=y)*y+x*y; x", x * y + y * y + y * y, x * y + y * y + y * y, y, z),
+
+      TEST_STRING("row[0]", x),
+      TEST_STRING("row[2]", z),
+      TEST_STRING("row[y]", z),
+      TEST_STRING("row[-x]", x),
+      TEST_STRING("row[z]", big),
+      TEST_STRING("row[0/0]", x),
+      TEST_STRING("odd[x]", big),
+      TEST_STRING("odd[1] - odd[0]", big - y),
+      TEST_STRING("tri[y] + tri[-1]", big + x),
+      TEST_STRING("var i=0, s=0; repeat(4) { s=s+row[i]; i=i+1; } s", x + y + z + big),
+
+      TEST_INLINE(x > 1 && y < 3),
+      TEST_INLINE(x > 2 || y > 3),
+      TEST_STRING("x > 1 && y > 2 || z < 0", 1.0),
+      TEST_STRING("x < 1 || y > 2 && z < 0", 0.0),
+      TEST_INLINE(x && 0),
+      TEST_INLINE(0 || y),
+      TEST_INLINE(x == 1.5 && !(y == z)),
+      TEST_STRING("(0/0) && x", 1.0),
+      TEST_STRING("var a = x > 1 && y > 1; a + (z > 1 || x > 9)", 2.0),
+
+      TEST_STRING("clamp01(x)", 1.0),
+      TEST_STRING("clamp01(-x)", 0.0),
+      TEST_STRING("clamp01(x - 1)", x - 1.0),
+      TEST_STRING("lerp(x, y, 0.5)", (x + y) * 0.5),
+      TEST_STRING("lerp(1, 3, 1) * 2", 6.0),
+      TEST_STRING("smoothstep(1, 2, x)", 0.5),
+      TEST_STRING("var t = x; lerp(t, y, clamp01(t - 1))", x + (y - x) * (x - 1.0)),
+      TEST_STRING("half_pi()", 3.14159265358979323846 / 2),
+
+      TEST_STRING("lin(0.5)", x + (y - x) * 0.5),
+      TEST_STRING("lin(1.5)", y + (z - y) * 0.5),
+      TEST_STRING("lin(-x)", x),
+      TEST_STRING("lin(z)", z),
+      TEST_STRING("is_nan(lin(0/0))", 1.0),
+      TEST_STRING("cub(2)", y),
+      TEST_STRING("cub(-big)", x),
+      TEST_STRING("knt(y)", z),
+      TEST_STRING("knt(2)", y + (z - y) * 0.5),
+      TEST_STRING("knt(0)", y),
+      TEST_STRING("is_nan(knt(0/0))", 1.0),
 
       TEST_OUTPUT("x = 11; y = 22; z = 33"   , 33.0, 11.0, 22.0, 33.0),
       TEST_OUTPUT("x = 11; y = 22; z = 33;"  , 33.0, 11.0, 22.0, 33.0),
@@ -441,7 +533,8 @@ struct TestApp {
       TEST_OUTPUT("x =  y; y =  z; x = 99; z", z   , 99.0, z,    z   ),
 
       TEST_OUTPUT("var t = x; x = y; y = z; z = t"   , x, y, z, x),
-      TEST_OUTPUT("var t = x; x = y; y = z; z = t; t", x, y, z, x)
+      TEST_OUTPUT("var t = x; x = y; y = z; z = t; t", x, y, z, x),
+      TEST_OUTPUT("x = 0; repeat(y) x = x + z; x", z + z, z + z, y, z)
     };
 
     #undef TEST_OUTPUT
@@ -463,6 +556,13 @@ struct TestApp {
       { "No-AVX"    , defaultOptions | mathpresso::kOptionDisableAVX    },
       { "No-AVX512" , defaultOptions | mathpresso::kOptionDisableAVX512 },
 #endif
+      { "FTZ"       , defaultOptions | mathpresso::kOptionFlushDenormals },
+      { "Finite"    , defaultOptions | mathpresso::kOptionFiniteFastPath },
+      { "Array"     , defaultOptions | mathpresso::kOptionArrayLoop | mathpresso::kOptionFiniteFastPath },
+      { "Reduce"    , defaultOptions | mathpresso::kOptionReduceLoop | mathpresso::kOptionKahanSum },
+      { "Filter"    , defaultOptions | mathpresso::kOptionFilterLoop | mathpresso::kOptionFiniteFastPath },
+      { "Gather"    , defaultOptions | mathpresso::kOptionGatherLoop },
+      { "Stream"    , defaultOptions | mathpresso::kOptionArrayLoop | mathpresso::kOptionStreamingStores | mathpresso::kOptionFiniteFastPath },
       { "Native"    , defaultOptions                                    }
     };
 
@@ -492,14 +592,76 @@ struct TestApp {
         double arg[] = { x, y, z, big };
         double result = e.evaluate(arg);
 
-        if (result != test.result ||
+        // Evaluate 3 copies of the row through the array API, which must give the same result.
+        double array_rows[3][4];
+        for (int i = 0; i < 3; i++) {
+          array_rows[i][0] = x;
+          array_rows[i][1] = y;
+          array_rows[i][2] = z;
+          array_rows[i][3] = big;
+        }
+
+        double array_results[3];
+        e.evaluate_array(array_results, array_rows, sizeof(array_rows[0]), 3);
+
+        for (int i = 0; i < 3; i++) {
+          if (!is_same_result(array_results[i], result)) {
+            printf("[Failure]: \"%s\" (%s)\n", exp, option.name);
+            printf("  evaluate_array(row %d: %.17g) != evaluate(%.17g)\n", i, array_results[i], result);
+            allOk = false;
+          }
+        }
+
+        // Reducing the same row must give the result (NaN results are skipped).
+        mathpresso::ReduceResult reduced;
+        double reduce_row[] = { x, y, z, big };
+        e.reduce_array(&reduced, reduce_row, sizeof(reduce_row), 1);
+
+        if (result == result ? (reduced.count != 1 || reduced.sum != result || reduced.min != result || reduced.max != result)
+                             : (reduced.count != 0)) {
+          printf("[Failure]: \"%s\" (%s)\n", exp, option.name);
+          printf("  reduce_array(sum=%.17g count=%u) doesn't match evaluate(%.17g)\n", reduced.sum, unsigned(reduced.count), result);
+          allOk = false;
+        }
+
+        // Filter 64 copies of the row, so the compiled bitmap function is used (if compiled).
+        double filter_rows[64][4];
+        for (int i = 0; i < 64; i++) {
+          filter_rows[i][0] = x;
+          filter_rows[i][1] = y;
+          filter_rows[i][2] = z;
+          filter_rows[i][3] = big;
+        }
+
+        uint64_t bitmap = 0;
+        e.filter_bitmap(&bitmap, filter_rows, sizeof(filter_rows[0]), 64);
+
+        if (bitmap != ((result != 0.0 && result == result) ? ~uint64_t(0) : uint64_t(0))) {
+          printf("[Failure]: \"%s\" (%s)\n", exp, option.name);
+          printf("  filter_bitmap(%016llX) doesn't match evaluate(%.17g)\n", (unsigned long long)bitmap, result);
+          allOk = false;
+        }
+
+        // Evaluate the second of two rows selected by its index.
+        double gather_rows[2][4] = { { 0.0, 0.0, 0.0, 0.0 }, { x, y, z, big } };
+        uint32_t gather_index = 1;
+        double gather_result;
+        e.evaluate_indexed(&gather_result, gather_rows, sizeof(gather_rows[0]), &gather_index, 1);
+
+        if (!is_same_result(gather_result, result)) {
+          printf("[Failure]: \"%s\" (%s)\n", exp, option.name);
+          printf("  evaluate_indexed(%.17g) != evaluate(%.17g)\n", gather_result, result);
+          allOk = false;
+        }
+
+        if (!is_same_result(result, test.result) ||
             arg[0] != test.xyz[0] ||
             arg[1] != test.xyz[1] ||
             arg[2] != test.xyz[2]) {
           printf("[Failure]: \"%s\" (%s)\n", exp, option.name);
 
           static const char indentation[] = "  ";
-          if (result != test.result) printf("%s _(%.17g) != expected(%.17g)\n", indentation, result, test.result);
+          if (!is_same_result(result, test.result)) printf("%s _(%.17g) != expected(%.17g)\n", indentation, result, test.result);
           if (arg[0] != test.xyz[0]) printf("%s x(%.17g) != expected(%.17g)\n", indentation, arg[0], test.xyz[0]);
           if (arg[1] != test.xyz[1]) printf("%s y(%.17g) != expected(%.17g)\n", indentation, arg[1], test.xyz[1]);
           if (arg[2] != test.xyz[2]) printf("%s z(%.17g) != expected(%.17g)\n", indentation, arg[2], test.xyz[2]);
@@ -514,6 +676,638 @@ struct TestApp {
         failed = true;
     }
 
+    // A product of normal numbers that is denormal must be flushed to zero, and the caller's mode must be restored.
+    {
+      const char* exp = "x * y";
+      double arg[] = { 2.2250738585072014e-308, 0.25, z, big };
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionFlushDenormals, &outputLog);
+      double result = err ? 1.0 : e.evaluate(arg);
+
+      volatile double a = arg[0];
+      volatile double b = arg[1];
+      double host = a * b;
+
+      if (err || result != 0.0 || host == 0.0) {
+        printf("[Failure]: \"%s\" (FTZ)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (FTZ)\n", exp);
+      }
+    }
+
+    // Specialization must give the same result as passing the values through the data, also after respecialize().
+    {
+      const char* exp = "x * y + z";
+      const char* names[] = { "y", "z" };
+      double values[] = { y, z };
+
+      int err = e.specialize(ctx, exp, names, values, 2, defaultOptions, &outputLog);
+      double arg[] = { x, 0.0, 0.0, big };
+      double result = err ? 0.0 : e.evaluate(arg);
+
+      values[1] = big;
+      if (!err)
+        err = e.respecialize(values, &outputLog);
+      double result2 = err ? 0.0 : e.evaluate(arg);
+
+      if (err || result != x * y + z || result2 != x * y + big) {
+        printf("[Failure]: \"%s\" (Specialized)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Specialized)\n", exp);
+      }
+    }
+
+    // A derived context must resolve symbols of its parent and shadow them by its own symbols.
+    {
+      const char* exp = "x * y + w";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_variable("w", 3 * sizeof(double));
+      derived.add_constant("y", 2.0);
+
+      int err = e.compile(derived, exp, defaultOptions, &outputLog);
+      double arg[] = { x, y, z, big };
+      double result = err ? 0.0 : e.evaluate(arg);
+
+      if (err || result != x * 2.0 + big) {
+        printf("[Failure]: \"%s\" (Derived)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Derived)\n", exp);
+      }
+    }
+
+    // Variables bound to other base pointers must be read from (and written to) their own base.
+    {
+      const char* exp = "k = k + 1; x * k + g";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_variable("k", 0 * sizeof(double), mathpresso::kVariableBase1);
+      derived.add_variable("g", 1 * sizeof(double), mathpresso::kVariableBase2 | mathpresso::kVariableRO);
+
+      int err = e.compile(derived, exp, defaultOptions, &outputLog);
+      double arg[] = { x, y, z, big };
+      double params[] = { 2.0 };
+      double globals[] = { 0.0, 5.0 };
+      void* bases[] = { arg, params, globals };
+      double result = err ? 0.0 : e.evaluate_bases(bases);
+
+      if (err || result != x * 3.0 + 5.0 || params[0] != 3.0) {
+        printf("[Failure]: \"%s\" (Bases)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Bases)\n", exp);
+      }
+    }
+
+    // Uniform subexpressions are computed once before the loop over rows, which must not change the results.
+    {
+      const char* exp = "x * sqrt(k * g) + y";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_variable("k", 0 * sizeof(double), mathpresso::kVariableBase1);
+      derived.add_variable("g", 1 * sizeof(double), mathpresso::kVariableBase1);
+
+      int err = e.compile(derived, exp, defaultOptions | mathpresso::kOptionArrayLoop, &outputLog);
+      double rows[3][4] = { { x, y, z, big }, { y, z, x, big }, { z, x, y, big } };
+      double params[] = { 2.0, 8.0 };
+      void* bases[] = { nullptr, params };
+      double results[3] = { 0.0, 0.0, 0.0 };
+
+      if (!err)
+        e.evaluate_array(results, rows, sizeof(rows[0]), 3, bases);
+
+      bool ok = !err;
+      for (int i = 0; i < 3; i++)
+        ok &= results[i] == rows[i][0] * 4.0 + rows[i][1];
+
+      if (!ok) {
+        printf("[Failure]: \"%s\" (Hoisted)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Hoisted)\n", exp);
+      }
+    }
+
+    // A uniform subexpression that is computed twice must not be shared by a variable that a hoisted parent reads.
+    {
+      const char* exp = "x * sqrt(k * g) + y * (k * g)";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_variable("k", 0 * sizeof(double), mathpresso::kVariableBase1);
+      derived.add_variable("g", 1 * sizeof(double), mathpresso::kVariableBase1);
+
+      int err = e.compile(derived, exp, defaultOptions | mathpresso::kOptionArrayLoop, &outputLog);
+      double rows[3][4] = { { x, y, z, big }, { y, z, x, big }, { z, x, y, big } };
+      double params[] = { 2.0, 8.0 };
+      void* bases[] = { nullptr, params };
+      double results[3] = { 0.0, 0.0, 0.0 };
+
+      if (!err)
+        e.evaluate_array(results, rows, sizeof(rows[0]), 3, bases);
+
+      bool ok = !err;
+      for (int i = 0; i < 3; i++)
+        ok &= results[i] == rows[i][0] * 4.0 + rows[i][1] * 16.0;
+
+      if (!ok) {
+        printf("[Failure]: \"%s\" (Hoisted)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Hoisted)\n", exp);
+      }
+    }
+
+    // Calls of functions that can have side effects must not be hoisted, even if their arguments are uniform.
+    {
+      const char* exp = "var a = 0; repeat (2) a = a + counted(k); x * counted(k) + a";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_variable("k", 0 * sizeof(double), mathpresso::kVariableBase1);
+      derived.add_function("counted", (void*)counted, mathpresso::kFunctionArg1);
+
+      int err = e.compile(derived, exp, defaultOptions | mathpresso::kOptionArrayLoop, &outputLog);
+      double rows[3][4] = { { x, y, z, big }, { y, z, x, big }, { z, x, y, big } };
+      double params[] = { 2.0 };
+      void* bases[] = { nullptr, params };
+      double results[3] = { 0.0, 0.0, 0.0 };
+
+      counted_calls = 0;
+      if (!err)
+        e.evaluate_array(results, rows, sizeof(rows[0]), 3, bases);
+
+      bool ok = !err && counted_calls == 9;
+      for (int i = 0; i < 3; i++)
+        ok &= results[i] == rows[i][0] * 2.0 + 4.0;
+
+      if (!ok) {
+        printf("[Failure]: \"%s\" (Impure)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Impure)\n", exp);
+      }
+    }
+
+    // Logical operators having a constant result must still call impure functions of the other operand.
+    {
+      const char* exp = "(counted(x) && 0) + (counted(y) || 1)";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_function("counted", (void*)counted, mathpresso::kFunctionArg1);
+
+      int err = e.compile(derived, exp, defaultOptions, &outputLog);
+      double arg[] = { x, y, z, big };
+
+      counted_calls = 0;
+      double result = err ? 0.0 : e.evaluate(arg);
+
+      if (err || result != 1.0 || counted_calls != 2) {
+        printf("[Failure]: \"%s\" (Impure)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Impure)\n", exp);
+      }
+    }
+
+    // Calls of functions without side effects having the same arguments must be shared.
+    {
+      const char* exp = "counted(x) * 2 + counted(x)";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_function("counted", (void*)counted, mathpresso::kFunctionArg1 | mathpresso::kFunctionNoSideEffects);
+
+      int err = e.compile(derived, exp, defaultOptions, &outputLog);
+      double arg[] = { x, y, z, big };
+
+      counted_calls = 0;
+      double result = err ? 0.0 : e.evaluate(arg);
+
+      if (err || result != x * 2.0 + x || counted_calls != 1) {
+        printf("[Failure]: \"%s\" (Shared)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Shared)\n", exp);
+      }
+    }
+
+    // Impure arguments of inline functions must be evaluated exactly once, otherwise the call is rejected.
+    {
+      const char* exp = "clamp01(counted(x))";
+      const char* rejected = "smoothstep(0, 1, counted(x))";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_function("counted", (void*)counted, mathpresso::kFunctionArg1);
+
+      mathpresso::Expression e_rejected;
+      int rejected_err = e_rejected.compile(derived, rejected, defaultOptions);
+
+      int err = e.compile(derived, exp, defaultOptions, &outputLog);
+      double arg[] = { 0.5, y, z, big };
+
+      counted_calls = 0;
+      double result = err ? 0.0 : e.evaluate(arg);
+
+      if (err || rejected_err != mathpresso::kErrorInvalidSyntax || result != 0.5 || counted_calls != 1) {
+        printf("[Failure]: \"%s\" (Impure)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Impure)\n", exp);
+      }
+    }
+
+    // A compensated sum must be INF (not NaN) once a row is INF.
+    {
+      const char* exp = "x";
+      double inf = std::numeric_limits<double>::infinity();
+      double rows[3][4] = { { 1.0, y, z, big }, { inf, z, x, big }, { 2.0, x, y, big } };
+
+      mathpresso::ReduceResult reduced;
+      reduced.sum = 0.0;
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionReduceLoop | mathpresso::kOptionKahanSum, &outputLog);
+      if (!err)
+        e.reduce_array(&reduced, rows, sizeof(rows[0]), 3);
+
+      if (err || reduced.sum != inf || reduced.count != 3 || reduced.max != inf) {
+        printf("[Failure]: \"%s\" (Kahan)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Kahan)\n", exp);
+      }
+    }
+
+    // Rows with different results that cross a word of the bitmap must select the same rows as evaluate(), a NaN
+    // predicate selects nothing.
+    {
+      const char* exp = "x > y";
+      double rows[100][4];
+      uint32_t expected[100];
+      size_t expected_count = 0;
+
+      for (int i = 0; i < 100; i++) {
+        rows[i][0] = double(i);
+        rows[i][1] = double((i * 37) % 100);
+        rows[i][2] = z;
+        rows[i][3] = big;
+      }
+      rows[63][0] = std::numeric_limits<double>::quiet_NaN();
+
+      for (int i = 0; i < 100; i++) {
+        if (rows[i][0] > rows[i][1])
+          expected[expected_count++] = uint32_t(i);
+      }
+
+      uint64_t bitmap[2] = { 0, ~uint64_t(0) };
+      uint32_t indices[100];
+      size_t count = 0;
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionFilterLoop | mathpresso::kOptionFiniteFastPath, &outputLog);
+      if (!err) {
+        e.filter_bitmap(bitmap, rows, sizeof(rows[0]), 100);
+        count = e.filter_array(indices, rows, sizeof(rows[0]), 100);
+      }
+
+      bool ok = !err && count == expected_count && (bitmap[1] >> 36) == 0;
+      for (size_t i = 0; ok && i < count; i++)
+        ok = indices[i] == expected[i];
+      for (uint32_t i = 0; ok && i < 100; i++)
+        ok = ((bitmap[i / 64] >> (i % 64)) & 1u) == uint64_t(rows[i][0] > rows[i][1]);
+
+      if (!ok) {
+        printf("[Failure]: \"%s\" (Filter)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Filter)\n", exp);
+      }
+    }
+
+    // Nulls must propagate to results of rows that read them.
+    {
+      const char* exp = "x + y";
+      double rows[3][4] = { { x, y, z, big }, { y, z, x, big }, { z, x, y, big } };
+      uint64_t x_valid = 0x5; // Row 1 is null.
+      uint64_t z_valid = 0x3; // Row 2 is null, but `z` is not read.
+      mathpresso::ValidityBitmap validity[] = {
+        { 0 * sizeof(double), &x_valid },
+        { 2 * sizeof(double), &z_valid }
+      };
+
+      double results[3];
+      uint64_t result_validity = 0;
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionArrayLoop, &outputLog);
+      if (!err)
+        e.evaluate_array_nullable(results, &result_validity, rows, sizeof(rows[0]), 3, validity, 2);
+
+      if (err || result_validity != 0x5 || results[0] != x + y || results[1] == results[1] || results[2] != z + x) {
+        printf("[Failure]: \"%s\" (Nullable)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Nullable)\n", exp);
+      }
+    }
+
+    // Null rows must not be evaluated and variables that are only written are not inputs.
+    {
+      const char* exp = "z = 1; x + counted(y)";
+      mathpresso::Context derived;
+      derived.derive_from(ctx);
+      derived.add_function("counted", (void*)counted, mathpresso::kFunctionArg1);
+
+      double rows[3][4] = { { x, y, z, big }, { y, z, x, big }, { z, x, y, big } };
+      uint64_t x_valid = 0x5; // Row 1 is null.
+      uint64_t z_valid = 0x3; // Row 2 is null, but `z` is only written.
+      mathpresso::ValidityBitmap validity[] = {
+        { 0 * sizeof(double), &x_valid },
+        { 2 * sizeof(double), &z_valid }
+      };
+
+      double results[3];
+      uint64_t result_validity = 0;
+
+      int err = e.compile(derived, exp, defaultOptions | mathpresso::kOptionArrayLoop, &outputLog);
+      counted_calls = 0;
+      if (!err)
+        e.evaluate_array_nullable(results, &result_validity, rows, sizeof(rows[0]), 3, validity, 2);
+
+      if (err || result_validity != 0x5 || counted_calls != 2 || rows[1][2] != x || results[1] == results[1] ||
+          results[0] != x + y || results[2] != z + x) {
+        printf("[Failure]: \"%s\" (Nullable)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Nullable)\n", exp);
+      }
+    }
+
+    // Partial derivatives must be computed together with the result.
+    {
+      const char* exp = "var t = x * y; t + sin(x) - z / y";
+      const char* names[] = { "x", "y", "z" };
+      int offsets[] = { 4 * sizeof(double), 5 * sizeof(double), 6 * sizeof(double) };
+
+      int err = e.compile_gradient(ctx, exp, names, offsets, 3, defaultOptions, &outputLog);
+      double arg[] = { x, y, z, big, 0.0, 0.0, 0.0 };
+      double result = err ? 0.0 : e.evaluate_gradient(arg);
+
+      double dx = y + cos(x);
+      double dy = x + z / (y * y);
+      double dz = -1.0 / y;
+
+      if (err || result != x * y + sin(x) - z / y ||
+          fabs(arg[4] - dx) > 1e-12 || fabs(arg[5] - dy) > 1e-12 || fabs(arg[6] - dz) > 1e-12) {
+        printf("[Failure]: \"%s\" (Gradient)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Gradient)\n", exp);
+      }
+    }
+
+    // Derivatives must flow through locals, assignments, the selected operand of min/max, and pow. Derivatives of
+    // functions are unknown, so only the partial derivative of their argument is NaN.
+    {
+      struct GradientTest {
+        const char* exp;
+        double result;
+        double d[3];
+      };
+
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      double t = x * y + z;
+
+      GradientTest gradient_tests[] = {
+        { "var a = x * x; var b = a * y; b + a"   , x * x * y + x * x     , { 2.0 * x * y + 2.0 * x, x * x, 0.0 } },
+        { "var a = x; a = a * y; a = a + z; a * a", t * t                 , { 2.0 * t * y, 2.0 * t * x, 2.0 * t } },
+        { "min(x, y) * 3 + max(y, z) * 2"         , x * 3.0 + z * 2.0     , { 3.0, 0.0, 2.0 } },
+        { "pow(x, y) + pow(z, 2)"                 , pow(x, y) + z * z     , { y * pow(x, y - 1.0), pow(x, y) * log(x), 2.0 * z } },
+        { "custom1(x) + y * z"                    , x + y * z             , { nan, z, y } }
+      };
+
+      const char* names[] = { "x", "y", "z" };
+      int offsets[] = { 4 * sizeof(double), 5 * sizeof(double), 6 * sizeof(double) };
+
+      for (const GradientTest& test : gradient_tests) {
+        int err = e.compile_gradient(ctx, test.exp, names, offsets, 3, defaultOptions, &outputLog);
+        double arg[] = { x, y, z, big, 0.0, 0.0, 0.0 };
+        double result = err ? 0.0 : e.evaluate_gradient(arg);
+
+        bool ok = !err && fabs(result - test.result) <= 1e-12 * fabs(test.result);
+        for (int i = 0; ok && i < 3; i++) {
+          double d = arg[4 + i];
+          ok = test.d[i] != test.d[i] ? d != d : fabs(d - test.d[i]) <= 1e-12 * (fabs(test.d[i]) + 1.0);
+        }
+
+        if (!ok) {
+          printf("[Failure]: \"%s\" (Gradient)\n", test.exp);
+          printf("  result=%.17g dx=%.17g dy=%.17g dz=%.17g\n", result, arg[4], arg[5], arg[6]);
+          failed = true;
+        }
+        else {
+          printf("[Success]: \"%s\" (Gradient)\n", test.exp);
+        }
+      }
+    }
+
+    // The interval result must contain results of all points of the input intervals, like their bounds.
+    {
+      const char* exp = "x * y + exp(z) - y";
+      mathpresso::Interval args[] = { { x, x + 1.0 }, { y, y + 1.0 }, { z, z + 1.0 }, { big, big } };
+      mathpresso::Interval result = { 0.0, 0.0 };
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionInterval, &outputLog);
+      if (!err)
+        e.evaluate_interval(&result, args);
+
+      double lo = x * y + ::exp(z) - y;
+      double hi = (x + 1.0) * (y + 1.0) + ::exp(z + 1.0) - (y + 1.0);
+
+      if (err || !(result.lo <= lo && lo <= result.hi) || !(result.lo <= hi && hi <= result.hi) ||
+          !is_finite(result.lo) || !is_finite(result.hi)) {
+        printf("[Failure]: \"%s\" (Interval)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Interval)\n", exp);
+      }
+    }
+
+    // Points having a NaN result must be included in conditions - `sqrt(x)` is NaN for `x < 0`.
+    {
+      const char* exps[] = { "isnan(sqrt(x))", "sqrt(x) < 2", "sqrt(x)" };
+      mathpresso::Interval args[] = { { -1.0, 1.0 }, { y, y }, { z, z }, { big, big } };
+
+      for (const char* exp : exps) {
+        mathpresso::Interval result = { 0.0, 0.0 };
+
+        int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionInterval, &outputLog);
+        if (!err)
+          e.evaluate_interval(&result, args);
+
+        // Conditions must be `[0, 1]`, `sqrt(x)` must be `[0, 1]` that may be NaN (`lo > hi`).
+        bool ok = exp == exps[2] ? result.hi <= 0.0 && result.lo >= 1.0 : result.lo == 0.0 && result.hi == 1.0;
+
+        if (err || !ok) {
+          printf("[Failure]: \"%s\" (Interval NaN)\n", exp);
+          failed = true;
+        }
+        else {
+          printf("[Success]: \"%s\" (Interval NaN)\n", exp);
+        }
+      }
+    }
+
+    // Harmonic oscillator integrated from [1, 0] to t = 1, the exact solution is [cos(t), -sin(t)].
+    {
+      const char* exp = "x' = y, y' = -x";
+      const char* bodies[] = { "y", "-x" };
+      const char* names[] = { "x", "y" };
+
+      double rk4_arg[] = { 1.0, 0.0, 0.0, 0.0 };
+      double rk45_arg[] = { 1.0, 0.0, 0.0, 0.0 };
+      mathpresso::OdeIntegration rk4 = { 0.0, 0.01, 0.0, 0.0, 100 };
+      mathpresso::OdeIntegration rk45 = { 0.0, 0.1, 1.0, 1e-10, 1000 };
+
+      int err = e.compile_ode(ctx, bodies, names, 2, "z", mathpresso::kOdeRK4, defaultOptions, &outputLog);
+      if (!err) {
+        e.integrate(&rk4, rk4_arg);
+        err = e.compile_ode(ctx, bodies, names, 2, "z", mathpresso::kOdeRK45, defaultOptions, &outputLog);
+      }
+      if (!err)
+        e.integrate(&rk45, rk45_arg);
+
+      if (err || rk4.steps != 0 || fabs(rk4_arg[0] - cos(1.0)) > 1e-8 || fabs(rk4_arg[1] + sin(1.0)) > 1e-8 ||
+          rk45.t != 1.0 || fabs(rk45_arg[0] - cos(1.0)) > 1e-8 || fabs(rk45_arg[1] + sin(1.0)) > 1e-8) {
+        printf("[Failure]: \"%s\" (ODE)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (ODE)\n", exp);
+      }
+    }
+
+    // The variant speculating on a constant `y` must only be used by chunks of rows that match the profile.
+    {
+      const char* exp = "x * y + z";
+      double rows[512][4];
+      double results[512];
+
+      for (int i = 0; i < 512; i++) {
+        rows[i][0] = x + i;
+        rows[i][1] = y;
+        rows[i][2] = z;
+        rows[i][3] = big;
+      }
+
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionProfile | mathpresso::kOptionReduceLoop | mathpresso::kOptionGatherLoop, &outputLog);
+      bool ok = !err;
+
+      // Rows evaluated as an array are not sampled, only rows passed to `sample()`.
+      if (ok) {
+        e.evaluate_array(results, rows, sizeof(rows[0]), 512);
+        for (int i = 0; i < 64; i++)
+          ok &= e.sample(rows[i * 8]) == rows[i * 8][0] * y + z;
+        err = e.reoptimize(&outputLog);
+      }
+
+      mathpresso::VariableProfile profile[4];
+      size_t profile_count = err ? 0 : e.profile(profile, 4);
+
+      ok &= !err && profile_count == 3;
+      for (size_t i = 0; ok && i < profile_count; i++)
+        ok = profile[i].count == 64 && profile[i].constant == (profile[i].offset != 0);
+
+      // A single row in the second chunk doesn't match, so the whole chunk is evaluated by the regular function
+      // within the same call that evaluates the first chunk by the variant.
+      rows[300][1] = z;
+      if (ok)
+        e.evaluate_array(results, rows, sizeof(rows[0]), 512);
+
+      // Reductions and selected rows are guarded the same way.
+      if (ok) {
+        mathpresso::ReduceResult reduced;
+        e.reduce_array(&reduced, rows, sizeof(rows[0]), 512);
+
+        double lo = results[0];
+        double hi = results[0];
+        for (int i = 1; i < 512; i++) {
+          lo = results[i] < lo ? results[i] : lo;
+          hi = results[i] > hi ? results[i] : hi;
+        }
+
+        const uint32_t indices[4] = { 511, 300, 0, 299 };
+        double selected[4];
+        e.evaluate_indexed(selected, rows, sizeof(rows[0]), indices, 4);
+
+        ok = reduced.count == 512 && reduced.min == lo && reduced.max == hi;
+        for (int i = 0; ok && i < 4; i++)
+          ok = selected[i] == results[indices[i]];
+      }
+
+      if (!ok || results[0] != x * y + z || results[255] != (x + 255) * y + z ||
+          results[299] != (x + 299) * y + z || results[300] != (x + 300) * z + z || results[511] != (x + 511) * y + z) {
+        printf("[Failure]: \"%s\" (Profiled)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Profiled)\n", exp);
+      }
+    }
+
+    // Outcomes of comparisons are counted by sampled rows only, including comparisons combined by `&&`.
+    {
+      const char* exp = "(x > 2) + (x < 6 && y == 1)";
+      double rows[8][4];
+
+      for (int i = 0; i < 8; i++) {
+        rows[i][0] = double(i);
+        rows[i][1] = double(i & 1);
+        rows[i][2] = z;
+        rows[i][3] = big;
+      }
+
+      double results[8];
+      int err = e.compile(ctx, exp, defaultOptions | mathpresso::kOptionProfile, &outputLog);
+      bool ok = !err;
+
+      if (ok) {
+        e.evaluate_array(results, rows, sizeof(rows[0]), 8);
+        for (int i = 0; i < 8; i++)
+          ok &= e.sample(rows[i]) == results[i];
+      }
+
+      mathpresso::ConditionProfile conditions[4];
+      size_t condition_count = ok ? e.condition_profile(conditions, 4) : 0;
+
+      // x > 2 is true for 5 rows, x < 6 for 6 rows, and y == 1 for odd rows.
+      ok &= condition_count == 3;
+      for (size_t i = 0; ok && i < condition_count; i++)
+        ok = conditions[i].count == 8 && conditions[i].position < strlen(exp);
+
+      if (!ok || conditions[0].true_count != 5 || conditions[1].true_count != 6 || conditions[2].true_count != 4) {
+        printf("[Failure]: \"%s\" (Conditions)\n", exp);
+        failed = true;
+      }
+      else {
+        printf("[Success]: \"%s\" (Conditions)\n", exp);
+      }
+    }
+
     return failed ? 1 : 0;
   }
 };